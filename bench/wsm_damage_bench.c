@@ -0,0 +1,147 @@
+#include "wsm_log.h"
+#include "wsm_common.h"
+#include "wsm_config.h"
+#include "wsm_damage.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <pixman.h>
+
+#define BENCH_DEFAULT_RECTS 256
+#define BENCH_DEFAULT_ITERATIONS 10000
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+// windows the damage is clipped to, as the render list entries of a frame
+#define BENCH_WINDOWS_X 4
+#define BENCH_WINDOWS_Y 3
+
+struct wsm_config global_config = {0};
+
+struct bench_pattern {
+	const char *name;
+	int x, y, width, height; // area the damaged rectangles fall in
+	int rect_width, rect_height;
+};
+
+static const struct bench_pattern patterns[] = {
+	// blinking cursors and clocks all over the output
+	{ "scattered", 0, 0, BENCH_WIDTH, BENCH_HEIGHT, 8, 16 },
+	// a terminal scrolling text line by line
+	{ "clustered", 100, 100, 640, 480, 24, 16 },
+};
+
+static const struct {
+	const char *name;
+	enum wsm_damage_policy policy;
+} policies[] = {
+	{ "none", WSM_DAMAGE_POLICY_NONE },
+	{ "bounding_box", WSM_DAMAGE_POLICY_BOUNDING_BOX },
+	{ "tiles", WSM_DAMAGE_POLICY_TILES },
+	{ "auto", WSM_DAMAGE_POLICY_AUTO },
+};
+
+static uint32_t bench_random(uint32_t *state) {
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static void pattern_region(const struct bench_pattern *pattern, int num_rects,
+		pixman_region32_t *region) {
+	uint32_t seed = 1;
+	for (int i = 0; i < num_rects; ++i) {
+		int x = pattern->x + bench_random(&seed) % (pattern->width - pattern->rect_width);
+		int y = pattern->y + bench_random(&seed) % (pattern->height - pattern->rect_height);
+		pixman_region32_union_rect(region, region, x, y,
+			pattern->rect_width, pattern->rect_height);
+	}
+}
+
+/**
+ * Every window of the frame is drawn clipped to the damage, which costs one
+ * scissored draw per rectangle left after the intersection.
+ */
+static int clip_to_windows(const pixman_region32_t *damage) {
+	int window_width = BENCH_WIDTH / BENCH_WINDOWS_X;
+	int window_height = BENCH_HEIGHT / BENCH_WINDOWS_Y;
+	int draws = 0;
+
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+	for (int y = 0; y < BENCH_WINDOWS_Y; ++y) {
+		for (int x = 0; x < BENCH_WINDOWS_X; ++x) {
+			pixman_region32_intersect_rect(&clip, (pixman_region32_t *)damage,
+				x * window_width, y * window_height, window_width, window_height);
+			draws += pixman_region32_n_rects(&clip);
+		}
+	}
+	pixman_region32_fini(&clip);
+	return draws;
+}
+
+/**
+ * @brief wsm_damage_bench time wsm_damage_simplify() under every damage policy
+ *
+ * @details Synthetic fragmented damage is simplified and then clipped to a
+ * grid of windows, as a repaint does with its render list. For each pattern
+ * and policy the time of these region operations per frame is printed next to
+ * the pixels the simplification adds, which is what the policy trades. Only
+ * pixman is used, no backend nor renderer.
+ *
+ * Usage: wsm_damage_bench [rects] [iterations]
+ */
+int main(int argc, char **argv) {
+	int num_rects = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_RECTS;
+	int iterations = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_ITERATIONS;
+	if (num_rects <= 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [rects] [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	wsm_log_init(WSM_ERROR, NULL);
+
+	// the defaults of the config
+	global_config.damage_max_rects = 32;
+	global_config.damage_max_waste = 0.5f;
+	global_config.damage_tile_size = 64;
+
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+		const struct bench_pattern *pattern = &patterns[i];
+		pixman_region32_t source;
+		pixman_region32_init(&source);
+		pattern_region(pattern, num_rects, &source);
+		printf("%s: %d rects, %" PRIu64 " px damaged\n", pattern->name,
+			pixman_region32_n_rects(&source), wsm_region_area(&source));
+
+		for (size_t j = 0; j < sizeof(policies) / sizeof(policies[0]); ++j) {
+			global_config.damage_policy = policies[j].policy;
+
+			pixman_region32_t damage;
+			pixman_region32_init(&damage);
+			uint64_t overdraw_px = 0;
+			int rects = 0, draws = 0;
+
+			struct timespec start, end, duration;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (int k = 0; k < iterations; ++k) {
+				pixman_region32_copy(&damage, &source);
+				overdraw_px = wsm_damage_simplify(&damage, BENCH_WIDTH, BENCH_HEIGHT);
+				draws = clip_to_windows(&damage);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			timespec_sub(&duration, &end, &start);
+			rects = pixman_region32_n_rects(&damage);
+			pixman_region32_fini(&damage);
+
+			printf("  %-12s %8" PRId64 " ns per frame, %5d rects, %5d draws, "
+				"%8" PRIu64 " overdraw_px\n", policies[j].name,
+				timespec_to_nsec(&duration) / iterations, rects, draws, overdraw_px);
+		}
+		pixman_region32_fini(&source);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#include "wsm_log.h"
+#include "wsm_common.h"
+#include "wsm_server.h"
+#include "wsm_container.h"
+#include "wsm_workspace.h"
+#include "wsm_transaction.h"
+#include "node/wsm_node.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <wlr/util/log.h>
+
+#define BENCH_DEFAULT_CONTAINERS 256
+#define BENCH_DEFAULT_ITERATIONS 1000
+
+struct wsm_server global_server = {0};
+
+/**
+ * @brief wsm_transaction_bench time transaction_commit_dirty()
+ *
+ * @details Every container of a workspace on the headless fallback output is
+ * marked dirty and committed, over and over. None of them has a view, so the
+ * transactions apply right away: the time measured is the one of splitting
+ * the dirty nodes into transactions, copying their state, applying it and
+ * arranging the scene.
+ *
+ * Usage: wsm_transaction_bench [containers] [iterations]
+ */
+int main(int argc, char **argv) {
+	int num_containers = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_CONTAINERS;
+	int iterations = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_ITERATIONS;
+	if (num_containers <= 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [containers] [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_ERROR, NULL);
+	wsm_log_init(WSM_ERROR, NULL);
+
+	setenv("WLR_BACKENDS", "headless", false);
+	setenv("WLR_RENDERER", "pixman", false);
+	if (!wsm_server_init(&global_server)) {
+		return EXIT_FAILURE;
+	}
+
+	struct wsm_workspace *ws =
+		workspace_create(global_server.scene->fallback_output, "bench");
+	if (!ws) {
+		server_finish(&global_server);
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < num_containers; ++i) {
+		struct wsm_container *con = container_create(NULL);
+		if (!con) {
+			server_finish(&global_server);
+			return EXIT_FAILURE;
+		}
+		workspace_add_tiling(ws, con);
+	}
+	transaction_commit_dirty();
+
+	struct timespec start, end, duration;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < iterations; ++i) {
+		for (int j = 0; j < ws->tiling->length; ++j) {
+			struct wsm_container *con = ws->tiling->items[j];
+			node_set_dirty(&con->node);
+		}
+		node_set_dirty(&ws->node);
+		transaction_commit_dirty();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_sub(&duration, &end, &start);
+
+	printf("%d containers, %d transactions: %" PRId64 " ns per transaction\n",
+		num_containers, iterations, timespec_to_nsec(&duration) / iterations);
+
+	server_finish(&global_server);
+	return EXIT_SUCCESS;
+}
@@ -2,6 +2,7 @@
 #include "wsm_common.h"
 #include "wsm_desktop.h"
 #include "wsm_pango.h"
+#include "wsm_icon_index.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,7 +14,6 @@
 #define MAX_PATH_LENGTH 2048
 
 #define SYSTEM_ICONS "/usr/share/icons/"
-#define SYSTEM_APPLICATIONS "/usr/share/applications/"
 
 struct wsm_desktop_interface *wsm_desktop_interface_create() {
 	struct wsm_desktop_interface *desktop =
@@ -74,6 +74,7 @@ struct wsm_desktop_interface *wsm_desktop_interface_create() {
 
 void wsm_desktop_interface_destory(struct wsm_desktop_interface *desktop) {
 	wl_signal_emit_mutable(&desktop->events.destroy, desktop);
+	wsm_icon_index_destroy(desktop->icon_index);
 	g_object_ref(desktop->settings);
 	free(desktop);
 }
@@ -94,6 +95,9 @@ void set_icon_theme(struct wsm_desktop_interface *desktop, char *icon_theme) {
 
 	free(desktop->icon_theme);
 	desktop->icon_theme = new_text;
+	if (desktop->icon_index) {
+		wsm_icon_index_set_theme(desktop->icon_index, desktop->icon_theme);
+	}
 	wl_signal_emit_mutable(&desktop->events.icon_theme_change, desktop);
 }
 
@@ -165,7 +169,7 @@ static char* find_desktop_file_frome_app_id(const char *identifier) {
 	return NULL;
 }
 
-static char* get_icon_name_from_desktop_file(const char* desktop_file_path) {
+char* get_icon_name_from_desktop_file(const char* desktop_file_path) {
 	FILE *file = fopen(desktop_file_path, "r");
 	if (!file) {
 		perror("Failed to open desktop file");
@@ -203,7 +207,7 @@ static int file_exists(const char *path) {
 }
 
 static void find_icon_in_directory(const char *directory, const char *icon_name,
-		const char *icon_extensions[],
+		const char *const icon_extensions[],
 		char *icon_path, size_t size) {
 	for (size_t i = 0; icon_extensions[i] != NULL; ++i) {
 		snprintf(icon_path, size, "%s/%s.%s",
@@ -246,11 +250,11 @@ static const char *systemd_icon_sizes[] = {
 	NULL
 };
 
-static const char *system_icon_extensions[] = {"svg", NULL};
-static const char *icon_extensions[] = {"png", "svg", "xpm", NULL};
+static const char *const system_icon_extensions[] = {"svg", NULL};
+static const char *const icon_extensions[] = {"png", "svg", "xpm", NULL};
 
-void find_app_icon(const char *icon_name, char *icon_path,
-		char *icon_theme, size_t size) {
+void for_each_app_icon_directory(const char *icon_theme,
+		icon_directory_iterator_func_t iterator, void *data) {
 	char home_dir[256];
 	get_home_directory(home_dir, sizeof(home_dir));
 
@@ -274,41 +278,34 @@ void find_app_icon(const char *icon_name, char *icon_path,
 			for (size_t k = 0; icon_sizes[k] != NULL; ++k) {
 				snprintf(directory, sizeof(directory), "%s/%s/%s/apps",
 					icon_dirs[i], icon_subdirs[j], icon_sizes[k]);
-				find_icon_in_directory(directory, icon_name,
-					icon_extensions, icon_path, size);
-				if (icon_path[0] != '\0') {
+				if (iterator(directory, icon_extensions, data)) {
 					return;
 				}
 
 				snprintf(directory, sizeof(directory), "%s/%s/apps/%s",
 					icon_dirs[i], icon_subdirs[j], icon_sizes[k]);
-				find_icon_in_directory(directory, icon_name,
-					icon_extensions, icon_path, size);
-				if (icon_path[0] != '\0') {
+				if (iterator(directory, icon_extensions, data)) {
 					return;
 				}
 			}
 
 			snprintf(directory, sizeof(directory), "%s/%s",
 				icon_dirs[i], icon_subdirs[j]);
-			find_icon_in_directory(directory, icon_name,
-				icon_extensions, icon_path, size);
-			if (icon_path[0] != '\0') {
+			if (iterator(directory, icon_extensions, data)) {
 				return;
 			}
 		}
 
 		snprintf(directory, sizeof(directory), "%s/pixmaps",
 			icon_dirs[i]);
-		find_icon_in_directory(directory, icon_name,
-			icon_extensions, icon_path, size);
-		if (icon_path[0] != '\0') {
+		if (iterator(directory, icon_extensions, data)) {
 			return;
 		}
 	}
 }
 
-void find_system_icon(const char *icon_name, char *icon_path, char *icon_theme, size_t size) {
+void for_each_system_icon_directory(const char *icon_theme,
+		icon_directory_iterator_func_t iterator, void *data) {
 	const char *icon_dirs[] = {
 		"/usr/share/icons",
 		NULL
@@ -325,9 +322,7 @@ void find_system_icon(const char *icon_name, char *icon_path, char *icon_theme,
 			for (size_t k = 0; systemd_icon_sizes[k] != NULL; ++k) {
 				snprintf(directory, sizeof(directory), "%s/%s/apps/%s",
 					icon_dirs[i], icon_subdirs[j], systemd_icon_sizes[k]);
-
-				find_icon_in_directory(directory, icon_name, system_icon_extensions, icon_path, size);
-				if (icon_path[0] != '\0') {
+				if (iterator(directory, system_icon_extensions, data)) {
 					return;
 				}
 			}
@@ -335,6 +330,39 @@ void find_system_icon(const char *icon_name, char *icon_path, char *icon_theme,
 	}
 }
 
+struct find_icon_data {
+	const char *icon_name;
+	char *icon_path;
+	size_t size;
+};
+
+static bool find_icon_iterator(const char *directory,
+		const char *const extensions[], void *data) {
+	struct find_icon_data *find = data;
+	find_icon_in_directory(directory, find->icon_name, extensions,
+		find->icon_path, find->size);
+	return find->icon_path[0] != '\0';
+}
+
+void find_app_icon(const char *icon_name, char *icon_path,
+		char *icon_theme, size_t size) {
+	struct find_icon_data find = {
+		.icon_name = icon_name,
+		.icon_path = icon_path,
+		.size = size,
+	};
+	for_each_app_icon_directory(icon_theme, find_icon_iterator, &find);
+}
+
+void find_system_icon(const char *icon_name, char *icon_path, char *icon_theme, size_t size) {
+	struct find_icon_data find = {
+		.icon_name = icon_name,
+		.icon_path = icon_path,
+		.size = size,
+	};
+	for_each_system_icon_directory(icon_theme, find_icon_iterator, &find);
+}
+
 char* find_app_icon_frome_app_id(struct wsm_desktop_interface *desktop, const char *app_id) {
 	char *desktop_file_path = find_desktop_file_frome_app_id(app_id);
 	if (!desktop_file_path) {
@@ -354,3 +382,32 @@ char* find_icon_file_frome_theme(struct wsm_desktop_interface *desktop, const ch
 	find_system_icon(icon_name, icon_path, desktop->icon_theme, sizeof(icon_path));
 	return strdup(icon_path);
 }
+
+void wsm_desktop_init_icon_index(struct wsm_desktop_interface *desktop,
+		struct wl_event_loop *loop) {
+	if (desktop->icon_index) {
+		return;
+	}
+
+	desktop->icon_index = wsm_icon_index_create(loop, desktop->icon_theme);
+}
+
+char *lookup_app_icon(struct wsm_desktop_interface *desktop,
+		const char *app_id, const char *fallback_name, bool *pending) {
+	*pending = false;
+	if (desktop->icon_index) {
+		return wsm_icon_index_lookup_app_icon(desktop->icon_index,
+			app_id, fallback_name, pending);
+	}
+
+	// Without an index, search the disk right away
+	char *icon_path = app_id ? find_app_icon_frome_app_id(desktop, app_id) : NULL;
+	if (icon_path && icon_path[0] == '\0') {
+		free(icon_path);
+		icon_path = NULL;
+	}
+	if (!icon_path) {
+		icon_path = find_icon_file_frome_theme(desktop, fallback_name);
+	}
+	return icon_path;
+}
@@ -1,11 +1,24 @@
 #ifndef WSM_DESKTOP_H
 #define WSM_DESKTOP_H
 
+#include <stdbool.h>
+
 #include <wayland-server-core.h>
 
 #include <gio/gio.h>
 #include <pango/pangocairo.h>
 
+#define SYSTEM_APPLICATIONS "/usr/share/applications/"
+
+struct wsm_icon_index;
+
+/**
+ * @brief called for every icon search directory in lookup order, returning
+ * true stops the iteration
+ */
+typedef bool (*icon_directory_iterator_func_t)(const char *directory,
+	const char *const extensions[], void *data);
+
 enum wsm_color_scheme {
 	Light,
 	Dark,
@@ -22,6 +35,7 @@ struct wsm_desktop_interface {
 
 	PangoFontDescription *font_description;
 	GSettings *settings;
+	struct wsm_icon_index *icon_index; // NULL until the event loop runs
 
 	char *style_name;
 	char *icon_theme;
@@ -40,9 +54,23 @@ void set_icon_theme(struct wsm_desktop_interface *desktop, char *icon_theme);
 void set_font_name(struct wsm_desktop_interface *desktop, char *font_name);
 void set_cursor_size(struct wsm_desktop_interface *desktop, int cursor_size);
 void set_color_scheme(struct wsm_desktop_interface *desktop, enum wsm_color_scheme scheme);
+void for_each_app_icon_directory(const char *icon_theme,
+	icon_directory_iterator_func_t iterator, void *data);
+void for_each_system_icon_directory(const char *icon_theme,
+	icon_directory_iterator_func_t iterator, void *data);
+char* get_icon_name_from_desktop_file(const char* desktop_file_path);
 void find_app_icon(const char *icon_name, char *icon_path, char *icon_theme, size_t size);
 void find_system_icon(const char *icon_name, char *icon_path, char *icon_theme, size_t size);
 char* find_app_icon_frome_app_id(struct wsm_desktop_interface *desktop, const char *app_id);
 char* find_icon_file_frome_theme(struct wsm_desktop_interface *desktop, const char *icon_name);
+void wsm_desktop_init_icon_index(struct wsm_desktop_interface *desktop,
+	struct wl_event_loop *loop);
+/**
+ * @brief lookup_app_icon icon of app_id, or the theme icon fallback_name.
+ * NULL with *pending set while the icon index resolves it, see
+ * wsm_icon_index_lookup_app_icon().
+ */
+char *lookup_app_icon(struct wsm_desktop_interface *desktop,
+	const char *app_id, const char *fallback_name, bool *pending);
 
 #endif
@@ -0,0 +1,517 @@
+#include "wsm_icon_index.h"
+#include "wsm_log.h"
+#include "wsm_desktop.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#define ICON_INDEX_REBUILD_DELAY_MS 1000
+#define ICON_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+	IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_CLOSE_WRITE)
+
+/**
+ * Immutable once built, shared between the worker and the compositor thread.
+ */
+struct icon_snapshot {
+	GHashTable *app_icons; // icon name -> path, in find_app_icon() order
+	GHashTable *system_icons; // icon name -> path, in find_system_icon() order
+	GHashTable *desktop_files; // desktop file id -> path
+	int watch_fd; // inotify on the indexed directories, taken by the index
+	int refs; // guarded by wsm_icon_index.lock
+};
+
+struct icon_request {
+	struct wl_list link;
+	char *app_id;
+	char *icon_path; // NULL when the app has no icon of its own
+};
+
+struct icon_index_build {
+	GHashTable *icons;
+	GHashTable *directory; // icon name -> extension rank in the current directory
+	int watch_fd;
+};
+
+static void icon_snapshot_destroy(struct icon_snapshot *snapshot) {
+	g_hash_table_unref(snapshot->app_icons);
+	g_hash_table_unref(snapshot->system_icons);
+	g_hash_table_unref(snapshot->desktop_files);
+	if (snapshot->watch_fd >= 0) {
+		close(snapshot->watch_fd);
+	}
+	free(snapshot);
+}
+
+static void icon_snapshot_unref_locked(struct icon_snapshot *snapshot) {
+	if (snapshot && --snapshot->refs == 0) {
+		icon_snapshot_destroy(snapshot);
+	}
+}
+
+static bool index_directory_iterator(const char *directory,
+		const char *const extensions[], void *data) {
+	struct icon_index_build *build = data;
+	DIR *dir = opendir(directory);
+	if (!dir) {
+		return false;
+	}
+
+	if (build->watch_fd >= 0) {
+		inotify_add_watch(build->watch_fd, directory, ICON_INDEX_WATCH_MASK);
+	}
+
+	// Earlier extensions win inside of a directory, earlier directories overall
+	g_hash_table_remove_all(build->directory);
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		const char *dot = strrchr(entry->d_name, '.');
+		if (!dot || dot == entry->d_name) {
+			continue;
+		}
+
+		intptr_t rank = 0;
+		while (extensions[rank] && strcmp(dot + 1, extensions[rank]) != 0) {
+			rank++;
+		}
+		if (!extensions[rank]) {
+			continue;
+		}
+
+		char *name = g_strndup(entry->d_name, dot - entry->d_name);
+		if (g_hash_table_contains(build->icons, name)) {
+			g_free(name);
+			continue;
+		}
+
+		gpointer best;
+		if (g_hash_table_lookup_extended(build->directory, name, NULL, &best) &&
+				(intptr_t)best <= rank) {
+			g_free(name);
+			continue;
+		}
+		g_hash_table_insert(build->directory, name, (gpointer)rank);
+	}
+	closedir(dir);
+
+	GHashTableIter iter;
+	gpointer name, rank;
+	g_hash_table_iter_init(&iter, build->directory);
+	while (g_hash_table_iter_next(&iter, &name, &rank)) {
+		char *path = g_strdup_printf("%s/%s.%s", directory, (char *)name,
+			extensions[(intptr_t)rank]);
+		g_hash_table_insert(build->icons, g_strdup(name), path);
+	}
+
+	return false;
+}
+
+static GHashTable *index_desktop_files(int watch_fd) {
+	GHashTable *desktop_files =
+		g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	DIR *dir = opendir(SYSTEM_APPLICATIONS);
+	if (!dir) {
+		return desktop_files;
+	}
+
+	if (watch_fd >= 0) {
+		inotify_add_watch(watch_fd, SYSTEM_APPLICATIONS, ICON_INDEX_WATCH_MASK);
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		size_t len = strlen(entry->d_name);
+		if (len <= strlen(".desktop") ||
+				strcmp(entry->d_name + len - strlen(".desktop"), ".desktop") != 0) {
+			continue;
+		}
+
+		g_hash_table_insert(desktop_files,
+			g_strndup(entry->d_name, len - strlen(".desktop")),
+			g_strdup_printf("%s%s", SYSTEM_APPLICATIONS, entry->d_name));
+	}
+	closedir(dir);
+
+	return desktop_files;
+}
+
+static struct icon_snapshot *icon_snapshot_build(const char *icon_theme) {
+	struct icon_snapshot *snapshot = calloc(1, sizeof(struct icon_snapshot));
+	if (!snapshot) {
+		wsm_log(WSM_ERROR, "Could not create icon_snapshot: allocation failed!");
+		return NULL;
+	}
+
+	snapshot->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (snapshot->watch_fd < 0) {
+		wsm_log(WSM_ERROR, "Could not watch icon directories, changes will be missed");
+	}
+
+	struct icon_index_build build = {
+		.directory = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+		.watch_fd = snapshot->watch_fd,
+	};
+
+	build.icons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	for_each_app_icon_directory(icon_theme, index_directory_iterator, &build);
+	snapshot->app_icons = build.icons;
+
+	build.icons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	for_each_system_icon_directory(icon_theme, index_directory_iterator, &build);
+	snapshot->system_icons = build.icons;
+
+	g_hash_table_unref(build.directory);
+	snapshot->desktop_files = index_desktop_files(snapshot->watch_fd);
+
+	wsm_log(WSM_DEBUG, "Icon index of theme %s: %u app icons, %u system icons, "
+		"%u desktop files", icon_theme, g_hash_table_size(snapshot->app_icons),
+		g_hash_table_size(snapshot->system_icons),
+		g_hash_table_size(snapshot->desktop_files));
+	return snapshot;
+}
+
+/**
+ * Worker side: the only part which reads a file, the desktop file of app_id.
+ */
+static char *icon_snapshot_resolve_app(struct icon_snapshot *snapshot,
+		const char *app_id) {
+	const char *desktop_file = g_hash_table_lookup(snapshot->desktop_files, app_id);
+	if (!desktop_file) {
+		return NULL;
+	}
+
+	char *icon_name = get_icon_name_from_desktop_file(desktop_file);
+	if (!icon_name) {
+		return NULL;
+	}
+
+	char *icon_path = NULL;
+	if (icon_name[0] == '/') {
+		if (access(icon_name, R_OK) == 0) {
+			icon_path = strdup(icon_name);
+		}
+	} else {
+		const char *path = g_hash_table_lookup(snapshot->app_icons, icon_name);
+		if (path) {
+			icon_path = strdup(path);
+		}
+	}
+	free(icon_name);
+	return icon_path;
+}
+
+static void icon_index_notify_locked(struct wsm_icon_index *index) {
+	uint64_t count = 1;
+	if (write(index->done_fd, &count, sizeof(count)) < 0) {
+		wsm_log(WSM_ERROR, "Could not wake up the compositor thread");
+	}
+}
+
+static void *icon_index_worker(void *data) {
+	struct wsm_icon_index *index = data;
+	struct icon_snapshot *current = NULL;
+
+	pthread_mutex_lock(&index->lock);
+	while (!index->quit) {
+		if (index->rebuild) {
+			index->rebuild = false;
+			char *icon_theme = strdup(index->icon_theme);
+			pthread_mutex_unlock(&index->lock);
+			struct icon_snapshot *snapshot = icon_snapshot_build(icon_theme);
+			free(icon_theme);
+			pthread_mutex_lock(&index->lock);
+
+			if (snapshot) {
+				// One reference for us, one for the compositor thread
+				snapshot->refs = 2;
+				icon_snapshot_unref_locked(current);
+				icon_snapshot_unref_locked(index->built);
+				current = snapshot;
+				index->built = snapshot;
+				icon_index_notify_locked(index);
+			}
+			continue;
+		}
+
+		if (current && !wl_list_empty(&index->requests)) {
+			struct icon_request *request =
+				wl_container_of(index->requests.next, request, link);
+			wl_list_remove(&request->link);
+			pthread_mutex_unlock(&index->lock);
+			request->icon_path = icon_snapshot_resolve_app(current, request->app_id);
+			pthread_mutex_lock(&index->lock);
+
+			wl_list_insert(index->results.prev, &request->link);
+			icon_index_notify_locked(index);
+			continue;
+		}
+
+		pthread_cond_wait(&index->cond, &index->lock);
+	}
+	icon_snapshot_unref_locked(current);
+	pthread_mutex_unlock(&index->lock);
+
+	return NULL;
+}
+
+static void icon_request_destroy(struct icon_request *request) {
+	wl_list_remove(&request->link);
+	free(request->app_id);
+	free(request->icon_path);
+	free(request);
+}
+
+static int handle_watch(int fd, uint32_t mask, void *data) {
+	struct wsm_icon_index *index = data;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+	while (read(fd, buffer, sizeof(buffer)) > 0) {
+		changed = true;
+	}
+
+	// Package managers touch many files at once, settle before rebuilding
+	if (changed) {
+		wl_event_source_timer_update(index->rebuild_timer, ICON_INDEX_REBUILD_DELAY_MS);
+	}
+	return 0;
+}
+
+static void icon_index_publish(struct wsm_icon_index *index,
+		struct icon_snapshot *snapshot) {
+	if (index->watch_source) {
+		wl_event_source_remove(index->watch_source);
+		index->watch_source = NULL;
+	}
+	if (index->watch_fd >= 0) {
+		close(index->watch_fd);
+	}
+
+	index->watch_fd = snapshot->watch_fd;
+	snapshot->watch_fd = -1;
+	if (index->watch_fd >= 0) {
+		index->watch_source = wl_event_loop_add_fd(index->event_loop,
+			index->watch_fd, WL_EVENT_READABLE, handle_watch, index);
+	}
+
+	pthread_mutex_lock(&index->lock);
+	icon_snapshot_unref_locked(index->snapshot);
+	pthread_mutex_unlock(&index->lock);
+	index->snapshot = snapshot;
+
+	// Mapped views keep their icon, new lookups see the new index
+	g_hash_table_remove_all(index->resolved);
+}
+
+static int handle_done(int fd, uint32_t mask, void *data) {
+	struct wsm_icon_index *index = data;
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0) {
+		return 0;
+	}
+
+	struct wl_list results;
+	wl_list_init(&results);
+	pthread_mutex_lock(&index->lock);
+	struct icon_snapshot *built = index->built;
+	index->built = NULL;
+	wl_list_insert_list(&results, &index->results);
+	wl_list_init(&index->results);
+	pthread_mutex_unlock(&index->lock);
+
+	if (built) {
+		icon_index_publish(index, built);
+	}
+
+	struct icon_request *request, *tmp;
+	wl_list_for_each_safe(request, tmp, &results, link) {
+		g_hash_table_insert(index->resolved, g_strdup(request->app_id),
+			g_strdup(request->icon_path ? request->icon_path : ""));
+		g_hash_table_remove(index->in_flight, request->app_id);
+		wl_signal_emit_mutable(&index->events.app_icon_resolved, request->app_id);
+		icon_request_destroy(request);
+	}
+
+	return 0;
+}
+
+static int handle_rebuild_timer(void *data) {
+	struct wsm_icon_index *index = data;
+	pthread_mutex_lock(&index->lock);
+	index->rebuild = true;
+	pthread_cond_signal(&index->cond);
+	pthread_mutex_unlock(&index->lock);
+	return 0;
+}
+
+struct wsm_icon_index *wsm_icon_index_create(struct wl_event_loop *loop,
+		const char *icon_theme) {
+	struct wsm_icon_index *index = calloc(1, sizeof(struct wsm_icon_index));
+	if (!index) {
+		wsm_log(WSM_ERROR, "Could not create wsm_icon_index: allocation failed!");
+		return NULL;
+	}
+
+	wl_signal_init(&index->events.app_icon_resolved);
+	wl_list_init(&index->requests);
+	wl_list_init(&index->results);
+	index->event_loop = loop;
+	index->watch_fd = -1;
+	index->icon_theme = strdup(icon_theme);
+	index->rebuild = true;
+	index->resolved = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	index->in_flight = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	index->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (index->done_fd < 0) {
+		wsm_log(WSM_ERROR, "Could not create icon index eventfd");
+		goto error;
+	}
+
+	index->done_source = wl_event_loop_add_fd(loop, index->done_fd,
+		WL_EVENT_READABLE, handle_done, index);
+	index->rebuild_timer = wl_event_loop_add_timer(loop, handle_rebuild_timer, index);
+	if (!index->done_source || !index->rebuild_timer) {
+		wsm_log(WSM_ERROR, "Could not add icon index event sources");
+		goto error;
+	}
+
+	pthread_mutex_init(&index->lock, NULL);
+	pthread_cond_init(&index->cond, NULL);
+	if (pthread_create(&index->thread, NULL, icon_index_worker, index) != 0) {
+		wsm_log(WSM_ERROR, "Could not start the icon index thread");
+		pthread_cond_destroy(&index->cond);
+		pthread_mutex_destroy(&index->lock);
+		goto error;
+	}
+
+	return index;
+
+error:
+	if (index->rebuild_timer) {
+		wl_event_source_remove(index->rebuild_timer);
+	}
+	if (index->done_source) {
+		wl_event_source_remove(index->done_source);
+	}
+	if (index->done_fd >= 0) {
+		close(index->done_fd);
+	}
+	g_hash_table_unref(index->resolved);
+	g_hash_table_unref(index->in_flight);
+	free(index->icon_theme);
+	free(index);
+	return NULL;
+}
+
+void wsm_icon_index_destroy(struct wsm_icon_index *index) {
+	if (!index) {
+		return;
+	}
+
+	pthread_mutex_lock(&index->lock);
+	index->quit = true;
+	pthread_cond_signal(&index->cond);
+	pthread_mutex_unlock(&index->lock);
+	pthread_join(index->thread, NULL);
+
+	struct icon_request *request, *tmp;
+	wl_list_for_each_safe(request, tmp, &index->requests, link) {
+		icon_request_destroy(request);
+	}
+	wl_list_for_each_safe(request, tmp, &index->results, link) {
+		icon_request_destroy(request);
+	}
+
+	icon_snapshot_unref_locked(index->built);
+	icon_snapshot_unref_locked(index->snapshot);
+	if (index->watch_source) {
+		wl_event_source_remove(index->watch_source);
+	}
+	if (index->watch_fd >= 0) {
+		close(index->watch_fd);
+	}
+	wl_event_source_remove(index->rebuild_timer);
+	wl_event_source_remove(index->done_source);
+	close(index->done_fd);
+
+	pthread_cond_destroy(&index->cond);
+	pthread_mutex_destroy(&index->lock);
+	g_hash_table_unref(index->resolved);
+	g_hash_table_unref(index->in_flight);
+	free(index->icon_theme);
+	free(index);
+}
+
+void wsm_icon_index_set_theme(struct wsm_icon_index *index, const char *icon_theme) {
+	char *new_theme = strdup(icon_theme);
+	if (!new_theme) {
+		return;
+	}
+
+	pthread_mutex_lock(&index->lock);
+	free(index->icon_theme);
+	index->icon_theme = new_theme;
+	index->rebuild = true;
+	pthread_cond_signal(&index->cond);
+	pthread_mutex_unlock(&index->lock);
+}
+
+static void icon_index_queue(struct wsm_icon_index *index, const char *app_id) {
+	if (g_hash_table_contains(index->in_flight, app_id)) {
+		return;
+	}
+
+	struct icon_request *request = calloc(1, sizeof(struct icon_request));
+	if (!request) {
+		wsm_log(WSM_ERROR, "Could not create icon_request: allocation failed!");
+		return;
+	}
+
+	request->app_id = strdup(app_id);
+	g_hash_table_add(index->in_flight, g_strdup(app_id));
+
+	pthread_mutex_lock(&index->lock);
+	wl_list_insert(index->requests.prev, &request->link);
+	pthread_cond_signal(&index->cond);
+	pthread_mutex_unlock(&index->lock);
+}
+
+char *wsm_icon_index_lookup_app_icon(struct wsm_icon_index *index,
+		const char *app_id, const char *fallback_name, bool *pending) {
+	*pending = false;
+
+	const char *icon_path = NULL;
+	if (app_id) {
+		icon_path = g_hash_table_lookup(index->resolved, app_id);
+		if (!icon_path && index->snapshot &&
+				!g_hash_table_contains(index->snapshot->desktop_files, app_id)) {
+			// No desktop file, no need to ask the worker
+			icon_path = "";
+			g_hash_table_insert(index->resolved, g_strdup(app_id), g_strdup(""));
+		}
+
+		if (!icon_path) {
+			icon_index_queue(index, app_id);
+			*pending = true;
+			return NULL;
+		}
+	}
+
+	if (icon_path && icon_path[0] != '\0') {
+		return strdup(icon_path);
+	}
+
+	if (!index->snapshot) {
+		// The fallback needs the index, an empty app id still gets an answer
+		icon_index_queue(index, "");
+		*pending = true;
+		return NULL;
+	}
+
+	icon_path = g_hash_table_lookup(index->snapshot->system_icons, fallback_name);
+	return icon_path ? strdup(icon_path) : NULL;
+}
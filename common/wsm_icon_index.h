@@ -0,0 +1,63 @@
+#ifndef WSM_ICON_INDEX_H
+#define WSM_ICON_INDEX_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <wayland-server-core.h>
+
+#include <glib.h>
+
+struct icon_snapshot;
+
+/**
+ * @brief in memory index of the icon themes and desktop files.
+ *
+ * @details The index is built on a worker thread and rebuilt when one of the
+ * indexed directories changes (inotify). Lookups on the compositor thread are
+ * hash hits, what needs disk access (parsing a desktop file) is answered by
+ * the worker, events.app_icon_resolved is emitted once it is known.
+ */
+struct wsm_icon_index {
+	struct {
+		struct wl_signal app_icon_resolved; // const char *app_id
+	} events;
+
+	struct wl_event_loop *event_loop;
+	struct wl_event_source *done_source;
+	struct wl_event_source *watch_source;
+	struct wl_event_source *rebuild_timer;
+	int done_fd;
+	int watch_fd;
+
+	struct icon_snapshot *snapshot; // published to the compositor thread
+	GHashTable *resolved; // app id -> icon path, "" when the app has none
+	GHashTable *in_flight; // app ids queued for the worker
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* guarded by lock */
+	struct wl_list requests; // icon_request.link, for the worker
+	struct wl_list results; // icon_request.link, for the compositor thread
+	struct icon_snapshot *built; // not yet published
+	char *icon_theme;
+	bool rebuild;
+	bool quit;
+};
+
+struct wsm_icon_index *wsm_icon_index_create(struct wl_event_loop *loop,
+	const char *icon_theme);
+void wsm_icon_index_destroy(struct wsm_icon_index *index);
+void wsm_icon_index_set_theme(struct wsm_icon_index *index, const char *icon_theme);
+/**
+ * @brief wsm_icon_index_lookup_app_icon never blocks on the disk.
+ * @return new string with the icon of app_id, or of the theme icon
+ * fallback_name when the app has none. NULL with *pending set when the answer
+ * comes later through events.app_icon_resolved.
+ */
+char *wsm_icon_index_lookup_app_icon(struct wsm_icon_index *index,
+	const char *app_id, const char *fallback_name, bool *pending);
+
+#endif
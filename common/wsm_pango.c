@@ -50,9 +50,8 @@ size_t escape_markup_text(const char *src, char *dest) {
 	return length;
 }
 
-PangoLayout *get_pango_layout(cairo_t *cairo, const PangoFontDescription *desc,
-		const char *text, double scale, bool markup) {
-	PangoLayout *layout = pango_cairo_create_layout(cairo);
+static PangoLayout *setup_pango_layout(PangoLayout *layout,
+		const PangoFontDescription *desc, const char *text, double scale, bool markup) {
 	PangoAttrList *attrs;
 	if (markup) {
 		char *buf;
@@ -80,6 +79,17 @@ PangoLayout *get_pango_layout(cairo_t *cairo, const PangoFontDescription *desc,
 	return layout;
 }
 
+PangoLayout *get_pango_layout(cairo_t *cairo, const PangoFontDescription *desc,
+		const char *text, double scale, bool markup) {
+	return setup_pango_layout(pango_cairo_create_layout(cairo), desc, text,
+		scale, markup);
+}
+
+PangoLayout *get_pango_layout_with_context(PangoContext *context,
+		const PangoFontDescription *desc, const char *text, double scale, bool markup) {
+	return setup_pango_layout(pango_layout_new(context), desc, text, scale, markup);
+}
+
 void get_text_size(cairo_t *cairo, const PangoFontDescription *desc, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...) {
 	va_list args;
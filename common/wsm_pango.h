@@ -14,6 +14,12 @@
 size_t escape_markup_text(const char *src, char *dest);
 PangoLayout *get_pango_layout(cairo_t *cairo, const PangoFontDescription *desc,
 	const char *text, double scale, bool markup);
+/**
+ * @brief get_pango_layout_with_context same as get_pango_layout, on a
+ * long lived context the caller keeps in sync with pango_cairo_update_context.
+ */
+PangoLayout *get_pango_layout_with_context(PangoContext *context,
+	const PangoFontDescription *desc, const char *text, double scale, bool markup);
 void get_text_size(cairo_t *cairo, const PangoFontDescription *desc, int *width, int *height,
 	int *baseline, double scale, bool markup, const char *fmt, ...) _WSM_ATTRIB_PRINTF(8, 9);
 void get_text_metrics(const PangoFontDescription *desc, int *height, int *baseline);
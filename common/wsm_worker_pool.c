@@ -0,0 +1,148 @@
+#include "wsm_worker_pool.h"
+#include "wsm_log.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+static void *worker_pool_thread(void *data) {
+	struct wsm_worker_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->quit) {
+		if (wl_list_empty(&pool->jobs)) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+
+		struct wsm_worker_job *job = wl_container_of(pool->jobs.next, job, link);
+		wl_list_remove(&job->link);
+		pthread_mutex_unlock(&pool->lock);
+		job->run(job);
+		pthread_mutex_lock(&pool->lock);
+
+		wl_list_insert(pool->finished.prev, &job->link);
+		uint64_t count = 1;
+		if (write(pool->done_fd, &count, sizeof(count)) < 0) {
+			wsm_log(WSM_ERROR, "Could not wake up the compositor thread");
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void worker_pool_hand_back(struct wl_list *jobs) {
+	struct wsm_worker_job *job, *tmp;
+	wl_list_for_each_safe(job, tmp, jobs, link) {
+		wl_list_remove(&job->link);
+		job->done(job);
+	}
+}
+
+static int handle_done(int fd, uint32_t mask, void *data) {
+	struct wsm_worker_pool *pool = data;
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0) {
+		return 0;
+	}
+
+	struct wl_list finished;
+	wl_list_init(&finished);
+	pthread_mutex_lock(&pool->lock);
+	wl_list_insert_list(&finished, &pool->finished);
+	wl_list_init(&pool->finished);
+	pthread_mutex_unlock(&pool->lock);
+
+	worker_pool_hand_back(&finished);
+	return 0;
+}
+
+static size_t worker_pool_thread_count(void) {
+	// Leave most cores to clients, this is only meant to keep the loop free
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t count = cpus > 1 ? (size_t)cpus / 2 : 1;
+	return count < WSM_WORKER_POOL_MAX_THREADS ? count : WSM_WORKER_POOL_MAX_THREADS;
+}
+
+struct wsm_worker_pool *wsm_worker_pool_create(struct wl_event_loop *loop) {
+	struct wsm_worker_pool *pool = calloc(1, sizeof(struct wsm_worker_pool));
+	if (!pool) {
+		wsm_log(WSM_ERROR, "Could not create wsm_worker_pool: allocation failed!");
+		return NULL;
+	}
+
+	wl_list_init(&pool->jobs);
+	wl_list_init(&pool->finished);
+
+	pool->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pool->done_fd < 0) {
+		wsm_log(WSM_ERROR, "Could not create worker pool eventfd");
+		free(pool);
+		return NULL;
+	}
+
+	pool->done_source = wl_event_loop_add_fd(loop, pool->done_fd,
+		WL_EVENT_READABLE, handle_done, pool);
+	if (!pool->done_source) {
+		wsm_log(WSM_ERROR, "Could not add worker pool event source");
+		close(pool->done_fd);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	size_t count = worker_pool_thread_count();
+	for (size_t i = 0; i < count; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_pool_thread, pool) != 0) {
+			wsm_log(WSM_ERROR, "Could not start worker thread %zu", i);
+			break;
+		}
+		pool->thread_count++;
+	}
+
+	if (pool->thread_count == 0) {
+		wsm_worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void wsm_worker_pool_destroy(struct wsm_worker_pool *pool) {
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->thread_count; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	worker_pool_hand_back(&pool->finished);
+	struct wsm_worker_job *job;
+	wl_list_for_each(job, &pool->jobs, link) {
+		job->cancelled = true;
+	}
+	worker_pool_hand_back(&pool->jobs);
+
+	wl_event_source_remove(pool->done_source);
+	close(pool->done_fd);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void wsm_worker_pool_submit(struct wsm_worker_pool *pool, struct wsm_worker_job *job) {
+	job->cancelled = false;
+
+	pthread_mutex_lock(&pool->lock);
+	wl_list_insert(pool->jobs.prev, &job->link);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,56 @@
+#ifndef WSM_WORKER_POOL_H
+#define WSM_WORKER_POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <wayland-server-core.h>
+
+#define WSM_WORKER_POOL_MAX_THREADS 4
+
+struct wsm_worker_job;
+
+typedef void (*wsm_worker_job_func_t)(struct wsm_worker_job *job);
+
+/**
+ * @brief unit of work, embedded in the structure of its submitter
+ */
+struct wsm_worker_job {
+	struct wl_list link;
+	wsm_worker_job_func_t run; // on a worker thread
+	wsm_worker_job_func_t done; // on the event loop thread, the job is handed back
+	bool cancelled; // done without run, the pool was destroyed first
+};
+
+/**
+ * @brief small pool of threads for the cairo, pango and image decoding work
+ * that must stay off the event loop thread.
+ *
+ * @details Finished jobs are handed back through an eventfd, in the order
+ * they finished.
+ */
+struct wsm_worker_pool {
+	struct wl_event_source *done_source;
+	int done_fd;
+
+	pthread_t threads[WSM_WORKER_POOL_MAX_THREADS];
+	size_t thread_count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* guarded by lock */
+	struct wl_list jobs; // wsm_worker_job.link, waiting for a thread
+	struct wl_list finished; // wsm_worker_job.link, waiting for done
+	bool quit;
+};
+
+struct wsm_worker_pool *wsm_worker_pool_create(struct wl_event_loop *loop);
+/**
+ * @brief wsm_worker_pool_destroy wait for the running jobs, then hand every
+ * outstanding job back to done, the ones never run with cancelled set.
+ */
+void wsm_worker_pool_destroy(struct wsm_worker_pool *pool);
+void wsm_worker_pool_submit(struct wsm_worker_pool *pool, struct wsm_worker_job *job);
+
+#endif
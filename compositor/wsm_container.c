@@ -201,6 +201,13 @@ void container_destroy(struct wsm_container *con) {
 	list_free(con->pending.children);
 	list_free(con->current.children);
 
+	if (con->config_dirty) {
+		int index = list_find(global_server.scene->dirty_configs, con);
+		if (index != -1) {
+			list_del(global_server.scene->dirty_configs, index);
+		}
+	}
+
 	if (con->view && con->view->container == con) {
 		con->view->container = NULL;
 		wlr_scene_node_destroy(&con->output_handler->node);
@@ -1048,6 +1055,15 @@ void container_update(struct wsm_container *con) {
 	}
 }
 
+void container_mark_config_dirty(struct wsm_container *con) {
+	if (con->config_dirty) {
+		return;
+	}
+
+	con->config_dirty = true;
+	list_add(global_server.scene->dirty_configs, con);
+}
+
 void container_update_itself_and_parents(struct wsm_container *con) {
 	container_update(con);
 
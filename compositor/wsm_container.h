@@ -217,6 +217,7 @@ struct wsm_container {
 
 	bool scratchpad;
 	bool is_sticky;
+	bool config_dirty; // queued in wsm_scene.dirty_configs
 };
 
 struct wsm_container *container_create(struct wsm_view *view);
@@ -274,6 +275,11 @@ bool container_is_transient_for(struct wsm_container *child,
 	struct wsm_container *ancestor);
 void container_update(struct wsm_container *con);
 void container_update_itself_and_parents(struct wsm_container *con);
+/**
+ * @brief container_mark_config_dirty queue the container subtree so the next
+ * repaint recomputes opacity and scale filter of its buffers
+ */
+void container_mark_config_dirty(struct wsm_container *con);
 bool container_has_urgent_child(struct wsm_container *container);
 void container_set_resizing(struct wsm_container *con, bool resizing);
 void floating_calculate_constraints(int *min_width, int *max_width,
@@ -15,7 +15,15 @@
 #include "wsm_config.h"
 #include "wsm_cursor.h"
 #include "wsm_session_lock.h"
+#include "wsm_stats.h"
+#include "wsm_trace.h"
 #include "wsm_desktop.h"
+#include "wsm_worker_pool.h"
+#include "wsm_transaction.h"
+#include "effects/wsm_effect.h"
+#include "node/wsm_text_cache.h"
+#include "node/wsm_image_cache.h"
+#include "effects/wsm_effects_manager.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +61,7 @@
 #include <wlr/types/wlr_data_control_v1.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_linux_drm_syncobj_v1.h>
 #include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_presentation_time.h>
@@ -63,6 +72,7 @@
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
 #include <wlr/types/wlr_content_type_v1.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
 #include <wlr/types/wlr_fractional_scale_v1.h>
 #include <wlr/types/wlr_cursor_shape_v1.h>
 #include <wlr/types/wlr_xdg_activation_v1.h>
@@ -136,6 +146,62 @@ void handle_pointer_constraint(struct wl_listener *listener, void *data) {
 	}
 }
 
+struct wsm_surface_map_tracker {
+	struct wl_listener map;
+	struct wl_listener unmap;
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+static void handle_surface_map(struct wl_listener *listener, void *data) {
+	// Freshly enabled buffers have not been given opacity and scale filter yet
+	wsm_scene_mark_config_dirty(global_server.scene);
+	wsm_scene_invalidate_render_lists(global_server.scene);
+}
+
+static void handle_surface_unmap(struct wl_listener *listener, void *data) {
+	wsm_scene_invalidate_render_lists(global_server.scene);
+}
+
+static void handle_surface_commit(struct wl_listener *listener, void *data) {
+	struct wlr_surface *surface = data;
+
+	// A shrinking opaque region may reveal nodes which were fully occluded
+	if (surface->current.committed & WLR_SURFACE_STATE_OPAQUE_REGION) {
+		wsm_scene_invalidate_render_lists(global_server.scene);
+	}
+}
+
+static void handle_surface_destroy(struct wl_listener *listener, void *data) {
+	struct wsm_surface_map_tracker *tracker =
+		wl_container_of(listener, tracker, destroy);
+
+	wl_list_remove(&tracker->map.link);
+	wl_list_remove(&tracker->unmap.link);
+	wl_list_remove(&tracker->commit.link);
+	wl_list_remove(&tracker->destroy.link);
+	free(tracker);
+}
+
+static void handle_new_surface(struct wl_listener *listener, void *data) {
+	struct wlr_surface *surface = data;
+	struct wsm_surface_map_tracker *tracker =
+		calloc(1, sizeof(struct wsm_surface_map_tracker));
+	if (!tracker) {
+		wsm_log(WSM_ERROR, "Could not create wsm_surface_map_tracker: allocation failed!");
+		return;
+	}
+
+	tracker->map.notify = handle_surface_map;
+	wl_signal_add(&surface->events.map, &tracker->map);
+	tracker->unmap.notify = handle_surface_unmap;
+	wl_signal_add(&surface->events.unmap, &tracker->unmap);
+	tracker->commit.notify = handle_surface_commit;
+	wl_signal_add(&surface->events.commit, &tracker->commit);
+	tracker->destroy.notify = handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &tracker->destroy);
+}
+
 #if WLR_HAS_DRM_BACKEND
 static void handle_drm_lease_request(struct wl_listener *listener, void *data) {
 	struct wlr_drm_lease_request_v1 *req = data;
@@ -231,6 +297,9 @@ bool wsm_server_init(struct wsm_server *server)
 
 	server->wl_display = wl_display_create();
 	server->wl_event_loop = wl_display_get_event_loop(server->wl_display);
+	if (server->desktop_interface) {
+		wsm_desktop_init_icon_index(server->desktop_interface, server->wl_event_loop);
+	}
 
 	wl_display_set_global_filter(server->wl_display, filter_global, server);
 
@@ -249,6 +318,9 @@ bool wsm_server_init(struct wsm_server *server)
 	}
 
 	wlr_renderer_init_wl_shm(server->wlr_renderer, server->wl_display);
+	server->worker_pool = wsm_worker_pool_create(server->wl_event_loop);
+	server->image_cache = wsm_image_cache_create(server->worker_pool,
+		server->wlr_renderer, WSM_IMAGE_CACHE_BUDGET);
 
 	if (wlr_renderer_get_texture_formats(server->wlr_renderer, WLR_BUFFER_CAP_DMABUF) != NULL) {
 		server->linux_dmabuf_v1 = wlr_linux_dmabuf_v1_create_with_renderer(
@@ -256,6 +328,18 @@ bool wsm_server_init(struct wsm_server *server)
 		// wlr_drm_create(server->wl_display, server->wlr_renderer);
 	}
 
+	// explicit sync needs timelines on both sides, the renderer waits on the
+	// acquire points of composited buffers and KMS on the scanned out ones
+	int drm_fd = wlr_renderer_get_drm_fd(server->wlr_renderer);
+	if (drm_fd >= 0 && server->wlr_renderer->features.timeline &&
+			server->backend->features.timeline) {
+		server->linux_drm_syncobj_manager_v1 =
+			wlr_linux_drm_syncobj_manager_v1_create(server->wl_display, 1, drm_fd);
+	}
+	if (!server->linux_drm_syncobj_manager_v1) {
+		wsm_log(WSM_DEBUG, "Explicit sync is not available, clients use implicit fencing");
+	}
+
 	server->wlr_allocator = wlr_allocator_autocreate(server->backend, server->wlr_renderer);
 	if (!server->wlr_allocator) {
 		wsm_log(WSM_ERROR, "Failed to create allocator");
@@ -265,6 +349,8 @@ bool wsm_server_init(struct wsm_server *server)
 	server->wlr_compositor = wlr_compositor_create(server->wl_display, 6, server->wlr_renderer);
 	wlr_subcompositor_create(server->wl_display);
 	server->scene = wsm_scene_create(server);
+	server->new_surface.notify = handle_new_surface;
+	wl_signal_add(&server->wlr_compositor->events.new_surface, &server->new_surface);
 
 	server->xcursor_manager = wlr_xcursor_manager_create(NULL, 24);
 	server->data_device_manager = wlr_data_device_manager_create(server->wl_display);
@@ -277,6 +363,8 @@ bool wsm_server_init(struct wsm_server *server)
 	server->idle_notifier_v1 = wlr_idle_notifier_v1_create(server->wl_display);
 	server->server_decoration_manager = wsm_server_decoration_manager_create(server);
 	server->xdg_decoration_manager = xdg_decoration_manager_create(server);
+	server->effects_manager = wsm_effects_manager_create(server->wl_display);
+	wsm_effects_init(server->wlr_renderer);
 	server->wlr_relative_pointer_manager =
 		wlr_relative_pointer_manager_v1_create(server->wl_display);
 
@@ -317,6 +405,8 @@ bool wsm_server_init(struct wsm_server *server)
 		WSM_WLR_FRACTIONAL_SCALE_V1_VERSION);
 	server->content_type_manager_v1 =
 		wlr_content_type_manager_v1_create(server->wl_display, 1);
+	server->tearing_control_manager_v1 =
+		wlr_tearing_control_manager_v1_create(server->wl_display, 1);
 
 	struct wlr_xdg_foreign_registry *foreign_registry =
 		wlr_xdg_foreign_registry_create(server->wl_display);
@@ -357,6 +447,10 @@ bool wsm_server_init(struct wsm_server *server)
 	}
 
 	server->dirty_nodes = create_list();
+	server->transactions = create_list();
+	server->pending_transactions = create_list();
+	wsm_stats_init(server->wl_event_loop);
+	wsm_trace_init(server->wl_event_loop);
 	server->input_manager = wsm_input_manager_create(server);
 	input_manager_get_default_seat();
 
@@ -371,6 +465,16 @@ void server_finish(struct wsm_server *server) {
 #endif
 	wl_display_destroy_clients(server->wl_display);
 	wlr_backend_destroy(server->backend);
+	wsm_effects_finish();
+	wsm_worker_pool_destroy(server->worker_pool);
+	server->worker_pool = NULL;
+	wsm_image_cache_destroy(server->image_cache);
+	wsm_text_cache_finish();
+	wsm_stats_finish();
+	wsm_trace_finish();
 	wl_display_destroy(server->wl_display);
+	transaction_arena_finish();
 	list_free(server->dirty_nodes);
+	list_free(server->transactions);
+	list_free(server->pending_transactions);
 }
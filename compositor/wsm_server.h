@@ -37,6 +37,8 @@ struct wlr_pointer_constraint_v1;
 struct wlr_security_context_manager_v1;
 struct wlr_xdg_activation_v1;
 struct wlr_content_type_manager_v1;
+struct wlr_tearing_control_manager_v1;
+struct wlr_linux_drm_syncobj_manager_v1;
 struct wlr_data_control_manager_v1;
 struct wlr_screencopy_manager_v1;
 struct wlr_pointer_constraints_v1;
@@ -59,6 +61,9 @@ struct wsm_session_lock;
 struct wsm_input_manager;
 struct wsm_output_manager;
 struct wsm_desktop_interface;
+struct wsm_effects_manager;
+struct wsm_image_cache;
+struct wsm_worker_pool;
 struct wsm_xdg_decoration_manager;
 struct wsm_server_decoration_manager;
 
@@ -84,6 +89,7 @@ struct wsm_server {
 
 	struct wl_listener pointer_constraint;
 	struct wl_listener drm_lease_request;
+	struct wl_listener new_surface;
 
 	struct {
 		struct wl_listener new_lock;
@@ -113,6 +119,8 @@ struct wsm_server {
 	struct wlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
 	struct wlr_drm_lease_v1_manager *drm_lease_manager;
 	struct wlr_content_type_manager_v1 *content_type_manager_v1;
+	struct wlr_tearing_control_manager_v1 *tearing_control_manager_v1;
+	struct wlr_linux_drm_syncobj_manager_v1 *linux_drm_syncobj_manager_v1;
 	struct wlr_data_control_manager_v1 *data_control_manager_v1;
 	struct wlr_screencopy_manager_v1 *screencopy_manager_v1;
 	struct wlr_export_dmabuf_manager_v1 *export_dmabuf_manager_v1;
@@ -134,10 +142,13 @@ struct wsm_server {
 	struct wsm_xdg_decoration_manager *xdg_decoration_manager;
 	struct wsm_idle_inhibit_manager_v1 idle_inhibit_manager_v1;
 	struct wsm_desktop_interface *desktop_interface;
+	struct wsm_effects_manager *effects_manager;
+	struct wsm_worker_pool *worker_pool;
+	struct wsm_image_cache *image_cache;
 
 	size_t txn_timeout_ms;
-	struct wsm_transaction *queued_transaction;
-	struct wsm_transaction *pending_transaction;
+	struct wsm_list *transactions; // committed, waiting for clients
+	struct wsm_list *pending_transactions; // touching disjoint subtrees
 	struct wsm_list *dirty_nodes;
 	struct wl_event_source *delayed_modeset;
 	bool xwayland_enabled;
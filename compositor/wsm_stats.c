@@ -0,0 +1,608 @@
+#include "wsm_stats.h"
+#include "wsm_log.h"
+#include "wsm_list.h"
+#include "wsm_scene.h"
+#include "wsm_common.h"
+#include "wsm_output.h"
+#include "wsm_server.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <wlr/types/wlr_output.h>
+
+struct wsm_client_stats {
+	struct wl_listener destroy;
+	struct wl_list link; // wsm_stats.clients
+	pid_t pid;
+	char comm[32];
+
+	struct timespec last_commit;
+	uint64_t commits;
+	struct wsm_histogram commit_interval_us;
+	struct wsm_histogram configure_ack_us;
+
+	struct wsm_configure_latency configure_latency;
+	uint64_t configure_timeouts;
+};
+
+#define STATS_CONNECTIONS_MAX 8
+
+/**
+ * A report being sent, the rest is written whenever the reader makes room.
+ */
+struct stats_connection {
+	struct wl_list link; // wsm_stats.connections
+	struct wl_event_source *source;
+	int fd;
+	char *report;
+	size_t len, written;
+};
+
+static struct {
+	struct wl_event_loop *loop;
+	struct wl_event_source *source;
+	int fd;
+	char *path;
+	struct wl_list clients; // wsm_client_stats.link
+	struct wl_list connections; // stats_connection.link
+	int connections_len;
+} wsm_stats = {
+	.fd = -1,
+	.clients = { &wsm_stats.clients, &wsm_stats.clients },
+	.connections = { &wsm_stats.connections, &wsm_stats.connections },
+};
+
+void wsm_histogram_add(struct wsm_histogram *histogram, uint64_t value) {
+	int bucket = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+	if (bucket >= WSM_HISTOGRAM_BUCKETS) {
+		bucket = WSM_HISTOGRAM_BUCKETS - 1;
+	}
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum += value;
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+static bool timespec_is_set(const struct timespec *t) {
+	return t->tv_sec != 0 || t->tv_nsec != 0;
+}
+
+static int64_t timespec_diff_nsec(const struct timespec *a, const struct timespec *b) {
+	struct timespec diff;
+	timespec_sub(&diff, a, b);
+	return timespec_to_nsec(&diff);
+}
+
+void wsm_stats_output_commit(struct wsm_output_stats *stats) {
+	clock_gettime(CLOCK_MONOTONIC, &stats->last_commit);
+}
+
+void wsm_stats_output_present(struct wsm_output_stats *stats,
+		const struct timespec *when, uint32_t refresh_nsec) {
+	stats->frames++;
+
+	if (timespec_is_set(&stats->last_commit)) {
+		int64_t latency = timespec_diff_nsec(when, &stats->last_commit);
+		if (latency >= 0) {
+			wsm_histogram_add(&stats->latency_us, latency / 1000);
+			// the commit was aiming for the first vblank after it
+			if (refresh_nsec > 0) {
+				stats->missed_vblanks += latency / refresh_nsec;
+			}
+		}
+	}
+
+	// frames committed after an idle period do not tell the frame interval
+	if (timespec_is_set(&stats->last_present)) {
+		int64_t interval = timespec_diff_nsec(when, &stats->last_present);
+		bool continuous = refresh_nsec == 0 ||
+			timespec_diff_nsec(&stats->last_commit, &stats->last_present) < refresh_nsec;
+		if (interval > 0 && continuous) {
+			wsm_histogram_add(&stats->frame_interval_us, interval / 1000);
+		}
+	}
+
+	stats->last_present = *when;
+}
+
+void wsm_stats_output_render_time(struct wsm_output_stats *stats,
+		int64_t pre_render_ns, int64_t render_ns) {
+	wsm_histogram_add(&stats->pre_render_us, pre_render_ns / 1000);
+	if (render_ns >= 0) {
+		wsm_histogram_add(&stats->render_us, render_ns / 1000);
+	}
+}
+
+void wsm_stats_output_build(struct wsm_output_stats *stats,
+		size_t render_list_len, uint64_t damage_px, bool scanout) {
+	wsm_histogram_add(&stats->render_list_len, render_list_len);
+	wsm_histogram_add(&stats->damage_px, damage_px);
+	if (scanout) {
+		stats->scanout_frames++;
+	} else {
+		stats->composited_frames++;
+	}
+}
+
+void wsm_stats_output_repaint(struct wsm_output_stats *stats,
+		int damage_rects, uint64_t overdraw_px, int64_t record_ns) {
+	wsm_histogram_add(&stats->damage_rects, damage_rects);
+	wsm_histogram_add(&stats->record_ns, record_ns);
+	if (overdraw_px > 0) {
+		stats->damage_simplified++;
+		stats->damage_overdraw_px += overdraw_px;
+	}
+}
+
+static void handle_client_destroy(struct wl_listener *listener, void *data) {
+	struct wsm_client_stats *stats = wl_container_of(listener, stats, destroy);
+	wl_list_remove(&stats->link);
+	wl_list_remove(&stats->destroy.link);
+	free(stats);
+}
+
+static void client_stats_read_comm(struct wsm_client_stats *stats) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/comm", (int)stats->pid);
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return;
+	}
+
+	if (fgets(stats->comm, sizeof(stats->comm), f)) {
+		// keep it usable as a label value
+		for (char *c = stats->comm; *c; ++c) {
+			if (*c == '\n') {
+				*c = '\0';
+				break;
+			} else if (*c == '"' || *c == '\\') {
+				*c = '_';
+			}
+		}
+	}
+	fclose(f);
+}
+
+static struct wsm_client_stats *client_stats_get(struct wl_client *client) {
+	struct wl_listener *listener =
+		wl_client_get_destroy_listener(client, handle_client_destroy);
+	if (listener) {
+		struct wsm_client_stats *stats = wl_container_of(listener, stats, destroy);
+		return stats;
+	}
+
+	struct wsm_client_stats *stats = calloc(1, sizeof(struct wsm_client_stats));
+	if (!stats) {
+		wsm_log(WSM_ERROR, "Could not create wsm_client_stats: allocation failed!");
+		return NULL;
+	}
+
+	wl_client_get_credentials(client, &stats->pid, NULL, NULL);
+	client_stats_read_comm(stats);
+	stats->destroy.notify = handle_client_destroy;
+	wl_client_add_destroy_listener(client, &stats->destroy);
+	wl_list_insert(wsm_stats.clients.prev, &stats->link);
+	return stats;
+}
+
+void wsm_stats_client_commit(struct wl_client *client) {
+	struct wsm_client_stats *stats = client_stats_get(client);
+	if (!stats) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (timespec_is_set(&stats->last_commit)) {
+		wsm_histogram_add(&stats->commit_interval_us,
+			timespec_diff_nsec(&now, &stats->last_commit) / 1000);
+	}
+	stats->last_commit = now;
+	stats->commits++;
+}
+
+static int compare_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* a quarter and 4 ms on top of the p99 absorb jitter */
+static uint64_t configure_deadline_ms(uint64_t p99_us) {
+	uint64_t deadline_ms = p99_us * 5 / 4 / 1000 + 4;
+	return deadline_ms < WSM_CONFIGURE_DEADLINE_MIN_MS ?
+		WSM_CONFIGURE_DEADLINE_MIN_MS : deadline_ms;
+}
+
+/**
+ * Returns whether the deadline moved by a millisecond, only then is it worth
+ * a line.
+ */
+static bool configure_latency_add(struct wsm_configure_latency *latency,
+		uint64_t latency_us) {
+	latency->samples_us[latency->samples_next] =
+		latency_us > UINT32_MAX ? UINT32_MAX : latency_us;
+	latency->samples_next = (latency->samples_next + 1) % WSM_CONFIGURE_ACK_SAMPLES;
+	if (latency->samples_len < WSM_CONFIGURE_ACK_SAMPLES) {
+		latency->samples_len++;
+	}
+	if (latency->samples_len < WSM_CONFIGURE_ACK_MIN_SAMPLES) {
+		return false;
+	}
+
+	uint32_t sorted[WSM_CONFIGURE_ACK_SAMPLES];
+	memcpy(sorted, latency->samples_us, latency->samples_len * sizeof(sorted[0]));
+	qsort(sorted, latency->samples_len, sizeof(sorted[0]), compare_u32);
+	uint64_t p99 = sorted[(latency->samples_len * 99 + 99) / 100 - 1];
+
+	bool moved = p99 / 1000 != latency->p99_us / 1000;
+	latency->p99_us = p99;
+	return moved;
+}
+
+static void client_stats_add_ack_sample(struct wsm_client_stats *stats,
+		struct wsm_configure_latency *latency, uint64_t latency_us) {
+	if (!latency) {
+		latency = &stats->configure_latency;
+	}
+
+	if (configure_latency_add(latency, latency_us)) {
+		wsm_log(WSM_DEBUG, "Client %d (%s)%s acks configures within %" PRIu64 " us "
+			"(p99 of %d), waiting up to %" PRIu64 " ms", (int)stats->pid, stats->comm,
+			latency == &stats->configure_latency ? "" : " window", latency->p99_us,
+			latency->samples_len, configure_deadline_ms(latency->p99_us));
+	}
+}
+
+void wsm_stats_client_configure_acked(struct wl_client *client,
+		struct wsm_configure_latency *latency, const struct timespec *configured) {
+	struct wsm_client_stats *stats = client_stats_get(client);
+	if (!stats) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t elapsed = timespec_diff_nsec(&now, configured);
+	if (elapsed >= 0) {
+		wsm_histogram_add(&stats->configure_ack_us, elapsed / 1000);
+		client_stats_add_ack_sample(stats, latency, elapsed / 1000);
+	}
+}
+
+void wsm_stats_client_configure_timed_out(struct wl_client *client,
+		struct wsm_configure_latency *latency, uint32_t waited_ms) {
+	struct wsm_client_stats *stats = client_stats_get(client);
+	if (!stats) {
+		return;
+	}
+
+	wsm_log(WSM_DEBUG, "Client %d (%s) did not ack a configure within %u ms",
+		(int)stats->pid, stats->comm, waited_ms);
+	stats->configure_timeouts++;
+	// the real latency is longer, but this is enough to raise the deadline
+	client_stats_add_ack_sample(stats, latency, (uint64_t)waited_ms * 1000);
+}
+
+uint32_t wsm_stats_client_configure_deadline(struct wl_client *client,
+		struct wsm_configure_latency *latency, uint32_t max_ms) {
+	if (!latency) {
+		struct wsm_client_stats *stats = client_stats_get(client);
+		if (!stats) {
+			return max_ms;
+		}
+		latency = &stats->configure_latency;
+	}
+
+	if (latency->samples_len < WSM_CONFIGURE_ACK_MIN_SAMPLES) {
+		return max_ms;
+	}
+
+	uint64_t deadline_ms = configure_deadline_ms(latency->p99_us);
+	return deadline_ms < max_ms ? deadline_ms : max_ms;
+}
+
+static void write_histogram(FILE *f, const char *name, const char *labels,
+		const struct wsm_histogram *histogram) {
+	uint64_t cumulative = 0;
+	for (int i = 0; i < WSM_HISTOGRAM_BUCKETS - 1; ++i) {
+		cumulative += histogram->buckets[i];
+		fprintf(f, "%s_bucket{%s,le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+			name, labels, (uint64_t)1 << i, cumulative);
+	}
+	fprintf(f, "%s_bucket{%s,le=\"+Inf\"} %" PRIu64 "\n", name, labels, histogram->count);
+	fprintf(f, "%s_sum{%s} %" PRIu64 "\n", name, labels, histogram->sum);
+	fprintf(f, "%s_count{%s} %" PRIu64 "\n", name, labels, histogram->count);
+}
+
+#define OUTPUT_STAT(name, field, help) \
+	{ "wsm_output_" name, help, offsetof(struct wsm_output_stats, field) }
+#define CLIENT_STAT(name, field, help) \
+	{ "wsm_client_" name, help, offsetof(struct wsm_client_stats, field) }
+
+struct stat_field {
+	const char *name;
+	const char *help;
+	size_t offset;
+};
+
+static const struct stat_field output_counters[] = {
+	OUTPUT_STAT("frames_total", frames, "Presented frames"),
+	OUTPUT_STAT("missed_vblanks_total", missed_vblanks,
+		"Vblanks passed between a commit and its presentation"),
+	OUTPUT_STAT("scanout_frames_total", scanout_frames, "Frames scanned out directly"),
+	OUTPUT_STAT("composited_frames_total", composited_frames, "Frames rendered"),
+	OUTPUT_STAT("suppressed_frame_callbacks_total", suppressed_frame_callbacks,
+		"Frame callbacks held back from fully occluded surfaces"),
+	OUTPUT_STAT("tearing_commits_total", tearing_commits,
+		"Frames committed with an async page flip"),
+	OUTPUT_STAT("dmabuf_feedbacks_total", dmabuf_feedbacks,
+		"Dmabuf feedback updates sent to surfaces"),
+	OUTPUT_STAT("damage_simplified_total", damage_simplified,
+		"Frames whose repaint damage was simplified"),
+	OUTPUT_STAT("damage_overdraw_px_total", damage_overdraw_px,
+		"Pixels repainted beyond the damage because of the simplification"),
+};
+
+static const struct stat_field output_histograms[] = {
+	OUTPUT_STAT("frame_interval_us", frame_interval_us,
+		"Time between presentations of continuous frames"),
+	OUTPUT_STAT("latency_us", latency_us, "Time from commit to presentation"),
+	OUTPUT_STAT("pre_render_us", pre_render_us, "CPU time to build a frame"),
+	OUTPUT_STAT("render_us", render_us, "GPU time to render a frame"),
+	OUTPUT_STAT("render_list_len", render_list_len, "Scene nodes in the render list"),
+	OUTPUT_STAT("damage_px", damage_px, "Damaged pixels of a frame"),
+	OUTPUT_STAT("damage_rects", damage_rects,
+		"Rectangles of the repaint damage before simplification"),
+	OUTPUT_STAT("record_ns", record_ns, "CPU time to clip and record the draw calls of a frame"),
+};
+
+static const struct stat_field client_counters[] = {
+	CLIENT_STAT("commits_total", commits, "Toplevel surface commits"),
+	CLIENT_STAT("configure_timeouts_total", configure_timeouts,
+		"Configures the client did not ack before its deadline"),
+};
+
+static const struct stat_field client_histograms[] = {
+	CLIENT_STAT("commit_interval_us", commit_interval_us,
+		"Time between toplevel surface commits"),
+	CLIENT_STAT("configure_ack_us", configure_ack_us,
+		"Time from a configure to the commit acking it"),
+};
+
+static void output_labels(struct wsm_output *output, char *labels, size_t size) {
+	snprintf(labels, size, "output=\"%s\"", output->wlr_output->name);
+}
+
+static void client_labels(struct wsm_client_stats *stats, char *labels, size_t size) {
+	snprintf(labels, size, "pid=\"%d\",comm=\"%s\"", (int)stats->pid, stats->comm);
+}
+
+static void write_report(FILE *f) {
+	struct wsm_list *outputs = global_server.scene->outputs;
+	char labels[128];
+
+	for (size_t i = 0; i < sizeof(output_counters) / sizeof(output_counters[0]); ++i) {
+		const struct stat_field *field = &output_counters[i];
+		fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", field->name, field->help, field->name);
+		for (int j = 0; j < outputs->length; ++j) {
+			struct wsm_output *output = outputs->items[j];
+			output_labels(output, labels, sizeof(labels));
+			fprintf(f, "%s{%s} %" PRIu64 "\n", field->name, labels,
+				*(uint64_t *)((char *)&output->stats + field->offset));
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(output_histograms) / sizeof(output_histograms[0]); ++i) {
+		const struct stat_field *field = &output_histograms[i];
+		fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", field->name, field->help, field->name);
+		for (int j = 0; j < outputs->length; ++j) {
+			struct wsm_output *output = outputs->items[j];
+			output_labels(output, labels, sizeof(labels));
+			write_histogram(f, field->name, labels,
+				(struct wsm_histogram *)((char *)&output->stats + field->offset));
+		}
+	}
+
+	struct wsm_client_stats *stats;
+	for (size_t i = 0; i < sizeof(client_counters) / sizeof(client_counters[0]); ++i) {
+		const struct stat_field *field = &client_counters[i];
+		fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", field->name, field->help, field->name);
+		wl_list_for_each(stats, &wsm_stats.clients, link) {
+			client_labels(stats, labels, sizeof(labels));
+			fprintf(f, "%s{%s} %" PRIu64 "\n", field->name, labels,
+				*(uint64_t *)((char *)stats + field->offset));
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(client_histograms) / sizeof(client_histograms[0]); ++i) {
+		const struct stat_field *field = &client_histograms[i];
+		fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", field->name, field->help, field->name);
+		wl_list_for_each(stats, &wsm_stats.clients, link) {
+			client_labels(stats, labels, sizeof(labels));
+			write_histogram(f, field->name, labels,
+				(struct wsm_histogram *)((char *)stats + field->offset));
+		}
+	}
+}
+
+static void stats_connection_destroy(struct stats_connection *conn) {
+	if (conn->source) {
+		wl_event_source_remove(conn->source);
+	}
+	wl_list_remove(&conn->link);
+	wsm_stats.connections_len--;
+	close(conn->fd);
+	free(conn->report);
+	free(conn);
+}
+
+/**
+ * Writes as much of the report as the socket takes without blocking.
+ * Returns false once the connection is done with, sent or failed.
+ */
+static bool stats_connection_write(struct stats_connection *conn) {
+	while (conn->written < conn->len) {
+		ssize_t ret = send(conn->fd, conn->report + conn->written,
+			conn->len - conn->written, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			wsm_log_errno(WSM_DEBUG, "Stats report truncated at %zu of %zu bytes",
+				conn->written, conn->len);
+			return false;
+		}
+		conn->written += ret;
+	}
+	return false;
+}
+
+static int handle_connection_writable(int fd, uint32_t mask, void *data) {
+	struct stats_connection *conn = data;
+	if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) ||
+			!stats_connection_write(conn)) {
+		stats_connection_destroy(conn);
+	}
+	return 0;
+}
+
+static int handle_connection(int fd, uint32_t mask, void *data) {
+	int client_fd = accept(fd, NULL, NULL);
+	if (client_fd < 0) {
+		wsm_log_errno(WSM_ERROR, "Unable to accept stats connection");
+		return 0;
+	}
+	fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+	// never wait on a reader which does not keep up
+	int flags = fcntl(client_fd, F_GETFL);
+	if (flags < 0 || fcntl(client_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		wsm_log_errno(WSM_ERROR, "Unable to set stats connection non-blocking");
+		close(client_fd);
+		return 0;
+	}
+
+	if (wsm_stats.connections_len >= STATS_CONNECTIONS_MAX) {
+		wsm_log(WSM_DEBUG, "Too many pending stats connections, dropping one");
+		close(client_fd);
+		return 0;
+	}
+
+	struct stats_connection *conn = calloc(1, sizeof(*conn));
+	if (!conn) {
+		wsm_log(WSM_ERROR, "Could not create stats_connection: allocation failed!");
+		close(client_fd);
+		return 0;
+	}
+	conn->fd = client_fd;
+	wl_list_insert(&wsm_stats.connections, &conn->link);
+	wsm_stats.connections_len++;
+
+	FILE *f = open_memstream(&conn->report, &conn->len);
+	if (!f) {
+		stats_connection_destroy(conn);
+		return 0;
+	}
+	write_report(f);
+	fclose(f);
+
+	if (!stats_connection_write(conn)) {
+		stats_connection_destroy(conn);
+		return 0;
+	}
+
+	conn->source = wl_event_loop_add_fd(wsm_stats.loop, client_fd,
+		WL_EVENT_WRITABLE, handle_connection_writable, conn);
+	if (!conn->source) {
+		wsm_log(WSM_ERROR, "Could not add stats connection event source");
+		stats_connection_destroy(conn);
+	}
+	return 0;
+}
+
+bool wsm_stats_init(struct wl_event_loop *loop) {
+	// anywhere else, other users could connect or take the path first
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	if (!dir) {
+		wsm_log(WSM_ERROR, "XDG_RUNTIME_DIR is not set, no stats socket");
+		return false;
+	}
+
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/wsm-stats.%u.%d.sock",
+		dir, getuid(), getpid());
+	if (len < 0 || (size_t)len >= sizeof(addr.sun_path)) {
+		wsm_log(WSM_ERROR, "Stats socket path is too long");
+		return false;
+	}
+
+	wsm_stats.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (wsm_stats.fd < 0) {
+		wsm_log_errno(WSM_ERROR, "Unable to create stats socket");
+		return false;
+	}
+
+	unlink(addr.sun_path);
+	if (bind(wsm_stats.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(wsm_stats.fd, 4) < 0) {
+		wsm_log_errno(WSM_ERROR, "Unable to listen on %s", addr.sun_path);
+		close(wsm_stats.fd);
+		wsm_stats.fd = -1;
+		return false;
+	}
+
+	wsm_stats.source = wl_event_loop_add_fd(loop, wsm_stats.fd, WL_EVENT_READABLE,
+		handle_connection, NULL);
+	if (!wsm_stats.source) {
+		wsm_log(WSM_ERROR, "Could not add stats event source");
+		unlink(addr.sun_path);
+		close(wsm_stats.fd);
+		wsm_stats.fd = -1;
+		return false;
+	}
+
+	wsm_stats.loop = loop;
+	wsm_stats.path = strdup(addr.sun_path);
+	setenv("WSM_STATS_SOCK", addr.sun_path, true);
+	wsm_log(WSM_DEBUG, "Frame statistics on %s", addr.sun_path);
+	return true;
+}
+
+void wsm_stats_finish(void) {
+	struct wsm_client_stats *stats, *tmp;
+	wl_list_for_each_safe(stats, tmp, &wsm_stats.clients, link) {
+		handle_client_destroy(&stats->destroy, NULL);
+	}
+
+	struct stats_connection *conn, *conn_tmp;
+	wl_list_for_each_safe(conn, conn_tmp, &wsm_stats.connections, link) {
+		stats_connection_destroy(conn);
+	}
+
+	if (wsm_stats.source) {
+		wl_event_source_remove(wsm_stats.source);
+		wsm_stats.source = NULL;
+	}
+	if (wsm_stats.fd >= 0) {
+		close(wsm_stats.fd);
+		wsm_stats.fd = -1;
+	}
+	if (wsm_stats.path) {
+		unlink(wsm_stats.path);
+		free(wsm_stats.path);
+		wsm_stats.path = NULL;
+	}
+}
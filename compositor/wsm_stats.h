@@ -0,0 +1,117 @@
+#ifndef WSM_STATS_H
+#define WSM_STATS_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <wayland-server-core.h>
+
+/* bucket i counts values <= 2^i, the last one is open ended */
+#define WSM_HISTOGRAM_BUCKETS 24
+
+/* recent configure to ack latencies kept per client or X11 window */
+#define WSM_CONFIGURE_ACK_SAMPLES 64
+/* below this many samples a client gets the global transaction timeout */
+#define WSM_CONFIGURE_ACK_MIN_SAMPLES 8
+#define WSM_CONFIGURE_DEADLINE_MIN_MS 16
+
+/**
+ * @brief recent configure to ack latencies of whatever answers configures:
+ * a Wayland client, or a single X11 window, since all of them go through the
+ * Xwayland client
+ */
+struct wsm_configure_latency {
+	uint32_t samples_us[WSM_CONFIGURE_ACK_SAMPLES]; // ring
+	int samples_len;
+	int samples_next;
+	uint64_t p99_us; // of the ring, 0 until enough samples
+};
+
+struct wsm_histogram {
+	uint64_t buckets[WSM_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+};
+
+void wsm_histogram_add(struct wsm_histogram *histogram, uint64_t value);
+
+/**
+ * @brief frame statistics of one output, embedded in wsm_output
+ */
+struct wsm_output_stats {
+	struct wsm_histogram frame_interval_us; // between presentations of continuous frames
+	struct wsm_histogram latency_us; // commit to presentation
+	struct wsm_histogram pre_render_us;
+	struct wsm_histogram render_us; // GPU, when the renderer supports timers
+	struct wsm_histogram render_list_len;
+	struct wsm_histogram damage_px;
+	struct wsm_histogram damage_rects; // repainted, before simplification
+	struct wsm_histogram record_ns; // CPU time clipping and recording draw calls
+
+	struct timespec last_commit;
+	struct timespec last_present;
+	uint64_t frames; // presented
+	uint64_t missed_vblanks;
+	uint64_t scanout_frames;
+	uint64_t composited_frames;
+	uint64_t suppressed_frame_callbacks; // of fully occluded surfaces
+	uint64_t tearing_commits; // async page flips
+	uint64_t dmabuf_feedbacks; // sent on scan-out candidacy changes
+	uint64_t damage_simplified; // frames whose repaint damage was simplified
+	uint64_t damage_overdraw_px; // repainted because of the simplification
+};
+
+void wsm_stats_output_commit(struct wsm_output_stats *stats);
+void wsm_stats_output_present(struct wsm_output_stats *stats,
+	const struct timespec *when, uint32_t refresh_nsec);
+/**
+ * @param render_ns -1 when the GPU duration is unknown
+ */
+void wsm_stats_output_render_time(struct wsm_output_stats *stats,
+	int64_t pre_render_ns, int64_t render_ns);
+void wsm_stats_output_build(struct wsm_output_stats *stats,
+	size_t render_list_len, uint64_t damage_px, bool scanout);
+/**
+ * @brief wsm_stats_output_repaint account a composited frame, the record time
+ * against the overdraw shows what the damage policy trades
+ */
+void wsm_stats_output_repaint(struct wsm_output_stats *stats,
+	int damage_rects, uint64_t overdraw_px, int64_t record_ns);
+
+void wsm_stats_client_commit(struct wl_client *client);
+/**
+ * @param latency the latencies of the window which acked, NULL for the ones
+ * of the client
+ * @param configured when the configure the client just acked was sent
+ */
+void wsm_stats_client_configure_acked(struct wl_client *client,
+	struct wsm_configure_latency *latency, const struct timespec *configured);
+/**
+ * @param waited_ms how long the configure went unanswered, counted as a
+ * latency sample
+ */
+void wsm_stats_client_configure_timed_out(struct wl_client *client,
+	struct wsm_configure_latency *latency, uint32_t waited_ms);
+/**
+ * @brief wsm_stats_client_configure_deadline how long to wait for the client
+ * or the window to ack a configure: the 99th percentile of its recent
+ * latencies with some margin, at least WSM_CONFIGURE_DEADLINE_MIN_MS
+ *
+ * @param max_ms returned too while too little is known about the client
+ */
+uint32_t wsm_stats_client_configure_deadline(struct wl_client *client,
+	struct wsm_configure_latency *latency, uint32_t max_ms);
+
+/**
+ * @brief wsm_stats_init listen on $XDG_RUNTIME_DIR/wsm-stats.<uid>.<pid>.sock,
+ * every connection is answered with the current statistics in the Prometheus
+ * text format and closed. The path is exported as WSM_STATS_SOCK. Without
+ * XDG_RUNTIME_DIR there is no private place for it, and no socket.
+ */
+bool wsm_stats_init(struct wl_event_loop *loop);
+void wsm_stats_finish(void);
+
+#endif
@@ -0,0 +1,353 @@
+#include "wsm_trace.h"
+#include "wsm_log.h"
+#include "wsm_common.h"
+#include "wsm_output.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_compositor.h>
+
+#define TRACE_INFLIGHT 32
+// inputs nobody answered within this long are dropped
+#define TRACE_INFLIGHT_TIMEOUT_NSEC 1000000000
+// device timestamps further in the past than this use another clock
+#define TRACE_DEVICE_SKEW_MSEC 1000
+
+enum trace_stage {
+	TRACE_STAGE_FREE,
+	TRACE_STAGE_HANDLING, // in the compositor
+	TRACE_STAGE_CLIENT, // delivered, waiting for the client to commit
+	TRACE_STAGE_COMMITTED, // waiting for a repaint
+	TRACE_STAGE_REPAINTED, // waiting for the presentation
+};
+
+/* lanes of the trace, one per stage */
+enum trace_lane {
+	TRACE_LANE_TOTAL = 1,
+	TRACE_LANE_QUEUE,
+	TRACE_LANE_COMPOSITOR,
+	TRACE_LANE_CLIENT,
+	TRACE_LANE_REPAINT_WAIT,
+	TRACE_LANE_PRESENT_WAIT,
+};
+
+static const char *trace_lane_names[] = {
+	[TRACE_LANE_TOTAL] = "input to photon",
+	[TRACE_LANE_QUEUE] = "device to compositor",
+	[TRACE_LANE_COMPOSITOR] = "compositor handling",
+	[TRACE_LANE_CLIENT] = "client",
+	[TRACE_LANE_REPAINT_WAIT] = "waiting for repaint",
+	[TRACE_LANE_PRESENT_WAIT] = "repaint to presentation",
+};
+
+struct trace_input {
+	uint64_t id;
+	const char *kind;
+	enum trace_stage stage;
+	struct wl_client *client;
+	struct wlr_surface *surface; // which answered, compared only
+	struct wsm_output *output;
+
+	int64_t device_ns;
+	int64_t received_ns;
+	int64_t handled_ns;
+	int64_t committed_ns;
+	int64_t repainted_ns;
+};
+
+struct trace_event {
+	const char *kind;
+	uint64_t id;
+	enum trace_lane lane;
+	int64_t ts_ns;
+	int64_t dur_ns;
+};
+
+static struct {
+	bool enabled;
+	struct wl_event_source *signal;
+	uint64_t next_id;
+	unsigned int dumps;
+
+	struct trace_input inflight[TRACE_INFLIGHT];
+
+	struct trace_event *events; // ring of WSM_TRACE_EVENTS
+	size_t events_next;
+	size_t events_len;
+	uint64_t dropped;
+} wsm_trace;
+
+static int64_t trace_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static void trace_emit(struct trace_input *input, enum trace_lane lane,
+		int64_t start_ns, int64_t end_ns) {
+	struct trace_event *event = &wsm_trace.events[wsm_trace.events_next];
+	*event = (struct trace_event){
+		.kind = input->kind,
+		.id = input->id,
+		.lane = lane,
+		.ts_ns = start_ns,
+		.dur_ns = end_ns > start_ns ? end_ns - start_ns : 0,
+	};
+
+	wsm_trace.events_next = (wsm_trace.events_next + 1) % WSM_TRACE_EVENTS;
+	if (wsm_trace.events_len < WSM_TRACE_EVENTS) {
+		wsm_trace.events_len++;
+	}
+}
+
+static void trace_input_complete(struct trace_input *input, int64_t presented_ns) {
+	trace_emit(input, TRACE_LANE_TOTAL, input->device_ns, presented_ns);
+	trace_emit(input, TRACE_LANE_QUEUE, input->device_ns, input->received_ns);
+	trace_emit(input, TRACE_LANE_COMPOSITOR, input->received_ns, input->handled_ns);
+	if (input->client) {
+		trace_emit(input, TRACE_LANE_CLIENT, input->handled_ns, input->committed_ns);
+	}
+	trace_emit(input, TRACE_LANE_REPAINT_WAIT, input->committed_ns, input->repainted_ns);
+	trace_emit(input, TRACE_LANE_PRESENT_WAIT, input->repainted_ns, presented_ns);
+	input->stage = TRACE_STAGE_FREE;
+}
+
+static struct trace_input *trace_input_get(uint64_t id) {
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		if (wsm_trace.inflight[i].stage != TRACE_STAGE_FREE &&
+				wsm_trace.inflight[i].id == id) {
+			return &wsm_trace.inflight[i];
+		}
+	}
+	return NULL;
+}
+
+uint64_t wsm_trace_input_begin(const char *kind, uint32_t time_msec) {
+	if (!wsm_trace.enabled) {
+		return 0;
+	}
+
+	int64_t now = trace_now();
+	struct trace_input *slot = NULL;
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		struct trace_input *input = &wsm_trace.inflight[i];
+		if (input->stage != TRACE_STAGE_FREE &&
+				now - input->received_ns > TRACE_INFLIGHT_TIMEOUT_NSEC) {
+			input->stage = TRACE_STAGE_FREE;
+			wsm_trace.dropped++;
+		}
+		if (input->stage == TRACE_STAGE_FREE) {
+			if (!slot || slot->stage != TRACE_STAGE_FREE) {
+				slot = input;
+			}
+		} else if (!slot || (slot->stage != TRACE_STAGE_FREE &&
+				input->received_ns < slot->received_ns)) {
+			slot = input;
+		}
+	}
+	if (slot->stage != TRACE_STAGE_FREE) {
+		wsm_trace.dropped++;
+	}
+
+	uint32_t now_msec = (uint32_t)(now / 1000000);
+	uint32_t queued_msec = now_msec - time_msec;
+
+	*slot = (struct trace_input){
+		.id = ++wsm_trace.next_id,
+		.kind = kind,
+		.stage = TRACE_STAGE_HANDLING,
+		.received_ns = now,
+		.device_ns = queued_msec <= TRACE_DEVICE_SKEW_MSEC ?
+			now - (int64_t)queued_msec * 1000000 : now,
+	};
+	return slot->id;
+}
+
+void wsm_trace_input_handled(uint64_t id, struct wl_client *client) {
+	struct trace_input *input = id ? trace_input_get(id) : NULL;
+	if (!input) {
+		return;
+	}
+
+	input->handled_ns = trace_now();
+	input->client = client;
+	if (client) {
+		input->stage = TRACE_STAGE_CLIENT;
+	} else {
+		input->committed_ns = input->handled_ns;
+		input->stage = TRACE_STAGE_COMMITTED;
+	}
+}
+
+void wsm_trace_client_commit(struct wlr_surface *surface) {
+	if (!wsm_trace.enabled) {
+		return;
+	}
+
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	int64_t now = trace_now();
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		struct trace_input *input = &wsm_trace.inflight[i];
+		if (input->stage == TRACE_STAGE_CLIENT && input->client == client) {
+			input->committed_ns = now;
+			input->surface = surface;
+			input->stage = TRACE_STAGE_COMMITTED;
+		}
+	}
+}
+
+static void trace_input_repainted(struct trace_input *input,
+		struct wsm_output *output, int64_t now) {
+	input->repainted_ns = now;
+	input->output = output;
+	input->stage = TRACE_STAGE_REPAINTED;
+}
+
+struct trace_repaint_data {
+	struct wsm_output *output;
+	int64_t now;
+};
+
+static void trace_repaint_iterator(struct wlr_scene_buffer *buffer,
+		int sx, int sy, void *_data) {
+	struct trace_repaint_data *data = _data;
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (!scene_surface) {
+		return;
+	}
+
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		struct trace_input *input = &wsm_trace.inflight[i];
+		if (input->stage == TRACE_STAGE_COMMITTED &&
+				input->surface == scene_surface->surface) {
+			trace_input_repainted(input, data->output, data->now);
+		}
+	}
+}
+
+void wsm_trace_output_repaint(struct wsm_output *output) {
+	if (!wsm_trace.enabled) {
+		return;
+	}
+
+	// What the compositor handled itself shows on whatever output repaints
+	struct trace_repaint_data data = { .output = output, .now = trace_now() };
+	bool waiting = false;
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		struct trace_input *input = &wsm_trace.inflight[i];
+		if (input->stage != TRACE_STAGE_COMMITTED) {
+			continue;
+		} else if (!input->surface) {
+			trace_input_repainted(input, output, data.now);
+		} else {
+			waiting = true;
+		}
+	}
+
+	if (waiting) {
+		wlr_scene_output_for_each_buffer(output->scene_output,
+			trace_repaint_iterator, &data);
+	}
+}
+
+void wsm_trace_output_present(struct wsm_output *output, const struct timespec *when) {
+	if (!wsm_trace.enabled) {
+		return;
+	}
+
+	int64_t presented_ns = timespec_to_nsec(when);
+	for (int i = 0; i < TRACE_INFLIGHT; ++i) {
+		struct trace_input *input = &wsm_trace.inflight[i];
+		if (input->stage == TRACE_STAGE_REPAINTED && input->output == output) {
+			trace_input_complete(input, presented_ns);
+		}
+	}
+}
+
+static void trace_write(FILE *f) {
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+		"\"args\":{\"name\":\"wsm input latency\"}}");
+	for (size_t lane = TRACE_LANE_TOTAL; lane <= TRACE_LANE_PRESENT_WAIT; ++lane) {
+		fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"name\":\"thread_name\","
+			"\"args\":{\"name\":\"%s\"}}", lane, trace_lane_names[lane]);
+		fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"name\":\"thread_sort_index\","
+			"\"args\":{\"sort_index\":%zu}}", lane, lane);
+	}
+
+	size_t first = (wsm_trace.events_next + WSM_TRACE_EVENTS - wsm_trace.events_len)
+		% WSM_TRACE_EVENTS;
+	for (size_t i = 0; i < wsm_trace.events_len; ++i) {
+		struct trace_event *event = &wsm_trace.events[(first + i) % WSM_TRACE_EVENTS];
+		fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"input\":%" PRIu64 "}}",
+			event->lane, event->kind, event->ts_ns / 1000.0, event->dur_ns / 1000.0,
+			event->id);
+	}
+	fprintf(f, "\n]}\n");
+}
+
+static int handle_dump_signal(int signal_number, void *data) {
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	if (!dir) {
+		dir = "/tmp";
+	}
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/wsm-trace.%d.%u.json",
+		dir, getpid(), wsm_trace.dumps++);
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		wsm_log_errno(WSM_ERROR, "Unable to open %s", path);
+		return 0;
+	}
+
+	trace_write(f);
+	fclose(f);
+	wsm_log(WSM_INFO, "Wrote %zu trace events to %s, %" PRIu64 " inputs dropped",
+		wsm_trace.events_len, path, wsm_trace.dropped);
+	return 0;
+}
+
+bool wsm_trace_init(struct wl_event_loop *loop) {
+	if (!getenv("WSM_TRACE")) {
+		return true;
+	}
+
+	wsm_trace.events = calloc(WSM_TRACE_EVENTS, sizeof(struct trace_event));
+	if (!wsm_trace.events) {
+		wsm_log(WSM_ERROR, "Could not create trace ring: allocation failed!");
+		return false;
+	}
+
+	wsm_trace.signal = wl_event_loop_add_signal(loop, SIGUSR2,
+		handle_dump_signal, NULL);
+	if (!wsm_trace.signal) {
+		wsm_log(WSM_ERROR, "Could not add trace signal source");
+		free(wsm_trace.events);
+		wsm_trace.events = NULL;
+		return false;
+	}
+
+	wsm_trace.enabled = true;
+	wsm_log(WSM_INFO, "Input latency tracing enabled, send SIGUSR2 to pid %d to dump",
+		getpid());
+	return true;
+}
+
+void wsm_trace_finish(void) {
+	if (!wsm_trace.enabled) {
+		return;
+	}
+
+	wl_event_source_remove(wsm_trace.signal);
+	free(wsm_trace.events);
+	memset(&wsm_trace, 0, sizeof(wsm_trace));
+}
@@ -0,0 +1,47 @@
+#ifndef WSM_TRACE_H
+#define WSM_TRACE_H
+
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <wayland-server-core.h>
+
+#define WSM_TRACE_EVENTS 16384
+
+struct wlr_surface;
+struct wsm_output;
+
+/**
+ * @brief input-to-photon tracing, enabled by setting WSM_TRACE in the
+ * environment.
+ *
+ * @details Input events are followed through the compositor, the focused
+ * client and its next commit, the next repaint and the presentation. The
+ * stages of every input that made it to the screen go to a ring buffer, which
+ * is written as Chrome trace event JSON to
+ * $XDG_RUNTIME_DIR/wsm-trace.<pid>.<n>.json on SIGUSR2. Open it in Perfetto
+ * or chrome://tracing.
+ */
+bool wsm_trace_init(struct wl_event_loop *loop);
+void wsm_trace_finish(void);
+
+/**
+ * @param time_msec timestamp of the event from the device
+ * @return id of the traced input, 0 when tracing is off
+ */
+uint64_t wsm_trace_input_begin(const char *kind, uint32_t time_msec);
+/**
+ * @param client the input was delivered to, NULL when the compositor handled
+ * it itself
+ */
+void wsm_trace_input_handled(uint64_t id, struct wl_client *client);
+void wsm_trace_client_commit(struct wlr_surface *surface);
+/**
+ * @brief wsm_trace_output_repaint account a frame committed on the output,
+ * for the inputs whose answering surface it shows
+ */
+void wsm_trace_output_repaint(struct wsm_output *output);
+void wsm_trace_output_present(struct wsm_output *output, const struct timespec *when);
+
+#endif
@@ -1,5 +1,6 @@
 #include "wsm_transaction.h"
 #include "wsm_log.h"
+#include "wsm_common.h"
 #include "wsm_list.h"
 #include "wsm_seat.h"
 #include "wsm_view.h"
@@ -10,6 +11,7 @@
 #include "node/wsm_node.h"
 #include "wsm_titlebar.h"
 #include "wsm_server.h"
+#include "wsm_stats.h"
 #include "wsm_scene.h"
 #include "wsm_arrange.h"
 #include "wsm_input_manager.h"
@@ -17,13 +19,20 @@
 #include "wsm_workspace_manager.h"
 #include "node/wsm_node_descriptor.h"
 
+#include <time.h>
+#include <string.h>
 #include <stdlib.h>
 
 #include <wlr/types/wlr_scene.h>
 
+#define TRANSACTION_ARENA_BLOCK_SIZE 64
+#define TRANSACTION_LIST_POOL_MAX 256
+
 struct wsm_transaction {
 	struct wl_event_source *timer;
 	struct wsm_list *instructions;
+	// outputs and workspaces whose subtrees it touches, the root for all
+	struct wsm_list *keys;
 	size_t num_waiting;
 	size_t num_configures;
 	struct timespec commit_time;
@@ -38,11 +47,133 @@ struct wsm_transaction_instruction {
 		struct wsm_container_state container_state;
 	};
 	uint32_t serial;
+	struct timespec configure_time;
+	int64_t deadline_nsec; // for the client to ack, CLOCK_MONOTONIC
 	bool server_request;
 	bool waiting;
 };
 
+struct transaction_arena_block {
+	struct wl_list link; // transaction_arena.blocks
+	struct wsm_transaction_instruction instructions[TRANSACTION_ARENA_BLOCK_SIZE];
+};
+
+/**
+ * Instructions come from blocks that are never freed before the server, and
+ * the lists holding child nodes are handed back and forth between the
+ * instructions and the current state of the nodes, so that committing a
+ * transaction does not go through the allocator for every node.
+ */
+static struct {
+	struct wl_list blocks; // transaction_arena_block.link
+	struct wsm_list *free_instructions;
+	struct wsm_list *free_transactions;
+	struct wsm_list *free_lists;
+	bool initialized;
+} transaction_arena;
+
+static void transaction_arena_init(void) {
+	if (transaction_arena.initialized) {
+		return;
+	}
+
+	wl_list_init(&transaction_arena.blocks);
+	transaction_arena.free_instructions = create_list();
+	transaction_arena.free_transactions = create_list();
+	transaction_arena.free_lists = create_list();
+	transaction_arena.initialized = true;
+}
+
+static struct wsm_list *transaction_list_get(void) {
+	struct wsm_list *free_lists = transaction_arena.free_lists;
+	if (free_lists->length == 0) {
+		return create_list();
+	}
+
+	struct wsm_list *list = free_lists->items[--free_lists->length];
+	list->length = 0;
+	return list;
+}
+
+static void transaction_list_put(struct wsm_list *list) {
+	if (!list) {
+		return;
+	}
+
+	if (transaction_arena.free_lists->length >= TRANSACTION_LIST_POOL_MAX) {
+		list_free(list);
+		return;
+	}
+	list_add(transaction_arena.free_lists, list);
+}
+
+static struct wsm_transaction_instruction *transaction_instruction_alloc(void) {
+	struct wsm_list *free_instructions = transaction_arena.free_instructions;
+	if (free_instructions->length == 0) {
+		struct transaction_arena_block *block =
+			calloc(1, sizeof(struct transaction_arena_block));
+		if (!block) {
+			return NULL;
+		}
+		wl_list_insert(&transaction_arena.blocks, &block->link);
+		for (int i = TRANSACTION_ARENA_BLOCK_SIZE - 1; i >= 0; i--) {
+			list_add(free_instructions, &block->instructions[i]);
+		}
+	}
+
+	struct wsm_transaction_instruction *instruction =
+		free_instructions->items[--free_instructions->length];
+	memset(instruction, 0, sizeof(struct wsm_transaction_instruction));
+	return instruction;
+}
+
+static void transaction_instruction_free(
+		struct wsm_transaction_instruction *instruction) {
+	list_add(transaction_arena.free_instructions, instruction);
+}
+
+void transaction_arena_finish(void) {
+	if (!transaction_arena.initialized) {
+		return;
+	}
+
+	struct transaction_arena_block *block, *tmp;
+	wl_list_for_each_safe(block, tmp, &transaction_arena.blocks, link) {
+		wl_list_remove(&block->link);
+		free(block);
+	}
+	list_free(transaction_arena.free_instructions);
+
+	for (int i = 0; i < transaction_arena.free_transactions->length; ++i) {
+		struct wsm_transaction *transaction =
+			transaction_arena.free_transactions->items[i];
+		list_free(transaction->instructions);
+		free(transaction);
+	}
+	list_free(transaction_arena.free_transactions);
+
+	for (int i = 0; i < transaction_arena.free_lists->length; ++i) {
+		list_free(transaction_arena.free_lists->items[i]);
+	}
+	list_free(transaction_arena.free_lists);
+	transaction_arena.initialized = false;
+}
+
 static struct wsm_transaction *transaction_create(void) {
+	transaction_arena_init();
+
+	struct wsm_list *free_transactions = transaction_arena.free_transactions;
+	if (free_transactions->length > 0) {
+		struct wsm_transaction *transaction =
+			free_transactions->items[--free_transactions->length];
+		struct wsm_list *instructions = transaction->instructions;
+		memset(transaction, 0, sizeof(struct wsm_transaction));
+		instructions->length = 0;
+		transaction->instructions = instructions;
+		transaction->keys = transaction_list_get();
+		return transaction;
+	}
+
 	struct wsm_transaction *transaction =
 			calloc(1, sizeof(struct wsm_transaction));
 	if (!transaction) {
@@ -50,9 +181,20 @@ static struct wsm_transaction *transaction_create(void) {
 		return NULL;
 	}
 	transaction->instructions = create_list();
+	transaction->keys = transaction_list_get();
 	return transaction;
 }
 
+static void transaction_recycle(struct wsm_transaction *transaction) {
+	if (transaction->timer) {
+		wl_event_source_remove(transaction->timer);
+		transaction->timer = NULL;
+	}
+	transaction_list_put(transaction->keys);
+	transaction->keys = NULL;
+	list_add(transaction_arena.free_transactions, transaction);
+}
+
 static void transaction_destroy(struct wsm_transaction *transaction) {
 	for (int i = 0; i < transaction->instructions->length; ++i) {
 		struct wsm_transaction_instruction *instruction =
@@ -78,14 +220,103 @@ static void transaction_destroy(struct wsm_transaction *transaction) {
 				break;
 			}
 		}
-		free(instruction);
+		transaction_instruction_free(instruction);
 	}
-	list_free(transaction->instructions);
 
-	if (transaction->timer) {
-		wl_event_source_remove(transaction->timer);
+	transaction_recycle(transaction);
+}
+
+/**
+ * Transactions are partitioned by the subtrees they touch, so that a client
+ * slow to ack its configure only holds back the layout of its own workspace.
+ * A node is keyed by the workspaces it is and will be on, workspaces also by
+ * the outputs they are and will be on, outputs by themselves. Anything
+ * without a workspace, and a container fullscreen on all outputs, is keyed by
+ * the root, which overlaps everything.
+ */
+static void node_get_keys(struct wsm_node *node, struct wsm_list *keys) {
+	void *root = global_server.scene;
+	struct wsm_container *con;
+
+	switch (node->type) {
+	case N_ROOT:
+		list_add(keys, root);
+		break;
+	case N_OUTPUT:
+		list_add(keys, node->output);
+		break;
+	case N_WORKSPACE:
+		if (node->destroying) {
+			list_add(keys, root);
+			break;
+		}
+		// moving or switching a workspace changes its outputs' state too
+		list_add(keys, node->workspace);
+		if (node->workspace->output) {
+			list_add(keys, node->workspace->output);
+		}
+		if (node->workspace->current.output &&
+				node->workspace->current.output != node->workspace->output) {
+			list_add(keys, node->workspace->current.output);
+		}
+		break;
+	case N_CONTAINER:
+		con = node->container;
+		if (con->pending.fullscreen_mode == FULLSCREEN_GLOBAL ||
+				con->current.fullscreen_mode == FULLSCREEN_GLOBAL ||
+				(!con->pending.workspace && !con->current.workspace)) {
+			list_add(keys, root);
+			break;
+		}
+		if (con->pending.workspace) {
+			list_add(keys, con->pending.workspace);
+		}
+		if (con->current.workspace && con->current.workspace != con->pending.workspace) {
+			list_add(keys, con->current.workspace);
+		}
+		break;
+	}
+}
+
+static bool keys_overlap(struct wsm_list *a, struct wsm_list *b) {
+	void *root = global_server.scene;
+	if (a->length == 0 || b->length == 0) {
+		return false;
+	}
+	if (list_find(a, root) != -1 || list_find(b, root) != -1) {
+		return true;
+	}
+	for (int i = 0; i < a->length; ++i) {
+		if (list_find(b, a->items[i]) != -1) {
+			return true;
+		}
 	}
-	free(transaction);
+	return false;
+}
+
+static void transaction_add_keys(struct wsm_transaction *transaction,
+		struct wsm_list *keys) {
+	for (int i = 0; i < keys->length; ++i) {
+		if (list_find(transaction->keys, keys->items[i]) == -1) {
+			list_add(transaction->keys, keys->items[i]);
+		}
+	}
+}
+
+/**
+ * Move the instructions of a pending transaction into another one, when a
+ * node joins both of them.
+ */
+static void transaction_merge(struct wsm_transaction *transaction,
+		struct wsm_transaction *other) {
+	for (int i = 0; i < other->instructions->length; ++i) {
+		struct wsm_transaction_instruction *instruction = other->instructions->items[i];
+		instruction->transaction = transaction;
+		list_add(transaction->instructions, instruction);
+	}
+	other->instructions->length = 0;
+	transaction_add_keys(transaction, other->keys);
+	transaction_recycle(other);
 }
 
 static void copy_output_state(struct wsm_output *output,
@@ -94,7 +325,7 @@ static void copy_output_state(struct wsm_output *output,
 	if (state->workspaces) {
 		state->workspaces->length = 0;
 	} else {
-		state->workspaces = create_list();
+		state->workspaces = transaction_list_get();
 	}
 	list_cat(state->workspaces, output->workspaces);
 
@@ -116,12 +347,12 @@ static void copy_workspace_state(struct wsm_workspace *ws,
 	if (state->floating) {
 		state->floating->length = 0;
 	} else {
-		state->floating = create_list();
+		state->floating = transaction_list_get();
 	}
 	if (state->tiling) {
 		state->tiling->length = 0;
 	} else {
-		state->tiling = create_list();
+		state->tiling = transaction_list_get();
 	}
 	list_cat(state->floating, ws->floating);
 	list_cat(state->tiling, ws->tiling);
@@ -141,17 +372,20 @@ static void copy_workspace_state(struct wsm_workspace *ws,
 static void copy_container_state(struct wsm_container *container,
 		struct wsm_transaction_instruction *instruction) {
 	struct wsm_container_state *state = &instruction->container_state;
-
-	if (state->children) {
-		list_free(state->children);
-	}
+	struct wsm_list *children = state->children;
 
 	memcpy(state, &container->pending, sizeof(struct wsm_container_state));
 
 	if (!container->view) {
-		state->children = create_list();
-		list_cat(state->children, container->pending.children);
+		if (children) {
+			children->length = 0;
+		} else {
+			children = transaction_list_get();
+		}
+		list_cat(children, container->pending.children);
+		state->children = children;
 	} else {
+		transaction_list_put(children);
 		state->children = NULL;
 	}
 
@@ -169,19 +403,13 @@ static void transaction_add_node(struct wsm_transaction *transaction,
 		struct wsm_node *node, bool server_request) {
 	struct wsm_transaction_instruction *instruction = NULL;
 
-	if (node->ntxnrefs > 0) {
-		for (int idx = 0; idx < transaction->instructions->length; idx++) {
-			struct wsm_transaction_instruction *other =
-				transaction->instructions->items[idx];
-			if (other->node == node) {
-				instruction = other;
-				break;
-			}
-		}
+	if (node->pending_instruction &&
+			node->pending_instruction->transaction == transaction) {
+		instruction = node->pending_instruction;
 	}
 
 	if (!instruction) {
-		instruction = calloc(1, sizeof(struct wsm_transaction_instruction));
+		instruction = transaction_instruction_alloc();
 		if (!instruction) {
 			wsm_log(WSM_ERROR, "Unable to allocate wsm_transaction_instruction: allocation failed!");
 			return;
@@ -192,6 +420,7 @@ static void transaction_add_node(struct wsm_transaction *transaction,
 
 		list_add(transaction->instructions, instruction);
 		node->ntxnrefs++;
+		node->pending_instruction = instruction;
 	} else if (server_request) {
 		instruction->server_request = true;
 	}
@@ -213,21 +442,21 @@ static void transaction_add_node(struct wsm_transaction *transaction,
 
 static void apply_output_state(struct wsm_output *output,
 		struct wsm_output_state *state) {
-	list_free(output->current.workspaces);
+	transaction_list_put(output->current.workspaces);
 	memcpy(&output->current, state, sizeof(struct wsm_output_state));
 }
 
 static void apply_workspace_state(struct wsm_workspace *ws,
 		struct wsm_workspace_state *state) {
-	list_free(ws->current.floating);
-	list_free(ws->current.tiling);
+	transaction_list_put(ws->current.floating);
+	transaction_list_put(ws->current.tiling);
 	memcpy(&ws->current, state, sizeof(struct wsm_workspace_state));
 }
 
 static void apply_container_state(struct wsm_container *container,
 		struct wsm_container_state *state) {
 	struct wsm_view *view = container->view;
-	list_free(container->current.children);
+	transaction_list_put(container->current.children);
 
 	memcpy(&container->current, state, sizeof(struct wsm_container_state));
 
@@ -275,35 +504,154 @@ static void transaction_apply(struct wsm_transaction *transaction) {
 	}
 }
 
+/**
+ * Re-lay-out the scene of the workspaces touched by an applied transaction,
+ * the containers of a workspace are arranged from it anyway. Anything
+ * involving outputs, the root or hidden containers arranges everything.
+ */
+static void transaction_arrange(struct wsm_transaction *transaction) {
+	arrange_take_scene_mutations();
+	struct wsm_list *workspaces = transaction_list_get();
+	bool full = false;
+	for (int i = 0; i < transaction->instructions->length && !full; ++i) {
+		struct wsm_transaction_instruction *instruction =
+			transaction->instructions->items[i];
+		struct wsm_node *node = instruction->node;
+		struct wsm_workspace *ws = NULL;
+
+		switch (node->type) {
+		case N_ROOT:
+		case N_OUTPUT:
+			full = true;
+			break;
+		case N_WORKSPACE:
+			ws = node->workspace;
+			full = node->destroying;
+			break;
+		case N_CONTAINER:
+			ws = node->container->current.workspace;
+			// scratchpad containers are hidden by the root
+			full = !ws && !node->destroying;
+			break;
+		}
+
+		if (ws && list_find(workspaces, ws) == -1) {
+			list_add(workspaces, ws);
+		}
+	}
+
+	if (full) {
+		arrange_root_scene(global_server.scene);
+		wsm_log(WSM_DEBUG, "Transaction %p arranged the whole scene: "
+			"%zu scene node changes", transaction, arrange_take_scene_mutations());
+	} else {
+		arrange_workspaces_scene(global_server.scene, workspaces);
+		wsm_log(WSM_DEBUG, "Transaction %p arranged %d workspaces: "
+			"%zu scene node changes", transaction, workspaces->length,
+			arrange_take_scene_mutations());
+	}
+	transaction_list_put(workspaces);
+}
+
 static void transaction_commit_pending(void);
 
-static void transaction_progress(void) {
-	if (!global_server.queued_transaction) {
+static void transaction_progress(struct wsm_transaction *transaction) {
+	if (transaction->num_waiting > 0) {
 		return;
 	}
-	if (global_server.queued_transaction->num_waiting > 0) {
+	int index = list_find(global_server.transactions, transaction);
+	if (index == -1) {
 		return;
 	}
-	transaction_apply(global_server.queued_transaction);
-	arrange_root_scene(global_server.scene);
+	list_del(global_server.transactions, index);
+
+	transaction_apply(transaction);
+	transaction_arrange(transaction);
+	transaction_destroy(transaction);
+	// fullscreen views and workspaces decide what outputs show
+	wsm_content_policy_update_all();
+	// seat operations waiting for the transaction may start the next one
 	cursor_rebase_all();
-	transaction_destroy(global_server.queued_transaction);
-	global_server.queued_transaction = NULL;
 
-	if (!global_server.pending_transaction) {
-		wsm_idle_inhibit_v1_check_active();
+	if (!global_server.pending_transactions->length) {
+		if (!global_server.transactions->length) {
+			wsm_idle_inhibit_v1_check_active();
+		}
 		return;
 	}
 
 	transaction_commit_pending();
 }
 
+static struct wl_client *instruction_get_client(
+		struct wsm_transaction_instruction *instruction) {
+	struct wsm_node *node = instruction->node;
+	if (!node_is_view(node) || !node->container->view->surface) {
+		return NULL;
+	}
+	return wl_resource_get_client(node->container->view->surface->resource);
+}
+
+/**
+ * Configure latencies are learned per client, except for X11 windows which
+ * all share the Xwayland client: NULL picks the client's.
+ */
+static struct wsm_configure_latency *instruction_get_configure_latency(
+		struct wsm_transaction_instruction *instruction) {
+#if HAVE_XWAYLAND
+	struct wsm_view *view = instruction->node->container->view;
+	if (view->type == WSM_VIEW_XWAYLAND) {
+		struct wsm_xwayland_view *xwayland_view = (struct wsm_xwayland_view *)view;
+		return &xwayland_view->configure_latency;
+	}
+#endif
+	return NULL;
+}
+
+/**
+ * The transaction is released once the latest deadline of the clients it
+ * still waits for has passed, each learned from how fast the client acked
+ * configures before.
+ */
+static void transaction_arm_timer(struct wsm_transaction *transaction) {
+	int64_t deadline = 0;
+	for (int i = 0; i < transaction->instructions->length; ++i) {
+		struct wsm_transaction_instruction *instruction =
+			transaction->instructions->items[i];
+		if (instruction->waiting && instruction->deadline_nsec > deadline) {
+			deadline = instruction->deadline_nsec;
+		}
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t left_ms = (deadline - timespec_to_nsec(&now) + 999999) / 1000000;
+	wl_event_source_timer_update(transaction->timer, left_ms > 0 ? left_ms : 1);
+}
+
 static int handle_timeout(void *data) {
 	struct wsm_transaction *transaction = data;
 	wsm_log(WSM_DEBUG, "Transaction %p timed out (%zi waiting)",
 		transaction, transaction->num_waiting);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = 0; i < transaction->instructions->length; ++i) {
+		struct wsm_transaction_instruction *instruction =
+			transaction->instructions->items[i];
+		struct wl_client *client = instruction_get_client(instruction);
+		if (instruction->waiting && client) {
+			struct timespec waited;
+			timespec_sub(&waited, &now, &instruction->configure_time);
+			wsm_stats_client_configure_timed_out(client,
+				instruction_get_configure_latency(instruction),
+				timespec_to_msec(&waited));
+		}
+		instruction->waiting = false;
+	}
+
 	transaction->num_waiting = 0;
-	transaction_progress();
+	transaction_progress(transaction);
 	return 0;
 }
 
@@ -341,6 +689,13 @@ static bool should_configure(struct wsm_node *node,
 	return true;
 }
 
+static bool instruction_resizes(struct wsm_transaction_instruction *instruction) {
+	struct wsm_container_state *cstate = &instruction->node->container->current;
+	struct wsm_container_state *istate = &instruction->container_state;
+	return cstate->content_width != istate->content_width ||
+		cstate->content_height != istate->content_height;
+}
+
 static void transaction_commit(struct wsm_transaction *transaction) {
 	wsm_log(WSM_DEBUG, "Transaction %p committing with %i instructions",
 		transaction, transaction->instructions->length);
@@ -349,6 +704,7 @@ static void transaction_commit(struct wsm_transaction *transaction) {
 		struct wsm_transaction_instruction *instruction =
 				transaction->instructions->items[i];
 		struct wsm_node *node = instruction->node;
+		node->pending_instruction = NULL;
 		bool hidden = node_is_view(node) && !node->destroying &&
 					  !view_is_visible(node->container->view);
 		if (should_configure(node, instruction)) {
@@ -357,6 +713,13 @@ static void transaction_commit(struct wsm_transaction *transaction) {
 				instruction->container_state.content_y,
 				instruction->container_state.content_width,
 				instruction->container_state.content_height);
+			clock_gettime(CLOCK_MONOTONIC, &instruction->configure_time);
+			struct wl_client *client = instruction_get_client(instruction);
+			uint32_t deadline_ms = client ? wsm_stats_client_configure_deadline(client,
+				instruction_get_configure_latency(instruction),
+				global_server.txn_timeout_ms) : global_server.txn_timeout_ms;
+			instruction->deadline_nsec = timespec_to_nsec(&instruction->configure_time) +
+				(int64_t)deadline_ms * 1000000;
 			if (!hidden) {
 				instruction->waiting = true;
 				++transaction->num_waiting;
@@ -364,8 +727,10 @@ static void transaction_commit(struct wsm_transaction *transaction) {
 
 			view_send_frame_done(node->container->view);
 		}
+		// the content of a view which keeps its size is shown live
 		if (!hidden && node_is_view(node) &&
-			!node->container->view->saved_surface_tree) {
+			!node->container->view->saved_surface_tree &&
+			(node->destroying || instruction_resizes(instruction))) {
 			view_save_buffer(node->container->view);
 		}
 		node->instruction = instruction;
@@ -376,8 +741,7 @@ static void transaction_commit(struct wsm_transaction *transaction) {
 		transaction->timer = wl_event_loop_add_timer(global_server.wl_event_loop,
 			handle_timeout, transaction);
 		if (transaction->timer) {
-			wl_event_source_timer_update(transaction->timer,
-				global_server.txn_timeout_ms);
+			transaction_arm_timer(transaction);
 		} else {
 			wsm_log_errno(WSM_ERROR, "Unable to create transaction timer "
 				"(some imperfect frames might be rendered)");
@@ -386,29 +750,86 @@ static void transaction_commit(struct wsm_transaction *transaction) {
 	}
 }
 
+static bool transaction_blocked(struct wsm_transaction *transaction) {
+	for (int i = 0; i < global_server.transactions->length; ++i) {
+		struct wsm_transaction *committed = global_server.transactions->items[i];
+		if (keys_overlap(transaction->keys, committed->keys)) {
+			return true;
+		}
+	}
+
+	// a node may have moved away from the subtrees of its committed instruction
+	for (int i = 0; i < transaction->instructions->length; ++i) {
+		struct wsm_transaction_instruction *instruction =
+			transaction->instructions->items[i];
+		if (instruction->node->ntxnrefs > 1) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static struct wsm_transaction *pending_transaction_committable(void) {
+	for (int i = 0; i < global_server.pending_transactions->length; ++i) {
+		struct wsm_transaction *pending = global_server.pending_transactions->items[i];
+		if (!transaction_blocked(pending)) {
+			return pending;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Commit every pending transaction which does not overlap a committed one,
+ * those which do wait for it to be applied.
+ */
 static void transaction_commit_pending(void) {
-	if (global_server.queued_transaction) {
+	static bool committing = false;
+	if (committing) {
+		// transactions applied right away come back here
 		return;
 	}
-	struct wsm_transaction *transaction = global_server.pending_transaction;
-	global_server.pending_transaction = NULL;
-	global_server.queued_transaction = transaction;
-	transaction_commit(transaction);
-	transaction_progress();
+
+	committing = true;
+	struct wsm_transaction *transaction;
+	while ((transaction = pending_transaction_committable())) {
+		list_del(global_server.pending_transactions,
+			list_find(global_server.pending_transactions, transaction));
+		list_add(global_server.transactions, transaction);
+		transaction_commit(transaction);
+		transaction_progress(transaction);
+	}
+	committing = false;
+
+	if (!global_server.transactions->length && !global_server.pending_transactions->length) {
+		wsm_idle_inhibit_v1_check_active();
+	}
 }
 
 static void set_instruction_ready(
 		struct wsm_transaction_instruction *instruction) {
 	struct wsm_transaction *transaction = instruction->transaction;
 
-	if (instruction->waiting && transaction->num_waiting > 0 &&
-		--transaction->num_waiting == 0) {
-		wsm_log(WSM_DEBUG, "Transaction %p is ready", transaction);
-		wl_event_source_timer_update(transaction->timer, 0);
+	struct wl_client *client = instruction_get_client(instruction);
+	if (instruction->waiting && client) {
+		wsm_stats_client_configure_acked(client,
+			instruction_get_configure_latency(instruction),
+			&instruction->configure_time);
+	}
+
+	if (instruction->waiting && transaction->num_waiting > 0) {
+		instruction->waiting = false;
+		if (--transaction->num_waiting == 0) {
+			wsm_log(WSM_DEBUG, "Transaction %p is ready", transaction);
+			wl_event_source_timer_update(transaction->timer, 0);
+		} else {
+			// the slowest client may just have answered
+			transaction_arm_timer(transaction);
+		}
 	}
 
 	instruction->node->instruction = NULL;
-	transaction_progress();
+	transaction_progress(transaction);
 }
 
 bool transaction_notify_view_ready_by_serial(struct wsm_view *view,
@@ -437,25 +858,141 @@ bool transaction_notify_view_ready_by_geometry(struct wsm_view *view,
 	return false;
 }
 
-static void _transaction_commit_dirty(bool server_request) {
-	if (!global_server.dirty_nodes->length) {
-		return;
+/**
+ * Find the pending transaction a node with these keys belongs to, merging
+ * those it joins together, or start a new one. A node already pending stays
+ * in its transaction even if it moved to another subtree since.
+ */
+static struct wsm_transaction *pending_transaction_for_node(struct wsm_node *node,
+		struct wsm_list *keys) {
+	struct wsm_list *pending = global_server.pending_transactions;
+	struct wsm_transaction *transaction = NULL;
+	for (int i = 0; i < pending->length; ++i) {
+		struct wsm_transaction *other = pending->items[i];
+		if (!keys_overlap(keys, other->keys) && (!node->pending_instruction ||
+				node->pending_instruction->transaction != other)) {
+			continue;
+		}
+		if (!transaction) {
+			transaction = other;
+			continue;
+		}
+		list_del(pending, i--);
+		transaction_merge(transaction, other);
 	}
 
-	if (!global_server.pending_transaction) {
-		global_server.pending_transaction = transaction_create();
-		if (!global_server.pending_transaction) {
-			return;
+	if (!transaction) {
+		transaction = transaction_create();
+		if (!transaction) {
+			return NULL;
 		}
+		list_add(pending, transaction);
+	}
+	transaction_add_keys(transaction, keys);
+	return transaction;
+}
+
+/**
+ * A floating view which only moved needs neither a snapshot of its buffers
+ * nor to wait for any client, so unless it is already part of a transaction
+ * its new position is applied right away. This keeps dragging a window at the
+ * pointer rate without allocating.
+ */
+static bool transaction_apply_move(struct wsm_node *node) {
+	if (node->type != N_CONTAINER || node->destroying || node->ntxnrefs > 0) {
+		return false;
+	}
+
+	struct wsm_container *con = node->container;
+	struct wsm_container_state *pending = &con->pending;
+	struct wsm_container_state *current = &con->current;
+	if (!con->view || pending->parent || !pending->workspace ||
+			pending->workspace != current->workspace ||
+			list_find(pending->workspace->floating, con) == -1) {
+		return false;
+	}
+
+	if (pending->width != current->width || pending->height != current->height ||
+			pending->content_width != current->content_width ||
+			pending->content_height != current->content_height ||
+			pending->content_x - pending->x != current->content_x - current->x ||
+			pending->content_y - pending->y != current->content_y - current->y ||
+			pending->fullscreen_mode != FULLSCREEN_NONE ||
+			current->fullscreen_mode != FULLSCREEN_NONE ||
+			pending->border != current->border ||
+			pending->border_thickness != current->border_thickness ||
+			pending->sensing_thickness != current->sensing_thickness ||
+			pending->border_top != current->border_top ||
+			pending->border_bottom != current->border_bottom ||
+			pending->border_left != current->border_left ||
+			pending->border_right != current->border_right) {
+		return false;
 	}
 
+	struct wsm_seat *seat = input_manager_current_seat();
+	if ((seat_get_focus(seat) == node) != current->focused) {
+		return false;
+	}
+
+	current->x = pending->x;
+	current->y = pending->y;
+	current->content_x = pending->content_x;
+	current->content_y = pending->content_y;
+
+#if HAVE_XWAYLAND
+	// the position of X11 windows is theirs to know, nothing to wait for though
+	if (con->view->type == WSM_VIEW_XWAYLAND) {
+		view_configure(con->view, current->content_x, current->content_y,
+			current->content_width, current->content_height);
+	}
+#endif
+
+	// nothing is restacked, the cached render lists just follow the nodes
+	struct wsm_scene *root = global_server.scene;
+	wlr_scene_node_set_position(&con->scene_tree->node, current->x, current->y);
+	wsm_scene_render_lists_node_moved(root, &con->scene_tree->node);
+	wsm_arrange_popups(root->layers.popup);
+	wsm_scene_render_lists_node_moved(root, &root->layers.popup->node);
+	// the scale filter follows the output the view is mostly on
+	container_mark_config_dirty(con);
+	return true;
+}
+
+static void _transaction_commit_dirty(bool server_request) {
+	if (!global_server.dirty_nodes->length) {
+		return;
+	}
+
+	transaction_arena_init();
+	int num_dirty = global_server.dirty_nodes->length;
+	int num_moved = 0;
+	struct wsm_list *keys = transaction_list_get();
 	for (int i = 0; i < global_server.dirty_nodes->length; ++i) {
 		struct wsm_node *node = global_server.dirty_nodes->items[i];
-		transaction_add_node(global_server.pending_transaction, node, server_request);
+		if (transaction_apply_move(node)) {
+			node->dirty = false;
+			num_moved++;
+			continue;
+		}
+
+		keys->length = 0;
+		node_get_keys(node, keys);
+		struct wsm_transaction *transaction = pending_transaction_for_node(node, keys);
+		if (transaction) {
+			transaction_add_node(transaction, node, server_request);
+		}
 		node->dirty = false;
 	}
+	transaction_list_put(keys);
 	global_server.dirty_nodes->length = 0;
 
+	if (num_moved > 0) {
+		cursor_rebase_all();
+		if (num_moved == num_dirty) {
+			return;
+		}
+	}
+
 	transaction_commit_pending();
 }
 
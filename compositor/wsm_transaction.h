@@ -19,6 +19,11 @@
  * When we want to make adjustments to the layout, we change the pending state
  * in containers, mark them as dirty and call transaction_commit_dirty(). This
  * create and commits a transaction from the dirty containers.
+ *
+ * Dirty nodes are split into transactions by the outputs and workspaces they
+ * touch. Transactions on disjoint subtrees are committed and applied
+ * independently, so a client which is slow to respond only holds back its own
+ * workspace. Overlapping transactions are applied in order.
  */
 
 struct wlr_scene_tree;
@@ -61,4 +66,9 @@ bool transaction_notify_view_ready_by_serial(struct wsm_view *view,
 bool transaction_notify_view_ready_by_geometry(struct wsm_view *view,
 	double x, double y, int width, int height);
 
+/**
+ * Release the memory kept around for transactions, once none is left.
+ */
+void transaction_arena_finish(void);
+
 #endif
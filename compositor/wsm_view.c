@@ -20,6 +20,8 @@
 #include "wsm_input_manager.h"
 #include "wsm_xdg_decoration.h"
 #include "wsm_arrange.h"
+#include "wsm_desktop.h"
+#include "wsm_icon_index.h"
 
 #include <float.h>
 #include <stdlib.h>
@@ -62,6 +64,7 @@ bool view_init(struct wsm_view *view, enum wsm_view_type type,
 	view->allow_request_urgent = true;
 	view->enabled = true;
 	wl_signal_init(&view->events.unmap);
+	wl_list_init(&view->app_icon_resolved.link);
 	return true;
 }
 
@@ -79,6 +82,8 @@ void view_destroy(struct wsm_view *view) {
 		return;
 	}
 	wl_list_remove(&view->events.unmap.listener_list);
+	wl_list_remove(&view->app_icon_resolved.link);
+	wsm_output_frame_done_cancel_view(view);
 
 	wlr_scene_node_destroy(&view->scene_tree->node);
 	free(view->title_format);
@@ -847,6 +852,35 @@ void view_update_app_id(struct wsm_view *view) {
 	}
 }
 
+static void view_handle_app_icon_resolved(struct wl_listener *listener, void *data) {
+	struct wsm_view *view = wl_container_of(listener, view, app_icon_resolved);
+	const char *app_id = data;
+	if (strcmp(app_id, view->app_id ? view->app_id : "") != 0) {
+		return;
+	}
+
+	view_update_app_icon(view, view->app_icon_fallback);
+	if (view->app_icon_path && view->container && view->container->title_bar) {
+		container_arrange_title_bar_node(view->container);
+	}
+}
+
+void view_update_app_icon(struct wsm_view *view, const char *fallback_icon_name) {
+	wl_list_remove(&view->app_icon_resolved.link);
+	wl_list_init(&view->app_icon_resolved.link);
+
+	bool pending;
+	free(view->app_icon_path);
+	view->app_icon_fallback = fallback_icon_name;
+	view->app_icon_path = lookup_app_icon(global_server.desktop_interface,
+		view->app_id, fallback_icon_name, &pending);
+	if (pending) {
+		view->app_icon_resolved.notify = view_handle_app_icon_resolved;
+		wl_signal_add(&global_server.desktop_interface->icon_index->events.app_icon_resolved,
+			&view->app_icon_resolved);
+	}
+}
+
 void view_update_title(struct wsm_view *view, bool force) {
 	const char *title = view_get_title(view);
 
@@ -2,6 +2,7 @@
 #define WSM_VIEW_H
 
 #include "../config.h"
+#include "wsm_stats.h"
 
 #include <wayland-server-core.h>
 
@@ -93,6 +94,8 @@ struct wsm_view {
 	char *title_format;
 	char *app_id;
 	char *app_icon_path;
+	const char *app_icon_fallback; // theme icon without an app icon
+	struct wl_listener app_icon_resolved; // wsm_icon_index.events
 
 	struct wl_event_source *urgent_timer;
 	struct wlr_ext_foreign_toplevel_handle_v1 *ext_foreign_toplevel;
@@ -158,6 +161,13 @@ struct wsm_xwayland_view {
 	struct wl_listener surface_tree_destroy;
 
 	struct wlr_scene_tree *surface_tree;
+
+	// every X11 window goes through the Xwayland client, each acks on its own
+	struct wsm_configure_latency configure_latency;
+
+	int prop_requests_pending; // wsm_xwayland.prop_requests of this view
+	bool app_id_pending;
+	bool app_id_resolved;
 };
 
 struct wsm_xwayland_unmanaged {
@@ -220,6 +230,12 @@ void view_update_size(struct wsm_view *view);
 void view_center_and_clip_surface(struct wsm_view *view);
 struct wsm_view *view_from_wlr_surface(struct wlr_surface *surface);
 void view_update_app_id(struct wsm_view *view);
+/**
+ * @brief view_update_app_icon set app_icon_path from view->app_id, or from
+ * the theme icon fallback_icon_name. The titlebar icon is filled in later if
+ * the icon index has to read the disk first.
+ */
+void view_update_app_icon(struct wsm_view *view, const char *fallback_icon_name);
 void view_update_title(struct wsm_view *view, bool force);
 bool view_is_visible(struct wsm_view *view);
 void view_set_urgent(struct wsm_view *view, bool enable);
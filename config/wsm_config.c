@@ -19,6 +19,18 @@ void wsm_config_init() {
 	global_config.tiling_drag = true;
 	global_config.tiling_drag_threshold = 9;
 
+	global_config.occluded_frame_rate = 1;
+	global_config.content_policy = true;
+	global_config.allow_tearing = true;
+
+	global_config.damage_policy = WSM_DAMAGE_POLICY_AUTO;
+	global_config.damage_max_rects = 32;
+	global_config.damage_max_waste = 0.5f;
+	global_config.damage_tile_size = 64;
+
+	global_config.blur_passes = 3;
+	global_config.blur_offset = 2.0f;
+
 	global_config.border = B_NORMAL;
 	global_config.floating_border = B_NORMAL;
 	global_config.floating_border_thickness = 2;
@@ -30,6 +30,16 @@ enum wsm_fowa {
 	FOWA_NONE,
 };
 
+/**
+ * @brief how fragmented output damage is simplified, see wsm_damage_simplify
+ */
+enum wsm_damage_policy {
+	WSM_DAMAGE_POLICY_NONE,
+	WSM_DAMAGE_POLICY_BOUNDING_BOX,
+	WSM_DAMAGE_POLICY_TILES,
+	WSM_DAMAGE_POLICY_AUTO, // bounding box unless it wastes too much, tiles then
+};
+
 enum seat_keyboard_grouping {
 	KEYBOARD_GROUP_DEFAULT, // the default is currently smart
 	KEYBOARD_GROUP_NONE,
@@ -72,6 +82,18 @@ struct wsm_config {
 
 	int tiling_drag_threshold;
 
+	int occluded_frame_rate; // frame callbacks per second of fully covered surfaces
+	bool content_policy; // adaptive sync and refresh rate follow fullscreen content
+	bool allow_tearing; // honor async presentation hints of scanned out surfaces
+
+	enum wsm_damage_policy damage_policy;
+	int damage_max_rects; // simplify damage with more rectangles than this
+	float damage_max_waste; // share of a bounding box allowed to be undamaged
+	int damage_tile_size; // in buffer pixels
+
+	int blur_passes; // dual kawase downsample/upsample iterations
+	float blur_offset; // sample offset of each pass, in pixels of that pass
+
 	enum xwayland_mode xwayland;
 
 	enum wsm_fowa focus_on_window_activation;
@@ -43,7 +43,7 @@ static void default_output_config(struct output_config *oc,
 	struct wsm_output *output = wlr_output->data;
 	oc->subpixel = output->detected_subpixel;
 	oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
-	oc->max_render_time = 0;
+	oc->max_render_time = WSM_MAX_RENDER_TIME_AUTO;
 }
 
 static bool output_config_is_disabling(struct output_config *oc) {
@@ -206,6 +206,7 @@ static bool finalize_output_config(struct output_config *oc, struct wsm_output *
 			wsm_log(WSM_DEBUG, "Set %s scale_filter to %s", oc->name,
 					wsm_output_scale_filter_to_string(output->scale_filter));
 			wlr_damage_ring_add_whole(&output->scene_output->damage_ring);
+			wsm_scene_mark_config_dirty(global_server.scene);
 		}
 	}
 
@@ -227,7 +228,8 @@ static bool finalize_output_config(struct output_config *oc, struct wsm_output *
 		output_enable(output);
 	}
 
-	if (oc && oc->max_render_time >= 0) {
+	if (oc && (oc->max_render_time >= 0
+			|| oc->max_render_time == WSM_MAX_RENDER_TIME_AUTO)) {
 		wsm_log(WSM_DEBUG, "Set %s max render time to %d",
 			oc->name, oc->max_render_time);
 		output->max_render_time = oc->max_render_time;
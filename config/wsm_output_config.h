@@ -29,7 +29,7 @@ struct output_config {
 	enum scale_filter_mode scale_filter;
 	int32_t transform;
 	enum wl_output_subpixel subpixel;
-	int max_render_time; // In milliseconds
+	int max_render_time; // In milliseconds, or WSM_MAX_RENDER_TIME_AUTO
 	int adaptive_sync;
 	enum render_bit_depth render_bit_depth;
 
@@ -5,6 +5,7 @@
 #include "wsm_view.h"
 #include "wsm_tablet.h"
 #include "wsm_common.h"
+#include "wsm_trace.h"
 #include "wsm_scene.h"
 #include "wsm_output.h"
 #include "wsm_container.h"
@@ -168,14 +169,22 @@ void pointer_motion(struct wsm_cursor *cursor, uint32_t time_msec,
 	seatop_pointer_motion(cursor->seat_wsm, time_msec);
 }
 
+static void cursor_trace_input_handled(struct wsm_cursor *cursor, uint64_t trace) {
+	struct wlr_seat_client *focused =
+		cursor->seat_wsm->seat->pointer_state.focused_client;
+	wsm_trace_input_handled(trace, focused ? focused->client : NULL);
+}
+
 static void handle_pointer_motion_relative(
 		struct wl_listener *listener, void *data) {
 	struct wsm_cursor *cursor = wl_container_of(listener, cursor, motion);
 	struct wlr_pointer_motion_event *e = data;
 	cursor_handle_activity_from_device(cursor, &e->pointer->base);
 
+	uint64_t trace = wsm_trace_input_begin("pointer_motion", e->time_msec);
 	pointer_motion(cursor, e->time_msec, &e->pointer->base, e->delta_x,
 		e->delta_y, e->unaccel_dx, e->unaccel_dy);
+	cursor_trace_input_handled(cursor, trace);
 }
 
 static void handle_pointer_motion_absolute(
@@ -192,8 +201,10 @@ static void handle_pointer_motion_absolute(
 	double dx = lx - cursor->cursor_wlr->x;
 	double dy = ly - cursor->cursor_wlr->y;
 
+	uint64_t trace = wsm_trace_input_begin("pointer_motion", event->time_msec);
 	pointer_motion(cursor, event->time_msec, &event->pointer->base, dx, dy,
 		dx, dy);
+	cursor_trace_input_handled(cursor, trace);
 }
 
 static void handle_pointer_button(struct wl_listener *listener, void *data) {
@@ -6,6 +6,7 @@
 #include "wsm_keyboard.h"
 #include "wsm_text_input.h"
 #include "wsm_input_manager.h"
+#include "wsm_trace.h"
 
 #include <stdlib.h>
 #include <strings.h>
@@ -425,16 +426,25 @@ static void handle_key_event(struct wsm_keyboard *keyboard,
 	free(device_identifier);
 }
 
+static void handle_key_event_traced(struct wsm_keyboard *keyboard,
+		struct wlr_keyboard_key_event *event) {
+	uint64_t trace = wsm_trace_input_begin("key", event->time_msec);
+	handle_key_event(keyboard, event);
+	struct wlr_seat_client *focused =
+		keyboard->device_wsm->seat->seat->keyboard_state.focused_client;
+	wsm_trace_input_handled(trace, focused ? focused->client : NULL);
+}
+
 static void handle_keyboard_key(struct wl_listener *listener, void *data) {
 	struct wsm_keyboard *keyboard =
 		wl_container_of(listener, keyboard, keyboard_key);
-	handle_key_event(keyboard, data);
+	handle_key_event_traced(keyboard, data);
 }
 
 static void handle_keyboard_group_key(struct wl_listener *listener, void *data) {
 	struct wsm_keyboard_group *wsm_group =
 		wl_container_of(listener, wsm_group, keyboard_key);
-	handle_key_event(wsm_group->seat_device->keyboard, data);
+	handle_key_event_traced(wsm_group->seat_device->keyboard, data);
 }
 
 static void handle_keyboard_group_enter(struct wl_listener *listener, void *data) {
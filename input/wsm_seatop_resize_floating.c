@@ -20,8 +20,21 @@ struct seatop_resize_floating_event {
 	double ref_con_lx, ref_con_ly;
 	enum wlr_edges edge;
 	bool preserve_ratio;
+	bool deferred; // motion left for when the view answered its configure
 };
 
+/**
+ * Resizes are paced by the client: while the view has a configure in flight,
+ * motion only marks the resize as deferred, and the latest pointer position
+ * is applied once the transaction is done. A fast pointer then costs at most
+ * one transaction per frame of the client.
+ */
+static bool resize_in_flight(struct wsm_container *con) {
+	return con->node.ntxnrefs > 0;
+}
+
+static void resize_floating_update(struct wsm_seat *seat);
+
 static void handle_button(struct wsm_seat *seat, uint32_t time_msec,
 		struct wlr_input_device *device, uint32_t button,
 		enum wl_pointer_button_state state) {
@@ -29,6 +42,9 @@ static void handle_button(struct wsm_seat *seat, uint32_t time_msec,
 	struct wsm_container *con = e->container;
 
 	if (seat->cursor->pressed_button_count == 0) {
+		if (e->deferred) {
+			resize_floating_update(seat);
+		}
 		container_set_resizing(con, false);
 		wsm_arrange_container_auto(con); // Send configure w/o resizing hint
 		transaction_commit_dirty();
@@ -36,7 +52,7 @@ static void handle_button(struct wsm_seat *seat, uint32_t time_msec,
     }
 }
 
-static void handle_pointer_motion(struct wsm_seat *seat, uint32_t time_msec) {
+static void resize_floating_update(struct wsm_seat *seat) {
 	struct seatop_resize_floating_event *e = seat->seatop_data;
 	struct wsm_container *con = e->container;
 	enum wlr_edges edge = e->edge;
@@ -132,7 +148,29 @@ static void handle_pointer_motion(struct wsm_seat *seat, uint32_t time_msec) {
 	con->pending.content_width += relative_grow_width;
 	con->pending.content_height += relative_grow_height;
 
+	e->deferred = false;
 	wsm_arrange_container_auto(con);
+}
+
+static void handle_pointer_motion(struct wsm_seat *seat, uint32_t time_msec) {
+	struct seatop_resize_floating_event *e = seat->seatop_data;
+	if (resize_in_flight(e->container)) {
+		e->deferred = true;
+		return;
+	}
+
+	resize_floating_update(seat);
+	transaction_commit_dirty();
+}
+
+static void handle_rebase(struct wsm_seat *seat, uint32_t time_msec) {
+	// called once a transaction was applied
+	struct seatop_resize_floating_event *e = seat->seatop_data;
+	if (!e->deferred || resize_in_flight(e->container)) {
+		return;
+	}
+
+	resize_floating_update(seat);
 	transaction_commit_dirty();
 }
 
@@ -146,6 +184,7 @@ static void handle_unref(struct wsm_seat *seat, struct wsm_container *con) {
 static const struct wsm_seatop_impl seatop_impl = {
 	.button = handle_button,
 	.pointer_motion = handle_pointer_motion,
+	.rebase = handle_rebase,
 	.unref = handle_unref,
 };
 
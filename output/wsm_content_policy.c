@@ -0,0 +1,248 @@
+#include "wsm_content_policy.h"
+#include "wsm_log.h"
+#include "wsm_view.h"
+#include "wsm_scene.h"
+#include "wsm_server.h"
+#include "wsm_config.h"
+#include "wsm_common.h"
+#include "wsm_output.h"
+#include "wsm_container.h"
+#include "wsm_workspace.h"
+#include "wsm_output_config.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_content_type_v1.h>
+
+static const char *content_names[] = {
+	[WSM_OUTPUT_CONTENT_DESKTOP] = "desktop",
+	[WSM_OUTPUT_CONTENT_GAME] = "game",
+	[WSM_OUTPUT_CONTENT_VIDEO] = "video",
+};
+
+static enum wsm_output_content output_current_content(struct wsm_output *output) {
+	struct wsm_container *fullscreen = global_server.scene->fullscreen_global;
+	if (!fullscreen) {
+		struct wsm_workspace *workspace = output_get_active_workspace(output);
+		fullscreen = workspace ? workspace->current.fullscreen : NULL;
+	}
+	if (!fullscreen || !fullscreen->view || !fullscreen->view->surface) {
+		return WSM_OUTPUT_CONTENT_DESKTOP;
+	}
+
+	switch (wlr_surface_get_content_type_v1(global_server.content_type_manager_v1,
+			fullscreen->view->surface)) {
+	case WP_CONTENT_TYPE_V1_TYPE_GAME:
+		return WSM_OUTPUT_CONTENT_GAME;
+	case WP_CONTENT_TYPE_V1_TYPE_VIDEO:
+		return WSM_OUTPUT_CONTENT_VIDEO;
+	default:
+		return WSM_OUTPUT_CONTENT_DESKTOP;
+	}
+}
+
+static bool refresh_is_multiple_of(int refresh_mhz, int rate_mhz) {
+	double multiple = round((double)refresh_mhz / rate_mhz);
+	return multiple >= 1 && fabs(refresh_mhz - multiple * rate_mhz) <= refresh_mhz * 0.001;
+}
+
+/**
+ * 24 fps films and 30 fps broadcasts both play without judder at multiples
+ * of 120 Hz, films alone at multiples of 24 Hz.
+ */
+static int video_refresh_score(int refresh_mhz) {
+	int score = 0;
+	if (refresh_is_multiple_of(refresh_mhz, 24000)) {
+		score++;
+		if (refresh_is_multiple_of(refresh_mhz, 30000)) {
+			score++;
+		}
+	}
+	return score;
+}
+
+static struct wlr_output_mode *video_mode(struct wlr_output *wlr_output) {
+	struct wlr_output_mode *current = wlr_output->current_mode;
+	if (!current) {
+		return NULL;
+	}
+
+	struct wlr_output_mode *best = current;
+	int best_score = video_refresh_score(current->refresh);
+	struct wlr_output_mode *mode;
+	wl_list_for_each(mode, &wlr_output->modes, link) {
+		if (mode->width != current->width || mode->height != current->height) {
+			continue;
+		}
+
+		int score = video_refresh_score(mode->refresh);
+		if (score > best_score || (score == best_score && score > 0 &&
+				mode->refresh > best->refresh)) {
+			best = mode;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
+
+static bool output_has_mode(struct wlr_output *wlr_output, struct wlr_output_mode *mode) {
+	struct wlr_output_mode *iter;
+	wl_list_for_each(iter, &wlr_output->modes, link) {
+		if (iter == mode) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Adaptive sync set in the output configuration is the user's choice and is
+ * left alone.
+ */
+static bool output_adaptive_sync_configured(struct wsm_output *output) {
+	struct output_config *oc = find_output_config(output);
+	bool configured = oc && oc->adaptive_sync != -1;
+	free_output_config(oc);
+	return configured;
+}
+
+static bool content_policy_apply(struct wsm_output *output,
+		enum wsm_output_content content) {
+	struct wsm_content_policy *policy = &output->content_policy;
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	struct wlr_output_state state;
+	wlr_output_state_init(&state);
+
+	bool adaptive_sync_enabled =
+		wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+	bool adaptive_sync = adaptive_sync_enabled;
+	if (wlr_output->adaptive_sync_supported && !output_adaptive_sync_configured(output)) {
+		if (content == WSM_OUTPUT_CONTENT_DESKTOP) {
+			adaptive_sync = policy->desktop_adaptive_sync;
+		} else {
+			if (policy->applied == WSM_OUTPUT_CONTENT_DESKTOP) {
+				policy->desktop_adaptive_sync = adaptive_sync_enabled;
+			}
+			adaptive_sync = true;
+		}
+		if (adaptive_sync != adaptive_sync_enabled) {
+			wlr_output_state_set_adaptive_sync_enabled(&state, adaptive_sync);
+		}
+	}
+
+	// adaptive sync already follows the frame rate of the video
+	if (content == WSM_OUTPUT_CONTENT_VIDEO && !adaptive_sync) {
+		struct wlr_output_mode *mode = video_mode(wlr_output);
+		if (mode && mode != wlr_output->current_mode) {
+			policy->desktop_mode = wlr_output->current_mode;
+			wlr_output_state_set_mode(&state, mode);
+		}
+	} else if (content != WSM_OUTPUT_CONTENT_VIDEO && policy->desktop_mode) {
+		if (output_has_mode(wlr_output, policy->desktop_mode) &&
+				policy->desktop_mode != wlr_output->current_mode) {
+			wlr_output_state_set_mode(&state, policy->desktop_mode);
+		}
+		policy->desktop_mode = NULL;
+	}
+
+	bool ok = true;
+	if (state.committed) {
+		ok = wlr_output_test_state(wlr_output, &state) &&
+			wlr_output_commit_state(wlr_output, &state);
+		wsm_log(WSM_DEBUG, "Switching %s to %s content: adaptive sync %s, %.3f Hz%s",
+			wlr_output->name, content_names[content],
+			wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ?
+				"enabled" : "disabled",
+			wlr_output->refresh / 1000.0, ok ? "" : " (failed)");
+	}
+
+	wlr_output_state_finish(&state);
+	return ok;
+}
+
+static bool content_policy_enabled(struct wsm_output *output) {
+	return global_config.content_policy && global_server.content_type_manager_v1 &&
+		output->enabled && output->wlr_output && output->wlr_output->enabled;
+}
+
+/**
+ * Returns how long the candidate still has to wait before it is applied, 0
+ * when it is applied or nothing is to be done.
+ */
+static int64_t content_policy_evaluate(struct wsm_output *output, bool apply) {
+	if (!content_policy_enabled(output)) {
+		return 0;
+	}
+
+	struct wsm_content_policy *policy = &output->content_policy;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	enum wsm_output_content content = output_current_content(output);
+	if (content != policy->candidate) {
+		policy->candidate = content;
+		policy->candidate_since = now;
+	}
+	if (policy->candidate == policy->applied) {
+		return 0;
+	}
+
+	struct timespec stable, since_change;
+	timespec_sub(&stable, &now, &policy->candidate_since);
+	timespec_sub(&since_change, &now, &policy->last_change);
+	int64_t needed = policy->candidate == WSM_OUTPUT_CONTENT_DESKTOP ?
+		WSM_CONTENT_POLICY_LEAVE_MSEC : WSM_CONTENT_POLICY_ENTER_MSEC;
+	int64_t wait = MAX(needed - timespec_to_msec(&stable),
+		WSM_CONTENT_POLICY_CHANGE_INTERVAL_MSEC - timespec_to_msec(&since_change));
+	if (wait > 0 || !apply) {
+		return MAX(wait, 1);
+	}
+
+	// a failed switch is not retried before the next interval either
+	policy->last_change = now;
+	if (content_policy_apply(output, policy->candidate)) {
+		policy->applied = policy->candidate;
+		return 0;
+	}
+	return WSM_CONTENT_POLICY_CHANGE_INTERVAL_MSEC;
+}
+
+static int handle_content_policy_timer(void *data) {
+	struct wsm_output *output = data;
+	int64_t wait = content_policy_evaluate(output, true);
+	wl_event_source_timer_update(output->content_policy.timer, wait);
+	return 0;
+}
+
+void wsm_content_policy_init(struct wsm_output *output) {
+	output->content_policy.timer = wl_event_loop_add_timer(global_server.wl_event_loop,
+		handle_content_policy_timer, output);
+}
+
+void wsm_content_policy_finish(struct wsm_output *output) {
+	if (output->content_policy.timer) {
+		wl_event_source_remove(output->content_policy.timer);
+		output->content_policy.timer = NULL;
+	}
+}
+
+void wsm_content_policy_update(struct wsm_output *output) {
+	// the wait left is counted from when the candidate showed up, re-arming
+	// for the same candidate keeps the deadline
+	int64_t wait = content_policy_evaluate(output, false);
+	if (output->content_policy.timer) {
+		wl_event_source_timer_update(output->content_policy.timer, wait);
+	}
+}
+
+void wsm_content_policy_update_all(void) {
+	struct wsm_list *outputs = global_server.scene->outputs;
+	for (int i = 0; i < outputs->length; ++i) {
+		wsm_content_policy_update(outputs->items[i]);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef WSM_CONTENT_POLICY_H
+#define WSM_CONTENT_POLICY_H
+
+#include <time.h>
+
+#include <wayland-server-core.h>
+
+#define WSM_CONTENT_POLICY_ENTER_MSEC 1000
+#define WSM_CONTENT_POLICY_LEAVE_MSEC 3000
+#define WSM_CONTENT_POLICY_CHANGE_INTERVAL_MSEC 5000
+
+struct wsm_output;
+struct wlr_output_mode;
+
+/**
+ * @brief what an output mostly shows, from the content type of its
+ * fullscreen surface
+ */
+enum wsm_output_content {
+	WSM_OUTPUT_CONTENT_DESKTOP,
+	WSM_OUTPUT_CONTENT_GAME,
+	WSM_OUTPUT_CONTENT_VIDEO,
+};
+
+/**
+ * @brief adaptive sync and refresh rate policy of an output
+ *
+ * @details Games and videos shown fullscreen get adaptive sync, unless the
+ * output configuration sets it, videos get a refresh rate which is a multiple
+ * of the common frame rates when adaptive sync stays off. The desktop goes
+ * back to the adaptive sync state and refresh rate it had before. A new
+ * content has to last for a while before it is applied, and changes are rate
+ * limited, so that toggling a window does not turn into a modeset storm.
+ */
+struct wsm_content_policy {
+	enum wsm_output_content applied;
+	enum wsm_output_content candidate;
+	struct timespec candidate_since;
+	struct timespec last_change;
+	struct wlr_output_mode *desktop_mode; // to go back to after a video
+	bool desktop_adaptive_sync; // to go back to after a game or a video
+	struct wl_event_source *timer; // armed while the candidate is not applied
+};
+
+void wsm_content_policy_init(struct wsm_output *output);
+void wsm_content_policy_finish(struct wsm_output *output);
+/**
+ * @brief wsm_content_policy_update look at what the output shows, cheap
+ * enough to be called whenever it may have changed. A new candidate arms the
+ * timer which applies it, outside of any frame or commit handler.
+ */
+void wsm_content_policy_update(struct wsm_output *output);
+void wsm_content_policy_update_all(void);
+
+#endif
@@ -10,15 +10,18 @@
 #include "wsm_arrange.h"
 #include "wsm_workspace.h"
 #include "wsm_transaction.h"
+#include "wsm_trace.h"
 #include "wsm_input_manager.h"
 #include "wsm_output_manager.h"
 #include "wsm_workspace_manager.h"
 #include "wsm_layer_shell.h"
+#include "wsm_config.h"
 #include "wsm_output_config.h"
 #include "node/wsm_node_descriptor.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <pixman.h>
@@ -38,12 +41,76 @@ struct send_frame_done_data {
 	struct timespec when;
 	struct wsm_output *output;
 	int msec_until_refresh;
+	bool occluded_due; // fully occluded buffers get their throttled callback
+	struct wsm_view *last_queued_view;
 };
 
-struct buffer_timer {
-	struct wl_listener destroy;
-	struct wl_event_source *frame_done_timer;
-};
+
+#define RENDER_TIME_MIN_SAMPLES 16
+#define RENDER_TIME_PERCENTILE 95
+// timer wakeup latency and the commit itself, on top of the measured render
+#define RENDER_TIME_SLACK_NSEC 1000000
+
+static int compare_render_time(const void *a, const void *b) {
+	int64_t lhs = *(const int64_t *)a;
+	int64_t rhs = *(const int64_t *)b;
+	return (lhs > rhs) - (lhs < rhs);
+}
+
+/**
+ * Read back the timer of the previous repaint. Repaints without damage leave
+ * a zero duration and are not counted, a GPU query which is still not done
+ * by the next repaint is dropped.
+ */
+static void output_collect_render_time(struct wsm_output *output) {
+	struct wlr_scene_timer *timer = &output->render_time.timer;
+	int64_t duration = wlr_scene_timer_get_duration_ns(timer);
+	if (duration > 0) {
+		wsm_stats_output_render_time(&output->stats, timer->pre_render_duration,
+			timer->render_timer ? duration - timer->pre_render_duration : -1);
+	}
+	wlr_scene_timer_finish(timer);
+	*timer = (struct wlr_scene_timer){0};
+	if (duration <= 0) {
+		return;
+	}
+
+	output->render_time.samples[output->render_time.next_sample] = duration;
+	output->render_time.next_sample =
+		(output->render_time.next_sample + 1) % WSM_RENDER_TIME_SAMPLES;
+	if (output->render_time.samples_len < WSM_RENDER_TIME_SAMPLES) {
+		output->render_time.samples_len++;
+	}
+
+	size_t len = output->render_time.samples_len;
+	if (len < RENDER_TIME_MIN_SAMPLES) {
+		return;
+	}
+
+	int64_t sorted[WSM_RENDER_TIME_SAMPLES];
+	memcpy(sorted, output->render_time.samples, len * sizeof(sorted[0]));
+	qsort(sorted, len, sizeof(sorted[0]), compare_render_time);
+	int64_t percentile = sorted[(len - 1) * RENDER_TIME_PERCENTILE / 100];
+
+	int estimate_msec = (percentile + RENDER_TIME_SLACK_NSEC + 999999) / 1000000;
+	if (estimate_msec != output->render_time.estimate_msec) {
+		wsm_log(WSM_DEBUG, "Render time estimate of %s: %d ms (p%d %.2f ms)",
+			output->wlr_output->name, estimate_msec, RENDER_TIME_PERCENTILE,
+			percentile / 1000000.0);
+		output->render_time.estimate_msec = estimate_msec;
+	}
+}
+
+/**
+ * Milliseconds to reserve before the predicted vblank, either configured or
+ * learned. 0 repaints as soon as the frame event arrives.
+ */
+static int output_max_render_time(struct wsm_output *output) {
+	if (output->max_render_time == WSM_MAX_RENDER_TIME_AUTO) {
+		return output->render_time.estimate_msec;
+	}
+	return output->max_render_time;
+}
 
 static void begin_destroy(struct wsm_output *output) {
 	if (output->enabled) {
@@ -61,6 +128,11 @@ static void begin_destroy(struct wsm_output *output) {
 	wl_list_remove(&output->frame.link);
 	wl_list_remove(&output->request_state.link);
 
+	wsm_scene_output_release_render_list(output);
+	wl_array_release(&output->backdrop_nodes);
+	wl_array_init(&output->backdrop_nodes);
+	wlr_scene_timer_finish(&output->render_time.timer);
+	output->render_time.timer = (struct wlr_scene_timer){0};
 	wlr_scene_output_destroy(output->scene_output);
 	output->scene_output = NULL;
 	output->wlr_output->data = NULL;
@@ -97,9 +169,20 @@ static void handle_commit(struct wl_listener *listener, void *data) {
 		update_output_manager_config(&global_server);
 	}
 
+	// What the hardware rejected may fit the new mode
+	if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+			WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_RENDER_FORMAT)) {
+		output->plane_failed_len = 0;
+	}
+
 	if ((event->state->committed & WLR_OUTPUT_STATE_ENABLED) && !output->wlr_output->enabled) {
 		output->gamma_lut_changed = true;
 	}
+
+	if (event->state->committed & WLR_OUTPUT_STATE_BUFFER) {
+		wsm_stats_output_commit(&output->stats);
+		wsm_trace_output_repaint(output);
+	}
 }
 
 static void handle_present(struct wl_listener *listener, void *data) {
@@ -112,68 +195,192 @@ static void handle_present(struct wl_listener *listener, void *data) {
 
 	output->last_presentation = *output_event->when;
 	output->refresh_nsec = output_event->refresh;
+	wsm_stats_output_present(&output->stats, output_event->when, output_event->refresh);
+	wsm_trace_output_present(output, output_event->when);
+}
+
+/**
+ * Views with their own max_render_time get their frame callbacks later in the
+ * frame. The deadlines of an output are kept in a min-heap, served by a single
+ * timer which is only rearmed when the earliest deadline moves.
+ */
+static void frame_done_queue_swap(struct wsm_frame_done_deadline *entries,
+		size_t a, size_t b) {
+	struct wsm_frame_done_deadline tmp = entries[a];
+	entries[a] = entries[b];
+	entries[b] = tmp;
+}
+
+static void frame_done_queue_sift_up(struct wsm_frame_done_deadline *entries,
+		size_t i) {
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (entries[parent].deadline_nsec <= entries[i].deadline_nsec) {
+			break;
+		}
+		frame_done_queue_swap(entries, i, parent);
+		i = parent;
+	}
 }
 
-static int handle_buffer_timer(void *data) {
-	struct wlr_scene_buffer *buffer = data;
+static void frame_done_queue_sift_down(struct wsm_frame_done_deadline *entries,
+		size_t len, size_t i) {
+	while (true) {
+		size_t smallest = i;
+		size_t left = 2 * i + 1, right = 2 * i + 2;
+		if (left < len && entries[left].deadline_nsec < entries[smallest].deadline_nsec) {
+			smallest = left;
+		}
+		if (right < len && entries[right].deadline_nsec < entries[smallest].deadline_nsec) {
+			smallest = right;
+		}
+		if (smallest == i) {
+			break;
+		}
+		frame_done_queue_swap(entries, i, smallest);
+		i = smallest;
+	}
+}
+
+static size_t frame_done_queue_len(struct wsm_output *output) {
+	return output->frame_done_queue.size / sizeof(struct wsm_frame_done_deadline);
+}
+
+static void frame_done_queue_arm(struct wsm_output *output) {
+	if (frame_done_queue_len(output) == 0) {
+		output->frame_done_armed_nsec = 0;
+		return;
+	}
+
+	struct wsm_frame_done_deadline *first = output->frame_done_queue.data;
+	if (output->frame_done_armed_nsec != 0 &&
+			output->frame_done_armed_nsec <= first->deadline_nsec) {
+		return;
+	}
+
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	wlr_scene_buffer_send_frame_done(buffer, &now);
-	return 0;
+	int64_t delay = first->deadline_nsec - timespec_to_nsec(&now);
+	int delay_msec = delay > 0 ? (delay + 999999) / 1000000 : 1;
+	wl_event_source_timer_update(output->frame_done_timer, delay_msec);
+	output->frame_done_armed_nsec = first->deadline_nsec;
 }
 
-static void handle_buffer_timer_destroy(struct wl_listener *listener, void *data) {
-	struct buffer_timer *timer = wl_container_of(listener, timer, destroy);
+static void frame_done_queue_push(struct wsm_output *output,
+		struct wsm_view *view, int64_t deadline_nsec) {
+	struct wsm_frame_done_deadline *entry =
+		wl_array_add(&output->frame_done_queue, sizeof(*entry));
+	if (!entry) {
+		wsm_log(WSM_ERROR, "Could not queue frame done: allocation failed!");
+		return;
+	}
 
-	wl_list_remove(&timer->destroy.link);
-	wl_event_source_remove(timer->frame_done_timer);
-	free(timer);
+	*entry = (struct wsm_frame_done_deadline){
+		.deadline_nsec = deadline_nsec,
+		.view = view,
+	};
+	frame_done_queue_sift_up(output->frame_done_queue.data,
+		frame_done_queue_len(output) - 1);
 }
 
-static struct buffer_timer *buffer_timer_get_or_create(struct wlr_scene_buffer *buffer) {
-	struct buffer_timer *timer =
-		wsm_scene_descriptor_try_get(&buffer->node, WSM_SCENE_DESC_BUFFER_TIMER);
-	if (timer) {
-		return timer;
-	}
+static void frame_done_queue_pop(struct wsm_output *output) {
+	struct wsm_frame_done_deadline *entries = output->frame_done_queue.data;
+	size_t len = frame_done_queue_len(output) - 1;
+	entries[0] = entries[len];
+	output->frame_done_queue.size -= sizeof(*entries);
+	frame_done_queue_sift_down(entries, len, 0);
+}
 
-	timer = calloc(1, sizeof(struct buffer_timer));
-	if (!timer) {
-		wsm_log(WSM_ERROR, "Could not create buffer_timer: allocation failed!");
-		return NULL;
+struct view_frame_done_data {
+	struct wsm_output *output;
+	struct timespec when;
+};
+
+static void send_view_frame_done_iterator(struct wlr_scene_buffer *buffer,
+		int x, int y, void *user_data) {
+	struct view_frame_done_data *data = user_data;
+	if (buffer->primary_output == data->output->scene_output) {
+		wlr_scene_buffer_send_frame_done(buffer, &data->when);
 	}
+}
 
-	timer->frame_done_timer = wl_event_loop_add_timer(global_server.wl_event_loop,
-		handle_buffer_timer, buffer);
-	if (!timer->frame_done_timer) {
-		free(timer);
-		return NULL;
+static int handle_frame_done_timer(void *data) {
+	struct wsm_output *output = data;
+	output->frame_done_armed_nsec = 0;
+
+	struct view_frame_done_data frame_done = { .output = output };
+	clock_gettime(CLOCK_MONOTONIC, &frame_done.when);
+	// the timer has a millisecond resolution, flush what is due before the next tick
+	int64_t flush_until = timespec_to_nsec(&frame_done.when) + 500000;
+
+	while (frame_done_queue_len(output) > 0) {
+		struct wsm_frame_done_deadline *first = output->frame_done_queue.data;
+		if (first->deadline_nsec > flush_until) {
+			break;
+		}
+
+		struct wsm_view *view = first->view;
+		frame_done_queue_pop(output);
+		wlr_scene_node_for_each_buffer(&view->content_tree->node,
+			send_view_frame_done_iterator, &frame_done);
 	}
 
-	wsm_scene_descriptor_assign(&buffer->node, WSM_SCENE_DESC_BUFFER_TIMER, timer);
+	frame_done_queue_arm(output);
+	return 0;
+}
+
+static void frame_done_queue_clear(struct wsm_output *output) {
+	output->frame_done_queue.size = 0;
+	output->frame_done_armed_nsec = 0;
+	wl_event_source_timer_update(output->frame_done_timer, 0);
+}
 
-	timer->destroy.notify = handle_buffer_timer_destroy;
-	wl_signal_add(&buffer->node.events.destroy, &timer->destroy);
+void wsm_output_frame_done_cancel_view(struct wsm_view *view) {
+	for (int i = 0; i < global_server.scene->outputs->length; ++i) {
+		struct wsm_output *output = global_server.scene->outputs->items[i];
+		struct wsm_frame_done_deadline *entries = output->frame_done_queue.data;
+		size_t len = frame_done_queue_len(output);
+		size_t kept = 0;
+		for (size_t j = 0; j < len; ++j) {
+			if (entries[j].view != view) {
+				entries[kept++] = entries[j];
+			}
+		}
+		if (kept == len) {
+			continue;
+		}
 
-	return timer;
+		output->frame_done_queue.size = kept * sizeof(*entries);
+		for (size_t j = kept / 2; j-- > 0;) {
+			frame_done_queue_sift_down(entries, kept, j);
+		}
+	}
 }
 
 static void send_frame_done_iterator(struct wlr_scene_buffer *buffer,
 		int x, int y, void *user_data) {
 	struct send_frame_done_data *data = user_data;
 	struct wsm_output *output = data->output;
-	int view_max_render_time = 0;
-	
+	struct wsm_view *view = NULL;
+
+	// the buffer overlaps this output, but nothing of it is visible anywhere
+	if (buffer->primary_output == NULL) {
+		if (data->occluded_due) {
+			wlr_scene_buffer_send_frame_done(buffer, &data->when);
+		} else {
+			output->stats.suppressed_frame_callbacks++;
+		}
+		return;
+	}
+
 	if (buffer->primary_output != data->output->scene_output) {
 		return;
 	}
 
 	struct wlr_scene_node *current = &buffer->node;
 	while (true) {
-		struct wsm_view *view = wsm_scene_descriptor_try_get(current,
-			WSM_SCENE_DESC_VIEW);
+		view = wsm_scene_descriptor_try_get(current, WSM_SCENE_DESC_VIEW);
 		if (view) {
-			view_max_render_time = view->max_render_time;
 			break;
 		}
 
@@ -184,28 +391,36 @@ static void send_frame_done_iterator(struct wlr_scene_buffer *buffer,
 		current = &current->parent->node;
 	}
 
-	int delay = data->msec_until_refresh - output->max_render_time
+	int view_max_render_time = view ? view->max_render_time : 0;
+	int output_render_time = output_max_render_time(output);
+	int delay = data->msec_until_refresh - output_render_time
 		- view_max_render_time;
 
-	struct buffer_timer *timer = NULL;
-
-	if (output->max_render_time != 0 && view_max_render_time != 0 && delay > 0) {
-		timer = buffer_timer_get_or_create(buffer);
+	if (output_render_time == 0 || view_max_render_time == 0 || delay <= 0) {
+		wlr_scene_buffer_send_frame_done(buffer, &data->when);
+		return;
 	}
 
-	if (timer) {
-		wl_event_source_timer_update(timer->frame_done_timer, delay);
-	} else {
-		wlr_scene_buffer_send_frame_done(buffer, &data->when);
+	// the whole view is served at once, its buffers are visited in a row
+	if (view != data->last_queued_view) {
+		frame_done_queue_push(output, view,
+			timespec_to_nsec(&data->when) + (int64_t)delay * 1000000);
+		data->last_queued_view = view;
 	}
 }
 
-static enum wlr_scale_filter_mode get_scale_filter(struct wsm_output *output,
-		struct wlr_scene_buffer *buffer) {
+static enum wlr_scale_filter_mode get_scale_filter(struct wlr_scene_buffer *buffer) {
 	if (buffer->dst_width > 0 && buffer->dst_height > 0) {
 		return WLR_SCALE_FILTER_BILINEAR;
 	}
 
+	// the filter follows the output the buffer is mostly displayed on
+	struct wsm_output *output = buffer->primary_output ?
+		buffer->primary_output->output->data : NULL;
+	if (!output) {
+		return buffer->filter_mode;
+	}
+
 	switch (output->scale_filter) {
 	case SCALE_FILTER_LINEAR:
 		return WLR_SCALE_FILTER_BILINEAR;
@@ -216,12 +431,12 @@ static enum wlr_scale_filter_mode get_scale_filter(struct wsm_output *output,
 	}
 }
 
-static void output_configure_scene(struct wsm_output *output,
-		struct wlr_scene_node *node, float opacity) {
+static size_t scene_configure_node(struct wlr_scene_node *node, float opacity) {
 	if (!node->enabled) {
-		return;
+		return 0;
 	}
 
+	size_t visited = 1;
 	struct wsm_container *con =
 		wsm_scene_descriptor_try_get(node, WSM_SCENE_DESC_CONTAINER);
 	if (con) {
@@ -230,15 +445,70 @@ static void output_configure_scene(struct wsm_output *output,
 
 	if (node->type == WLR_SCENE_NODE_BUFFER) {
 		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
-		buffer->filter_mode = get_scale_filter(output, buffer);
+		buffer->filter_mode = get_scale_filter(buffer);
 		wlr_scene_buffer_set_opacity(buffer, opacity);
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
 		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
 		struct wlr_scene_node *node;
 		wl_list_for_each(node, &tree->children, link) {
-			output_configure_scene(output, node, opacity);
+			visited += scene_configure_node(node, opacity);
+		}
+	}
+
+	return visited;
+}
+
+// the opacity of the closest container, as a walk from the root would give
+static float scene_node_opacity(struct wlr_scene_node *node) {
+	for (; node; node = node->parent ? &node->parent->node : NULL) {
+		struct wsm_container *con =
+			wsm_scene_descriptor_try_get(node, WSM_SCENE_DESC_CONTAINER);
+		if (con) {
+			return con->alpha;
+		}
+	}
+	return 1.0f;
+}
+
+/**
+ * Opacity and scale filter used to be pushed to every scene buffer on every
+ * repaint. Only subtrees which were marked dirty since the last repaint are
+ * visited now: the whole tree after a full arrange, output configuration or a
+ * surface map, otherwise just the queued containers and the buffers whose
+ * outputs or destination size changed.
+ */
+static size_t scene_configure_dirty(struct wsm_scene *root) {
+	size_t visited = 0;
+
+	if (root->config_dirty) {
+		visited = scene_configure_node(&root->root_scene->tree.node, 1.0f);
+	} else {
+		for (int i = 0; i < root->dirty_configs->length; ++i) {
+			struct wsm_container *con = root->dirty_configs->items[i];
+			visited += scene_configure_node(&con->scene_tree->node, 1.0f);
+			// a fullscreen view is reparented out of its container
+			if (con->view && con->view->scene_tree->node.parent != con->content_tree) {
+				visited += scene_configure_node(&con->view->scene_tree->node, 1.0f);
+			}
 		}
 	}
+
+	if (!root->config_dirty) {
+		for (int i = 0; i < root->dirty_buffers->length; ++i) {
+			struct wlr_scene_buffer *buffer = root->dirty_buffers->items[i];
+			visited += scene_configure_node(&buffer->node, scene_node_opacity(&buffer->node));
+		}
+	}
+
+	for (int i = 0; i < root->dirty_configs->length; ++i) {
+		struct wsm_container *con = root->dirty_configs->items[i];
+		con->config_dirty = false;
+	}
+	root->dirty_configs->length = 0;
+	root->dirty_buffers->length = 0;
+	root->config_dirty = false;
+
+	return visited;
 }
 
 static int output_repaint_timer_handler(void *data) {
@@ -249,13 +519,21 @@ static int output_repaint_timer_handler(void *data) {
 	}
 
 	output->wlr_output->frame_pending = false;
-
-	output_configure_scene(output, &global_server.scene->root_scene->tree.node, 1.0f);
+	output_collect_render_time(output);
+	struct wlr_scene_output_state_options options = {
+		.timer = &output->render_time.timer,
+	};
+
+	output->scene_nodes_visited = scene_configure_dirty(global_server.scene);
+	if (output->scene_nodes_visited > 0) {
+		wsm_log(WSM_DEBUG, "Configured %zu scene nodes for %s repaint",
+			output->scene_nodes_visited, output->wlr_output->name);
+	}
 
 	if (output->gamma_lut_changed) {
 		struct wlr_output_state pending;
 		wlr_output_state_init(&pending);
-		if (!wsm_scene_output_build_state(output->scene_output, &pending, NULL)) {
+		if (!wsm_scene_output_build_state(output->scene_output, &pending, &options)) {
 			return 0;
 		}
 
@@ -278,10 +556,30 @@ static int output_repaint_timer_handler(void *data) {
 		return 0;
 	}
 
-	wsm_scene_output_commit(output->scene_output, NULL);
+	wsm_scene_output_commit(output->scene_output, &options);
 	return 0;
 }
 
+/**
+ * Surfaces covered by opaque content keep getting frame callbacks, but only
+ * occluded_frame_rate times per second, so that they do not stall forever.
+ */
+static bool output_occluded_frame_done_due(struct wsm_output *output,
+		const struct timespec *now) {
+	if (global_config.occluded_frame_rate <= 0) {
+		return false;
+	}
+
+	struct timespec elapsed;
+	timespec_sub(&elapsed, now, &output->last_occluded_frame_done);
+	if (timespec_to_msec(&elapsed) < 1000 / global_config.occluded_frame_rate) {
+		return false;
+	}
+
+	output->last_occluded_frame_done = *now;
+	return true;
+}
+
 static void handle_frame(struct wl_listener *listener, void *user_data) {
 	struct wsm_output *output =
 		wl_container_of(listener, output, frame);
@@ -290,8 +588,9 @@ static void handle_frame(struct wl_listener *listener, void *user_data) {
 	}
 
 	int msec_until_refresh = 0;
+	int max_render_time = output_max_render_time(output);
 
-	if (output->max_render_time != 0) {
+	if (max_render_time != 0 && output->refresh_nsec != 0) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
 
@@ -312,7 +611,7 @@ static void handle_frame(struct wl_listener *listener, void *user_data) {
 		}
 	}
 
-	int delay = msec_until_refresh - output->max_render_time;
+	int delay = msec_until_refresh - max_render_time;
 
 	if (delay < 1) {
 		output_repaint_timer_handler(output);
@@ -325,7 +624,9 @@ static void handle_frame(struct wl_listener *listener, void *user_data) {
 	clock_gettime(CLOCK_MONOTONIC, &data.when);
 	data.msec_until_refresh = msec_until_refresh;
 	data.output = output;
+	data.occluded_due = output_occluded_frame_done_due(output, &data.when);
 	wlr_scene_output_for_each_buffer(output->scene_output, send_frame_done_iterator, &data);
+	frame_done_queue_arm(output);
 }
 
 static void handle_request_state(struct wl_listener *listener, void *data) {
@@ -440,6 +741,10 @@ struct wsm_output *wsm_ouput_create(struct wlr_output *wlr_output) {
 
 	output->repaint_timer = wl_event_loop_add_timer(global_server.wl_event_loop,
 		output_repaint_timer_handler, output);
+	output->frame_done_timer = wl_event_loop_add_timer(global_server.wl_event_loop,
+		handle_frame_done_timer, output);
+	wl_array_init(&output->frame_done_queue);
+	wsm_content_policy_init(output);
 
 	return output;
 
@@ -468,6 +773,9 @@ void wsm_output_destroy(struct wsm_output *output) {
 	list_free(output->workspaces);
 	list_free(output->current.workspaces);
 	wl_event_source_remove(output->repaint_timer);
+	wl_event_source_remove(output->frame_done_timer);
+	wl_array_release(&output->frame_done_queue);
+	wsm_content_policy_finish(output);
 	free(output);
 }
 
@@ -597,6 +905,7 @@ void output_disable(struct wsm_output *output) {
 	output_evacuate(output);
 
 	list_del(global_server.scene->outputs, index);
+	frame_done_queue_clear(output);
 
 	output->enabled = false;
 
@@ -1,15 +1,25 @@
 #ifndef WSM_OUTPUT_H
 #define WSM_OUTPUT_H
 
+#include "wsm_stats.h"
+#include "wsm_content_policy.h"
 #include "node/wsm_node.h"
 
 #include <bits/types/struct_timespec.h>
 
 #include <wayland-server-core.h>
 
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_damage_ring.h>
+#include <wlr/types/wlr_output_layer.h>
 #include <wlr/types/wlr_output_layout.h>
 
+#define WSM_OUTPUT_PLANES_MAX 3
+
+/* max_render_time learned from the measured render durations */
+#define WSM_MAX_RENDER_TIME_AUTO -2
+#define WSM_RENDER_TIME_SAMPLES 64
+
 struct udev_device;
 
 struct wlr_output;
@@ -19,6 +29,7 @@ struct wlr_scene_output;
 struct wlr_drm_connector;
 struct wlr_output_power_v1_set_mode_event;
 
+struct wsm_view;
 struct wsm_workspace;
 struct wsm_workspace_manager;
 
@@ -29,6 +40,14 @@ enum scale_filter_mode {
 	SCALE_FILTER_SMART,
 };
 
+/**
+ * @brief frame callbacks of a view, due at deadline_nsec on CLOCK_MONOTONIC
+ */
+struct wsm_frame_done_deadline {
+	int64_t deadline_nsec;
+	struct wsm_view *view;
+};
+
 struct wsm_output_state {
 	struct wsm_list *workspaces;
 	struct wsm_workspace *active_workspace;
@@ -69,6 +88,7 @@ struct wsm_output {
 	} events;
 
 	struct timespec last_presentation;
+	struct timespec last_occluded_frame_done;
 	struct wsm_list *workspaces;
 
 	struct wlr_scene_rect *fullscreen_background;
@@ -80,8 +100,56 @@ struct wsm_output {
 
 	struct wl_event_source *repaint_timer;
 
+	/* delayed frame callbacks, min-heap of wsm_frame_done_deadline */
+	struct wl_array frame_done_queue;
+	struct wl_event_source *frame_done_timer;
+	int64_t frame_done_armed_nsec; // deadline the timer waits for, 0 when idle
+
+	/**
+	 * Overlay planes (wlroots output layers) used to offload client buffers
+	 * from compositing. plane_states is handed to the pending output state
+	 * and must outlive the commit, lowest plane first.
+	 */
+	struct wlr_output_layer *planes[WSM_OUTPUT_PLANES_MAX];
+	struct wlr_output_layer_state plane_states[WSM_OUTPUT_PLANES_MAX];
+	struct wlr_scene_node *plane_nodes[WSM_OUTPUT_PLANES_MAX]; // currently lit
+	struct wlr_scene_node *plane_failed_nodes[WSM_OUTPUT_PLANES_MAX];
+	struct wlr_box plane_boxes[WSM_OUTPUT_PLANES_MAX]; // buffer coordinates
+	int planes_len;
+	int plane_failed_len;
+	int plane_failed_frames; // since the failed set was recorded
+
+	/* render list cached across frames, see wsm_scene_output_build_state() */
+	struct wl_array render_list;
+	struct wlr_box render_list_box;
+	float render_list_scale;
+	uint64_t render_list_generation;
+	bool render_list_valid;
+	bool render_list_tracked;
+
+	/* background layer nodes as of the last frame with effects */
+	struct wl_array backdrop_nodes;
+	struct wlr_box backdrop_box;
+	float backdrop_scale;
+
+	/**
+	 * CPU pre-render plus GPU render durations of the last repaints, the
+	 * timer of a repaint is read back at the next one. estimate_msec is a
+	 * high percentile of the samples, 0 until enough are known.
+	 */
+	struct {
+		struct wlr_scene_timer timer;
+		int64_t samples[WSM_RENDER_TIME_SAMPLES]; // In nanoseconds
+		size_t samples_len;
+		size_t next_sample;
+		int estimate_msec;
+	} render_time;
+	struct wsm_output_stats stats;
+	struct wsm_content_policy content_policy;
+
 	uint32_t refresh_nsec;
-	int max_render_time; // In milliseconds
+	size_t scene_nodes_visited; // by the scene configuration of the last repaint
+	int max_render_time; // In milliseconds, or WSM_MAX_RENDER_TIME_AUTO
 	int lx, ly; // layout coords
 	int width, height; // transformed buffer size
 	enum wl_output_subpixel detected_subpixel;
@@ -114,6 +182,11 @@ void wsm_output_damage_surface(struct wsm_output *output, double ox, double oy,
 	struct wlr_surface *surface, bool whole);
 void wsm_output_damage_box(struct wsm_output *output, struct wlr_box *box);
 struct wlr_box wsm_output_usable_area_in_layout_coords(struct wsm_output *output);
+/**
+ * @brief wsm_output_frame_done_cancel_view drop the delayed frame callbacks
+ * of a view, before it goes away
+ */
+void wsm_output_frame_done_cancel_view(struct wsm_view *view);
 struct wlr_box wsm_output_usable_area_scaled(struct wsm_output *output);
 void wsm_output_set_enable_adaptive_sync(struct wlr_output *output, bool enabled);
 
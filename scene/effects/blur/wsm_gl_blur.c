@@ -21,3 +21,197 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#include "wsm_gl_blur.h"
+#include "wsm_gl_blur_base.h"
+#include "wsm_log.h"
+#include "wsm_config.h"
+#include "wsm_server.h"
+#include "effects/wsm_effect.h"
+#include "effects/wsm_effects_manager.h"
+
+#include <stdlib.h>
+
+#include <wlr/util/addon.h>
+#include <wlr/util/region.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/gles2.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_output.h>
+
+/**
+ * Per output blur of the background layers, kept across frames and only
+ * recomputed where the backdrop changed.
+ */
+struct blur_output {
+	struct wlr_addon addon; // wlr_output.addons
+	struct wsm_blur_buffers buffers;
+	pixman_region32_t dirty; // down[0] out of date, buffer coordinates
+	struct wlr_texture *result;
+	uint32_t commit_seq;
+};
+
+static void blur_output_destroy(struct blur_output *blur) {
+	wlr_addon_finish(&blur->addon);
+	wsm_blur_buffers_finish(&blur->buffers);
+	pixman_region32_fini(&blur->dirty);
+	free(blur);
+}
+
+static void blur_output_addon_destroy(struct wlr_addon *addon) {
+	struct blur_output *blur = wl_container_of(addon, blur, addon);
+	blur_output_destroy(blur);
+}
+
+static const struct wlr_addon_interface blur_output_addon_impl = {
+	.name = "wsm_gl_blur_output",
+	.destroy = blur_output_addon_destroy,
+};
+
+static struct blur_output *blur_output_get(struct wlr_output *output) {
+	struct wlr_addon *addon =
+		wlr_addon_find(&output->addons, NULL, &blur_output_addon_impl);
+	if (addon) {
+		struct blur_output *blur = wl_container_of(addon, blur, addon);
+		return blur;
+	}
+
+	struct blur_output *blur = calloc(1, sizeof(struct blur_output));
+	if (!blur) {
+		wsm_log(WSM_ERROR, "Could not create blur_output: allocation failed!");
+		return NULL;
+	}
+
+	pixman_region32_init(&blur->dirty);
+	blur->commit_seq = output->commit_seq;
+	wlr_addon_init(&blur->addon, &output->addons, NULL, &blur_output_addon_impl);
+	return blur;
+}
+
+static void blur_pre_render_output(struct wsm_effect *effect,
+		struct wsm_effect_output_data *data) {
+	struct wlr_output *output = data->scene_output->output;
+	struct blur_output *blur = blur_output_get(output);
+	if (!blur) {
+		return;
+	}
+
+	// A frame went by without us (direct scan-out), its damage is unknown
+	if (blur->commit_seq != output->commit_seq) {
+		pixman_region32_union_rect(&blur->dirty, &blur->dirty,
+			0, 0, data->width, data->height);
+	}
+	blur->commit_seq = output->commit_seq + 1;
+	pixman_region32_union(&blur->dirty, &blur->dirty, data->backdrop_damage);
+
+	blur->result = NULL;
+	if (!(data->features & WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BLUR))) {
+		return;
+	}
+
+	int passes = global_config.blur_passes;
+	float offset = global_config.blur_offset;
+	if (blur->buffers.passes == 0 || blur->buffers.width != data->width ||
+			blur->buffers.height != data->height ||
+			blur->buffers.passes != passes) {
+		wsm_blur_buffers_finish(&blur->buffers);
+		if (!wsm_blur_buffers_init(&blur->buffers, data->renderer,
+				global_server.wlr_allocator, data->width, data->height, passes)) {
+			return;
+		}
+		pixman_region32_union_rect(&blur->dirty, &blur->dirty,
+			0, 0, data->width, data->height);
+	}
+
+	if (pixman_region32_not_empty(&blur->dirty)) {
+		pixman_region32_intersect_rect(&blur->dirty, &blur->dirty,
+			0, 0, data->width, data->height);
+
+		struct wlr_render_pass *pass = wlr_renderer_begin_buffer_pass(data->renderer,
+			blur->buffers.down[0].buffer, NULL);
+		if (!pass) {
+			return;
+		}
+		wlr_render_pass_add_rect(pass, &(struct wlr_render_rect_options){
+			.box = { .width = data->width, .height = data->height },
+			.color = { .r = 0, .g = 0, .b = 0, .a = 1 },
+			.clip = &blur->dirty,
+			.blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+		});
+		data->render_backdrop(data, pass, &blur->dirty);
+		if (!wlr_render_pass_submit(pass)) {
+			wsm_log(WSM_ERROR, "Could not render the blur backdrop");
+			return;
+		}
+
+		wsm_blur_render(&blur->buffers, data->renderer, &blur->dirty, offset);
+
+		// The blurred windows must be redrawn wherever the blur changed
+		pixman_region32_t damage;
+		pixman_region32_init(&damage);
+		wlr_region_expand(&damage, &blur->dirty, wsm_blur_expand_size(passes, offset));
+		pixman_region32_intersect(&damage, &damage, data->blur_region);
+		wlr_damage_ring_add(&data->scene_output->damage_ring, &damage);
+		pixman_region32_fini(&damage);
+
+		pixman_region32_clear(&blur->dirty);
+	}
+
+	blur->result = passes == 1 ?
+		blur->buffers.down[1].texture : blur->buffers.up[1].texture;
+}
+
+static void blur_pre_render_window(struct wsm_effect *effect,
+		struct wsm_effect_window_data *data) {
+	struct blur_output *blur = blur_output_get(data->output->scene_output->output);
+	if (!blur || !blur->result || !pixman_region32_not_empty(data->clip)) {
+		return;
+	}
+
+	const struct wsm_surface_effect_state *state = &data->surface_effect->current;
+	pixman_region32_t clip;
+	pixman_region32_init(&clip);
+	if (state->full_blur) {
+		pixman_region32_copy(&clip, data->clip);
+	} else {
+		pixman_region32_copy(&clip, &state->blur_region);
+		wlr_region_scale(&clip, &clip, data->output->scale);
+		pixman_region32_translate(&clip, data->dst_box.x, data->dst_box.y);
+		pixman_region32_intersect(&clip, &clip, data->clip);
+	}
+
+	if (pixman_region32_not_empty(&clip)) {
+		wlr_render_pass_add_texture(data->output->render_pass,
+			&(struct wlr_render_texture_options){
+				.texture = blur->result,
+				.dst_box = { .width = data->output->width, .height = data->output->height },
+				.clip = &clip,
+				.filter_mode = WLR_SCALE_FILTER_BILINEAR,
+				.blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+			});
+	}
+	pixman_region32_fini(&clip);
+}
+
+static bool blur_is_supported(struct wlr_renderer *renderer) {
+	// Every tap is a textured draw, too slow without a GPU
+	return wlr_renderer_is_gles2(renderer);
+}
+
+static const struct wsm_effect_impl blur_impl = {
+	.features = WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BLUR),
+	.pre_render_output = blur_pre_render_output,
+	.pre_render_window = blur_pre_render_window,
+	.is_supported = blur_is_supported,
+};
+
+struct wsm_effect *wsm_gl_blur_create(void) {
+	struct wsm_effect *effect = calloc(1, sizeof(struct wsm_effect));
+	if (!effect) {
+		wsm_log(WSM_ERROR, "Could not create wsm_gl_blur: allocation failed!");
+		return NULL;
+	}
+
+	wsm_effect_init(effect, &blur_impl);
+	return effect;
+}
@@ -21,3 +21,16 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#ifndef WSM_GL_BLUR_H
+#define WSM_GL_BLUR_H
+
+struct wsm_effect;
+
+/**
+ * @brief wsm_gl_blur_create blur of the output background layers shown
+ * through windows asking for it.
+ */
+struct wsm_effect *wsm_gl_blur_create(void);
+
+#endif
@@ -21,3 +21,233 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#include "wsm_gl_blur_base.h"
+#include "wsm_log.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include <wlr/util/box.h>
+#include <wlr/util/region.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_buffer.h>
+
+struct blur_tap {
+	float x, y; // in units of the blur offset
+	float weight;
+};
+
+/* center sample plus the four diagonals, at the source resolution */
+static const struct blur_tap down_taps[] = {
+	{ 0, 0, 4 },
+	{ -1, -1, 1 }, { 1, -1, 1 }, { -1, 1, 1 }, { 1, 1, 1 },
+};
+
+static const struct blur_tap up_taps[] = {
+	{ -1, -1, 2 }, { 1, -1, 2 }, { -1, 1, 2 }, { 1, 1, 2 },
+	{ -2, 0, 1 }, { 2, 0, 1 }, { 0, -2, 1 }, { 0, 2, 1 },
+};
+
+static bool blur_level_init(struct wsm_blur_level *level,
+		struct wlr_renderer *renderer, struct wlr_allocator *allocator,
+		const struct wlr_drm_format *format, int width, int height) {
+	level->width = width > 0 ? width : 1;
+	level->height = height > 0 ? height : 1;
+	level->buffer = wlr_allocator_create_buffer(allocator,
+		level->width, level->height, format);
+	if (!level->buffer) {
+		return false;
+	}
+
+	level->texture = wlr_texture_from_buffer(renderer, level->buffer);
+	return level->texture != NULL;
+}
+
+static void blur_level_finish(struct wsm_blur_level *level) {
+	if (level->texture) {
+		wlr_texture_destroy(level->texture);
+	}
+	if (level->buffer) {
+		wlr_buffer_drop(level->buffer);
+	}
+	memset(level, 0, sizeof(*level));
+}
+
+bool wsm_blur_buffers_init(struct wsm_blur_buffers *buffers,
+		struct wlr_renderer *renderer, struct wlr_allocator *allocator,
+		int width, int height, int passes) {
+	memset(buffers, 0, sizeof(*buffers));
+	if (passes < 1) {
+		passes = 1;
+	} else if (passes > WSM_BLUR_PASSES_MAX) {
+		passes = WSM_BLUR_PASSES_MAX;
+	}
+
+	const struct wlr_drm_format_set *formats =
+		wlr_renderer_get_render_formats(renderer);
+	const struct wlr_drm_format *format = NULL;
+	if (formats) {
+		format = wlr_drm_format_set_get(formats, DRM_FORMAT_XRGB8888);
+		if (!format) {
+			format = wlr_drm_format_set_get(formats, DRM_FORMAT_ARGB8888);
+		}
+	}
+	if (!format) {
+		wsm_log(WSM_ERROR, "No render format usable for blur buffers");
+		return false;
+	}
+
+	buffers->passes = passes;
+	buffers->width = width;
+	buffers->height = height;
+	for (int i = 0; i <= passes; i++) {
+		if (!blur_level_init(&buffers->down[i], renderer, allocator, format,
+				width >> i, height >> i)) {
+			goto error;
+		}
+		// up[0] and up[passes] are never rendered to
+		if (i > 0 && i < passes && !blur_level_init(&buffers->up[i], renderer,
+				allocator, format, width >> i, height >> i)) {
+			goto error;
+		}
+	}
+	return true;
+
+error:
+	wsm_log(WSM_ERROR, "Could not create blur buffers of %dx%d", width, height);
+	wsm_blur_buffers_finish(buffers);
+	return false;
+}
+
+void wsm_blur_buffers_finish(struct wsm_blur_buffers *buffers) {
+	for (int i = 0; i <= WSM_BLUR_PASSES_MAX; i++) {
+		blur_level_finish(&buffers->down[i]);
+		blur_level_finish(&buffers->up[i]);
+	}
+	buffers->passes = 0;
+}
+
+int wsm_blur_expand_size(int passes, float offset) {
+	float size = 0;
+	for (int i = 1; i <= passes; i++) {
+		// down sampling into level i reads level i - 1
+		size += offset * (1 << (i - 1));
+		// up sampling out of level i reads twice as far
+		if (i > 1) {
+			size += 2 * offset * (1 << i);
+		}
+	}
+	// bilinear filtering of the half resolution result
+	return (int)ceilf(size) + 2;
+}
+
+static void blur_level_damage(pixman_region32_t *dst, const pixman_region32_t *damage,
+		const struct wsm_blur_buffers *buffers, const struct wsm_blur_level *level) {
+	wlr_region_scale_xy(dst, damage, (float)level->width / buffers->width,
+		(float)level->height / buffers->height);
+	wlr_region_expand(dst, dst, 1);
+	pixman_region32_intersect_rect(dst, dst, 0, 0, level->width, level->height);
+}
+
+/**
+ * Weighted sum of the taps drawn one after the other: blending tap k over
+ * the previous ones with alpha w_k / (w_0 + ... + w_k) keeps the result
+ * normalized, no custom shader needed.
+ */
+static void blur_pass(struct wlr_renderer *renderer, const struct wsm_blur_level *src,
+		const struct wsm_blur_level *dst, const struct blur_tap *taps, size_t taps_len,
+		float offset, const pixman_region32_t *clip) {
+	struct wlr_render_pass *pass =
+		wlr_renderer_begin_buffer_pass(renderer, dst->buffer, NULL);
+	if (!pass) {
+		return;
+	}
+
+	float kx = (float)dst->width / src->width;
+	float ky = (float)dst->height / src->height;
+	float weight = 0;
+	for (size_t i = 0; i < taps_len; i++) {
+		const struct blur_tap *tap = &taps[i];
+		weight += tap->weight;
+		float alpha = tap->weight / weight;
+		float dx = tap->x * offset, dy = tap->y * offset;
+
+		// stay inside of the source texture, the borders miss this tap
+		int margin = (int)ceilf(fmaxf(fabsf(dx), fabsf(dy)));
+		int dst_mx = (int)roundf(margin * kx), dst_my = (int)roundf(margin * ky);
+		struct wlr_fbox src_box = {
+			.x = margin + dx,
+			.y = margin + dy,
+			.width = src->width - 2 * margin,
+			.height = src->height - 2 * margin,
+		};
+		struct wlr_box dst_box = {
+			.x = dst_mx,
+			.y = dst_my,
+			.width = dst->width - 2 * dst_mx,
+			.height = dst->height - 2 * dst_my,
+		};
+		if (wlr_fbox_empty(&src_box) || wlr_box_empty(&dst_box)) {
+			continue;
+		}
+
+		wlr_render_pass_add_texture(pass, &(struct wlr_render_texture_options){
+			.texture = src->texture,
+			.src_box = src_box,
+			.dst_box = dst_box,
+			.alpha = &alpha,
+			.clip = clip,
+			.filter_mode = WLR_SCALE_FILTER_BILINEAR,
+			.blend_mode = i == 0 ?
+				WLR_RENDER_BLEND_MODE_NONE : WLR_RENDER_BLEND_MODE_PREMULTIPLIED,
+		});
+	}
+
+	if (!wlr_render_pass_submit(pass)) {
+		wsm_log(WSM_ERROR, "Could not submit blur pass");
+	}
+}
+
+struct wlr_texture *wsm_blur_render(struct wsm_blur_buffers *buffers,
+		struct wlr_renderer *renderer, const pixman_region32_t *damage, float offset) {
+	int passes = buffers->passes;
+	if (passes == 0) {
+		return NULL;
+	}
+
+	pixman_region32_t affected, clip;
+	pixman_region32_init(&affected);
+	pixman_region32_init(&clip);
+	wlr_region_expand(&affected, damage, wsm_blur_expand_size(passes, offset));
+
+	for (int i = 1; i <= passes; i++) {
+		struct wsm_blur_level *dst = &buffers->down[i];
+		blur_level_damage(&clip, &affected, buffers, dst);
+		if (pixman_region32_not_empty(&clip)) {
+			blur_pass(renderer, &buffers->down[i - 1], dst, down_taps,
+				sizeof(down_taps) / sizeof(down_taps[0]), offset, &clip);
+		}
+	}
+
+	for (int i = passes; i > 1; i--) {
+		struct wsm_blur_level *src = i == passes ? &buffers->down[i] : &buffers->up[i];
+		struct wsm_blur_level *dst = &buffers->up[i - 1];
+		blur_level_damage(&clip, &affected, buffers, dst);
+		if (pixman_region32_not_empty(&clip)) {
+			blur_pass(renderer, src, dst, up_taps,
+				sizeof(up_taps) / sizeof(up_taps[0]), offset, &clip);
+		}
+	}
+
+	pixman_region32_fini(&clip);
+	pixman_region32_fini(&affected);
+
+	return passes == 1 ? buffers->down[1].texture : buffers->up[1].texture;
+}
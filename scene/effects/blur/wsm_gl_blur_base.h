@@ -21,3 +21,53 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#ifndef WSM_GL_BLUR_BASE_H
+#define WSM_GL_BLUR_BASE_H
+
+#include <stdbool.h>
+
+#include <pixman.h>
+
+#define WSM_BLUR_PASSES_MAX 8
+
+struct wlr_buffer;
+struct wlr_texture;
+struct wlr_renderer;
+struct wlr_allocator;
+
+struct wsm_blur_level {
+	struct wlr_buffer *buffer;
+	struct wlr_texture *texture;
+	int width, height;
+};
+
+/**
+ * @brief dual kawase blur chain, down[0] holds the full resolution source
+ * and is rendered by the caller.
+ */
+struct wsm_blur_buffers {
+	struct wsm_blur_level down[WSM_BLUR_PASSES_MAX + 1];
+	struct wsm_blur_level up[WSM_BLUR_PASSES_MAX + 1];
+	int passes;
+	int width, height;
+};
+
+bool wsm_blur_buffers_init(struct wsm_blur_buffers *buffers,
+	struct wlr_renderer *renderer, struct wlr_allocator *allocator,
+	int width, int height, int passes);
+void wsm_blur_buffers_finish(struct wsm_blur_buffers *buffers);
+/**
+ * @brief wsm_blur_expand_size how far a change of the source spreads into
+ * the blurred result, in source pixels.
+ */
+int wsm_blur_expand_size(int passes, float offset);
+/**
+ * @brief wsm_blur_render blur down[0] into the returned texture, at half of
+ * the source resolution. Only the part influenced by damage (source
+ * coordinates) is recomputed, the rest is kept from the previous call.
+ */
+struct wlr_texture *wsm_blur_render(struct wsm_blur_buffers *buffers,
+	struct wlr_renderer *renderer, const pixman_region32_t *damage, float offset);
+
+#endif
@@ -0,0 +1,106 @@
+#include "wsm_gl_scissors.h"
+#include "wsm_gl_scissors_base.h"
+#include "wsm_log.h"
+#include "effects/wsm_effect.h"
+#include "effects/wsm_effects_manager.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <wlr/util/region.h>
+#include <wlr/render/pass.h>
+
+static void window_region_to_buffer(pixman_region32_t *region,
+		const struct wsm_effect_window_data *data) {
+	wlr_region_scale(region, region, data->output->scale);
+	pixman_region32_translate(region, data->dst_box.x, data->dst_box.y);
+}
+
+static void scissors_pre_render_window(struct wsm_effect *effect,
+		struct wsm_effect_window_data *data) {
+	if (!(data->features & WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_RADIUS))) {
+		return;
+	}
+
+	const struct wsm_surface_effect_state *state = &data->surface_effect->current;
+	if (state->clip) {
+		pixman_region32_t clip;
+		pixman_region32_init(&clip);
+		pixman_region32_copy(&clip, &state->clip_region);
+		window_region_to_buffer(&clip, data);
+		pixman_region32_intersect(data->clip, data->clip, &clip);
+		pixman_region32_fini(&clip);
+	}
+
+	if (state->corner_radius > 0) {
+		pixman_region32_t rounded;
+		pixman_region32_init(&rounded);
+		wsm_scissors_rounded_region(&rounded, &data->dst_box,
+			state->corner_radius * data->output->scale, state->corner_flags);
+		pixman_region32_intersect(data->clip, data->clip, &rounded);
+		pixman_region32_fini(&rounded);
+	}
+}
+
+static void scissors_post_render_window(struct wsm_effect *effect,
+		struct wsm_effect_window_data *data) {
+	if (!(data->features & WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BORDER)) ||
+			!pixman_region32_not_empty(data->clip)) {
+		return;
+	}
+
+	const struct wsm_surface_effect_state *state = &data->surface_effect->current;
+	const struct wlr_box *box = &data->dst_box;
+	int width = (int)ceilf(state->border_width * data->output->scale);
+	width = width * 2 > box->width ? box->width / 2 : width;
+	width = width * 2 > box->height ? box->height / 2 : width;
+	if (width <= 0) {
+		return;
+	}
+
+	// Drawn inside of the window, so no damage beyond the window is needed
+	struct wlr_box edges[] = {
+		{ box->x, box->y, box->width, width },
+		{ box->x, box->y + box->height - width, box->width, width },
+		{ box->x, box->y + width, width, box->height - 2 * width },
+		{ box->x + box->width - width, box->y + width, width, box->height - 2 * width },
+	};
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+		wlr_render_pass_add_rect(data->output->render_pass, &(struct wlr_render_rect_options){
+			.box = edges[i],
+			.color = {
+				.r = state->border_color[0],
+				.g = state->border_color[1],
+				.b = state->border_color[2],
+				.a = state->border_color[3],
+			},
+			.clip = data->clip,
+			.blend_mode = state->border_color[3] < 1 ?
+				WLR_RENDER_BLEND_MODE_PREMULTIPLIED : WLR_RENDER_BLEND_MODE_NONE,
+		});
+	}
+}
+
+static bool scissors_is_supported(struct wlr_renderer *renderer) {
+	// Only clip regions and rects, every renderer can do that
+	return true;
+}
+
+static const struct wsm_effect_impl scissors_impl = {
+	.features = WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_RADIUS) |
+		WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BORDER),
+	.pre_render_window = scissors_pre_render_window,
+	.post_render_window = scissors_post_render_window,
+	.is_supported = scissors_is_supported,
+};
+
+struct wsm_effect *wsm_gl_scissors_create(void) {
+	struct wsm_effect *effect = calloc(1, sizeof(struct wsm_effect));
+	if (!effect) {
+		wsm_log(WSM_ERROR, "Could not create wsm_gl_scissors: allocation failed!");
+		return NULL;
+	}
+
+	wsm_effect_init(effect, &scissors_impl);
+	return effect;
+}
@@ -0,0 +1,12 @@
+#ifndef WSM_GL_SCISSORS_H
+#define WSM_GL_SCISSORS_H
+
+struct wsm_effect;
+
+/**
+ * @brief wsm_gl_scissors_create rounded corners, clip region and border of
+ * windows, done by narrowing the region the window is drawn in.
+ */
+struct wsm_effect *wsm_gl_scissors_create(void);
+
+#endif
@@ -21,3 +21,76 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#include "wsm_gl_scissors_base.h"
+#include "wsm-effects-protocol.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <wlr/util/box.h>
+
+void wsm_scissors_rounded_region(pixman_region32_t *region,
+		const struct wlr_box *box, float radius, uint32_t corner_flags) {
+	pixman_region32_clear(region);
+	if (wlr_box_empty(box)) {
+		return;
+	}
+
+	bool top = corner_flags == 0 ||
+		(corner_flags & (SURFACE_EFFECT_ROUNDED_CORNERS_FLAG_UP |
+		SURFACE_EFFECT_ROUNDED_CORNERS_FLAG_ROUNDED));
+	bool bottom = corner_flags == 0 ||
+		(corner_flags & (SURFACE_EFFECT_ROUNDED_CORNERS_FLAG_DOWN |
+		SURFACE_EFFECT_ROUNDED_CORNERS_FLAG_ROUNDED));
+
+	int r = (int)ceilf(radius);
+	r = r > box->width / 2 ? box->width / 2 : r;
+	r = r > box->height / 2 ? box->height / 2 : r;
+	if (r <= 0 || (!top && !bottom)) {
+		pixman_region32_init_rect(region, box->x, box->y, box->width, box->height);
+		return;
+	}
+
+	int n_rects = 1 + (top ? r : 0) + (bottom ? r : 0);
+	pixman_box32_t *rects = calloc(n_rects, sizeof(pixman_box32_t));
+	if (!rects) {
+		pixman_region32_init_rect(region, box->x, box->y, box->width, box->height);
+		return;
+	}
+
+	int n = 0;
+	int body_y1 = box->y + (top ? r : 0);
+	int body_y2 = box->y + box->height - (bottom ? r : 0);
+	for (int row = 0; row < r; row++) {
+		// horizontal inset of the circle at the center of this scanline
+		float dy = r - row - 0.5f;
+		int inset = (int)roundf(r - sqrtf(r * r - dy * dy));
+		if (top) {
+			rects[n++] = (pixman_box32_t){
+				.x1 = box->x + inset,
+				.y1 = box->y + row,
+				.x2 = box->x + box->width - inset,
+				.y2 = box->y + row + 1,
+			};
+		}
+		if (bottom) {
+			rects[n++] = (pixman_box32_t){
+				.x1 = box->x + inset,
+				.y1 = box->y + box->height - row - 1,
+				.x2 = box->x + box->width - inset,
+				.y2 = box->y + box->height - row,
+			};
+		}
+	}
+	rects[n++] = (pixman_box32_t){
+		.x1 = box->x,
+		.y1 = body_y1,
+		.x2 = box->x + box->width,
+		.y2 = body_y2,
+	};
+
+	pixman_region32_fini(region);
+	pixman_region32_init_rects(region, rects, n);
+	free(rects);
+}
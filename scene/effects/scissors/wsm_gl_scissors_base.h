@@ -21,3 +21,23 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
+
+#ifndef WSM_GL_SCISSORS_BASE_H
+#define WSM_GL_SCISSORS_BASE_H
+
+#include <stdint.h>
+
+#include <pixman.h>
+
+struct wlr_box;
+
+/**
+ * @brief wsm_scissors_rounded_region build the region of box with its corners
+ * cut to radius, one rectangle per scanline in the corner rows.
+ * @param corner_flags enum surface_effect_rounded_corners_flag, 0 rounds
+ * every corner
+ */
+void wsm_scissors_rounded_region(pixman_region32_t *region,
+	const struct wlr_box *box, float radius, uint32_t corner_flags);
+
+#endif
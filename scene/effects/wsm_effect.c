@@ -1 +1,164 @@
 #include "wsm_effect.h"
+#include "wsm_log.h"
+#include "wsm_effects_manager.h"
+#include "blur/wsm_gl_blur.h"
+#include "scissors/wsm_gl_scissors.h"
+
+#include <stdlib.h>
+
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_compositor.h>
+
+static struct {
+	struct wl_list effects; // wsm_effect.link
+	bool initialized;
+} wsm_effects;
+
+void wsm_effect_init(struct wsm_effect *effect, const struct wsm_effect_impl *impl) {
+	effect->impl = impl;
+	wl_list_init(&effect->link);
+}
+
+void wsm_effect_destroy(struct wsm_effect* effect) {
+	if (!effect) {
+		return;
+	}
+
+	wl_list_remove(&effect->link);
+	if (effect->impl->destroy) {
+		effect->impl->destroy(effect);
+	} else {
+		free(effect);
+	}
+}
+
+bool wsm_effect_provides_feature (struct wsm_effect *effect,
+		enum wsm_effect_feature feature) {
+	return effect->impl->features & WSM_EFFECT_FEATURE_BIT(feature);
+}
+
+static void effects_add(struct wsm_effect *effect, struct wlr_renderer *renderer) {
+	if (!effect) {
+		return;
+	}
+
+	if (effect->impl->is_supported && !effect->impl->is_supported(renderer)) {
+		wsm_effect_destroy(effect);
+		return;
+	}
+
+	wl_list_insert(wsm_effects.effects.prev, &effect->link);
+}
+
+void wsm_effects_init(struct wlr_renderer *renderer) {
+	if (wsm_effects.initialized) {
+		return;
+	}
+
+	wl_list_init(&wsm_effects.effects);
+	wsm_effects.initialized = true;
+
+	// Order matters, the scissors narrow what the blur is drawn into
+	effects_add(wsm_gl_scissors_create(), renderer);
+	effects_add(wsm_gl_blur_create(), renderer);
+}
+
+void wsm_effects_finish(void) {
+	if (!wsm_effects.initialized) {
+		return;
+	}
+
+	struct wsm_effect *effect, *tmp;
+	wl_list_for_each_safe(effect, tmp, &wsm_effects.effects, link) {
+		wsm_effect_destroy(effect);
+	}
+	wsm_effects.initialized = false;
+}
+
+uint32_t wsm_effects_window_features(struct wlr_scene_buffer *scene_buffer,
+		struct wsm_surface_effect **surface_effect) {
+	if (surface_effect) {
+		*surface_effect = NULL;
+	}
+
+	if (!wsm_effects.initialized || wl_list_empty(&wsm_effects.effects)) {
+		return 0;
+	}
+
+	struct wlr_scene_surface *scene_surface =
+		wlr_scene_surface_try_from_buffer(scene_buffer);
+	if (!scene_surface) {
+		return 0;
+	}
+
+	struct wsm_surface_effect *effect =
+		wsm_surface_effect_from_wlr_surface(scene_surface->surface);
+	if (!effect) {
+		return 0;
+	}
+
+	if (surface_effect) {
+		*surface_effect = effect;
+	}
+
+	const struct wsm_surface_effect_state *state = &effect->current;
+	uint32_t features = 0;
+	if (state->blur) {
+		features |= WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BLUR);
+	}
+	if (state->corner_radius > 0 || state->clip) {
+		features |= WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_RADIUS);
+	}
+	if (state->border_width > 0 && state->border_color[3] > 0) {
+		features |= WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BORDER);
+	}
+	return features;
+}
+
+#define EFFECTS_DISPATCH(hook, data) \
+	do { \
+		if (!wsm_effects.initialized || !(data)->features) { \
+			break; \
+		} \
+		struct wsm_effect *effect; \
+		wl_list_for_each(effect, &wsm_effects.effects, link) { \
+			if (effect->impl->hook && \
+					(effect->impl->features & (data)->features)) { \
+				effect->impl->hook(effect, data); \
+			} \
+		} \
+	} while (0)
+
+void wsm_effects_pre_render_output(struct wsm_effect_output_data *data) {
+	// Called on every composited frame, effects keep their caches in sync
+	if (!wsm_effects.initialized) {
+		return;
+	}
+
+	struct wsm_effect *effect;
+	wl_list_for_each(effect, &wsm_effects.effects, link) {
+		if (effect->impl->pre_render_output) {
+			effect->impl->pre_render_output(effect, data);
+		}
+	}
+}
+
+void wsm_effects_render_output(struct wsm_effect_output_data *data) {
+	EFFECTS_DISPATCH(render_output, data);
+}
+
+void wsm_effects_post_render_output(struct wsm_effect_output_data *data) {
+	EFFECTS_DISPATCH(post_render_output, data);
+}
+
+void wsm_effects_pre_render_window(struct wsm_effect_window_data *data) {
+	EFFECTS_DISPATCH(pre_render_window, data);
+}
+
+void wsm_effects_render_window(struct wsm_effect_window_data *data) {
+	EFFECTS_DISPATCH(render_window, data);
+}
+
+void wsm_effects_post_render_window(struct wsm_effect_window_data *data) {
+	EFFECTS_DISPATCH(post_render_window, data);
+}
@@ -2,6 +2,21 @@
 #define WSM_EFFECT_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include <pixman.h>
+
+#include <wayland-server-core.h>
+
+#include <wlr/util/box.h>
+
+struct wlr_buffer;
+struct wlr_renderer;
+struct wlr_render_pass;
+struct wlr_scene_buffer;
+struct wlr_scene_output;
+
+struct wsm_surface_effect;
 
 /**
  * @brief build-in effects enumeration
@@ -13,50 +28,140 @@ enum wsm_effect_feature {
 	WSM_EFFECT_RADIUS,      /**< supprot scissors window radius effect. */
 };
 
+#define WSM_EFFECT_FEATURE_BIT(feature) (1u << (feature))
+
+struct wsm_effect_output_data;
+
+/**
+ * @brief draws the output background layers (wallpaper, desktop widgets)
+ * into pass, clipped to clip in buffer coordinates.
+ */
+typedef void (*wsm_effect_render_backdrop_func_t)(
+	const struct wsm_effect_output_data *data, struct wlr_render_pass *pass,
+	const pixman_region32_t *clip);
+
+/**
+ * @brief per frame output state handed to the effects.
+ *
+ * All coordinates and regions are in output buffer coordinates.
+ */
+struct wsm_effect_output_data {
+	struct wlr_scene_output *scene_output;
+	struct wlr_renderer *renderer;
+	/* NULL in pre_render_output, effects may begin their own passes there */
+	struct wlr_render_pass *render_pass;
+	const pixman_region32_t *damage;
+
+	/*
+	 * Only valid in pre_render_output, area where the background layers
+	 * changed since the previous frame with effects. Effects may still add
+	 * damage to scene_output there.
+	 */
+	const pixman_region32_t *backdrop_damage;
+	/* area covered by windows asking for blur */
+	const pixman_region32_t *blur_region;
+	wsm_effect_render_backdrop_func_t render_backdrop;
+	void *backdrop_data;
+
+	int width, height;
+	float scale;
+	uint32_t features; // WSM_EFFECT_FEATURE_BIT() of effects wanted this frame
+};
+
+struct wsm_effect_window_data {
+	const struct wsm_effect_output_data *output;
+	struct wlr_scene_buffer *scene_buffer;
+	struct wsm_surface_effect *surface_effect;
+	uint32_t features;
+
+	struct wlr_box dst_box;
+	/* region the window is drawn in, effects may narrow it */
+	pixman_region32_t *clip;
+};
+
+struct wsm_effect;
+
 struct wsm_effect_impl {
+	uint32_t features; // WSM_EFFECT_FEATURE_BIT() of the implemented effects
+
 	/**
 	 * @brief Called before starting to render the screen.
 	 */
-	void (*pre_render_output) ();
+	void (*pre_render_output) (struct wsm_effect *effect,
+		struct wsm_effect_output_data *data);
 	/**
 	 * @brief render something on top of the windows.
 	 */
-	void (*render_output) ();
-	
+	void (*render_output) (struct wsm_effect *effect,
+		struct wsm_effect_output_data *data);
+
 	/**
 	 * @brief Called after all the render has been finished.
 	 */
-	void (*post_render_output) ();
-	
+	void (*post_render_output) (struct wsm_effect *effect,
+		struct wsm_effect_output_data *data);
+
 	/**
 	 * @brief Called for every window before the actual render pass.
 	 */
-	void (*pre_render_window) ();
-	
+	void (*pre_render_window) (struct wsm_effect *effect,
+		struct wsm_effect_window_data *data);
+
 	/**
 	 * @brief do various transformations.
 	 * change opacity、brightness、saturation of the window
 	 */
-	void (*render_window) ();
-	
+	void (*render_window) (struct wsm_effect *effect,
+		struct wsm_effect_window_data *data);
+
 	/**
 	 * @brief Called for every window after all rendering has been finished.
 	 */
-	void (*post_render_window) ();
-	
+	void (*post_render_window) (struct wsm_effect *effect,
+		struct wsm_effect_window_data *data);
+
 	/**
 	 * @brief Whether to support this special effect, distinguish different rendering APIs.
 	 */
-	bool (*is_supported) ();
+	bool (*is_supported) (struct wlr_renderer *renderer);
+
+	void (*destroy) (struct wsm_effect *effect);
 };
 
 struct wsm_effect {
 	const struct wsm_effect_impl *impl;
+	struct wl_list link; // wsm_effects.effects
 };
 
-struct wsm_effect* wsm_effect_create();
+void wsm_effect_init(struct wsm_effect *effect, const struct wsm_effect_impl *impl);
+/**
+ * @brief wsm_effect_destroy unlink the effect and release it through
+ * impl->destroy, or free() when the effect has none.
+ */
 void wsm_effect_destroy(struct wsm_effect* effect);
 bool wsm_effect_provides_feature (struct wsm_effect *effect,
 	enum wsm_effect_feature feature);
 
+/**
+ * @brief wsm_effects_init create the build-in effects supported by renderer
+ */
+void wsm_effects_init(struct wlr_renderer *renderer);
+void wsm_effects_finish(void);
+/**
+ * @brief wsm_effects_window_features WSM_EFFECT_FEATURE_BIT() of the effects
+ * scene_buffer asks for, surface_effect is set when not NULL.
+ */
+uint32_t wsm_effects_window_features(struct wlr_scene_buffer *scene_buffer,
+	struct wsm_surface_effect **surface_effect);
+/**
+ * @brief wsm_effects_pre_render_output called for every composited frame,
+ * even when data->features is 0, before the damage of the frame is final.
+ */
+void wsm_effects_pre_render_output(struct wsm_effect_output_data *data);
+void wsm_effects_render_output(struct wsm_effect_output_data *data);
+void wsm_effects_post_render_output(struct wsm_effect_output_data *data);
+void wsm_effects_pre_render_window(struct wsm_effect_window_data *data);
+void wsm_effects_render_window(struct wsm_effect_window_data *data);
+void wsm_effects_post_render_window(struct wsm_effect_window_data *data);
+
 #endif
@@ -0,0 +1,338 @@
+#include "wsm_effects_manager.h"
+#include "wsm_log.h"
+#include "wsm_list.h"
+#include "wsm_scene.h"
+#include "wsm_server.h"
+#include "wsm_output.h"
+#include "scissors/wsm_gl_scissors_base.h"
+#include "wsm-effects-protocol.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_compositor.h>
+
+#define WSM_EFFECTS_MANAGER_VERSION 1
+
+static const struct surface_effect_interface surface_effect_impl;
+
+static struct wsm_surface_effect *surface_effect_from_resource(
+		struct wl_resource *resource) {
+	assert(wl_resource_instance_of(resource, &surface_effect_interface,
+		&surface_effect_impl));
+	return wl_resource_get_user_data(resource);
+}
+
+static void surface_effect_state_init(struct wsm_surface_effect_state *state) {
+	memset(state, 0, sizeof(*state));
+	pixman_region32_init(&state->blur_region);
+	pixman_region32_init(&state->clip_region);
+}
+
+static void surface_effect_state_finish(struct wsm_surface_effect_state *state) {
+	pixman_region32_fini(&state->blur_region);
+	pixman_region32_fini(&state->clip_region);
+}
+
+static void surface_effect_state_copy(struct wsm_surface_effect_state *dst,
+		const struct wsm_surface_effect_state *src) {
+	pixman_region32_t blur_region, clip_region;
+	blur_region = dst->blur_region;
+	clip_region = dst->clip_region;
+	*dst = *src;
+	dst->blur_region = blur_region;
+	dst->clip_region = clip_region;
+	pixman_region32_copy(&dst->blur_region, &src->blur_region);
+	pixman_region32_copy(&dst->clip_region, &src->clip_region);
+}
+
+static void surface_effect_destroy(struct wsm_surface_effect *effect) {
+	if (!effect) {
+		return;
+	}
+
+	if (effect->surface) {
+		wlr_addon_finish(&effect->addon);
+		wsm_scene_surface_effect_changed(global_server.scene, effect->surface);
+	}
+	wl_resource_set_user_data(effect->resource, NULL);
+	surface_effect_state_finish(&effect->pending);
+	surface_effect_state_finish(&effect->current);
+	free(effect);
+}
+
+static void surface_addon_destroy(struct wlr_addon *addon) {
+	// The resource stays alive but inert until the client releases it
+	struct wsm_surface_effect *effect = wl_container_of(addon, effect, addon);
+	surface_effect_destroy(effect);
+}
+
+static const struct wlr_addon_interface surface_addon_impl = {
+	.name = "wsm_surface_effect",
+	.destroy = surface_addon_destroy,
+};
+
+struct wsm_surface_effect *wsm_surface_effect_from_wlr_surface(
+		struct wlr_surface *surface) {
+	struct wlr_addon *addon =
+		wlr_addon_find(&surface->addons, NULL, &surface_addon_impl);
+	if (!addon) {
+		return NULL;
+	}
+
+	struct wsm_surface_effect *effect = wl_container_of(addon, effect, addon);
+	return effect;
+}
+
+void wsm_surface_effect_opaque_region(struct wlr_surface *surface,
+		pixman_region32_t *opaque) {
+	pixman_region32_copy(opaque, &surface->opaque_region);
+
+	struct wsm_surface_effect *effect = wsm_surface_effect_from_wlr_surface(surface);
+	if (!effect || !pixman_region32_not_empty(opaque)) {
+		return;
+	}
+
+	struct wsm_surface_effect_state *state = &effect->current;
+	if (state->clip) {
+		pixman_region32_intersect(opaque, opaque, &state->clip_region);
+	}
+
+	if (state->corner_radius > 0) {
+		struct wlr_box box = {
+			.width = surface->current.width,
+			.height = surface->current.height,
+		};
+		pixman_region32_t rounded;
+		pixman_region32_init(&rounded);
+		wsm_scissors_rounded_region(&rounded, &box, state->corner_radius,
+			state->corner_flags);
+		pixman_region32_intersect(opaque, opaque, &rounded);
+		pixman_region32_fini(&rounded);
+	}
+}
+
+static void surface_effect_handle_commit(struct wl_client *client,
+		struct wl_resource *resource) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	surface_effect_state_copy(&effect->current, &effect->pending);
+	wsm_scene_surface_effect_changed(global_server.scene, effect->surface);
+}
+
+static void surface_effect_handle_set_region(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *region_resource) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	struct wsm_surface_effect_state *pending = &effect->pending;
+	pending->full_blur = false;
+	if (region_resource) {
+		const pixman_region32_t *region = wlr_region_from_resource(region_resource);
+		pixman_region32_copy(&pending->blur_region, region);
+		pending->blur = true;
+	} else {
+		pixman_region32_clear(&pending->blur_region);
+		pending->blur = false;
+	}
+}
+
+static void surface_effect_handle_set_fullwindowblur(struct wl_client *client,
+		struct wl_resource *resource) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	effect->pending.blur = true;
+	effect->pending.full_blur = true;
+}
+
+static void surface_effect_handle_set_window_rounded_corner(struct wl_client *client,
+		struct wl_resource *resource, wl_fixed_t radius, uint32_t flag) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	double value = wl_fixed_to_double(radius);
+	effect->pending.corner_radius = value > 0 ? value : 0;
+	effect->pending.corner_flags = flag;
+}
+
+static void surface_effect_handle_set_shadow_color(struct wl_client *client,
+		struct wl_resource *resource, int32_t r, int32_t g, int32_t b) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	float *color = effect->pending.shadow_color;
+	color[0] = r / 255.0f;
+	color[1] = g / 255.0f;
+	color[2] = b / 255.0f;
+	color[3] = 1.0f;
+}
+
+static void surface_effect_handle_set_border_color(struct wl_client *client,
+		struct wl_resource *resource, int32_t r, int32_t g, int32_t b, int32_t a) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	// premultiplied, as expected by wlr_render_pass
+	float alpha = a / 255.0f;
+	float *color = effect->pending.border_color;
+	color[0] = r / 255.0f * alpha;
+	color[1] = g / 255.0f * alpha;
+	color[2] = b / 255.0f * alpha;
+	color[3] = alpha;
+}
+
+static void surface_effect_handle_set_border_width(struct wl_client *client,
+		struct wl_resource *resource, wl_fixed_t width) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	double value = wl_fixed_to_double(width);
+	effect->pending.border_width = value > 0 ? value : 0;
+}
+
+static void surface_effect_handle_set_clip_region(struct wl_client *client,
+		struct wl_resource *resource, struct wl_resource *region_resource) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	if (!effect) {
+		return;
+	}
+
+	struct wsm_surface_effect_state *pending = &effect->pending;
+	if (region_resource) {
+		const pixman_region32_t *region = wlr_region_from_resource(region_resource);
+		pixman_region32_copy(&pending->clip_region, region);
+		pending->clip = true;
+	} else {
+		pixman_region32_clear(&pending->clip_region);
+		pending->clip = false;
+	}
+}
+
+static void surface_effect_handle_release(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static const struct surface_effect_interface surface_effect_impl = {
+	.commit = surface_effect_handle_commit,
+	.set_region = surface_effect_handle_set_region,
+	.set_fullwindowblur = surface_effect_handle_set_fullwindowblur,
+	.set_window_rounded_corner = surface_effect_handle_set_window_rounded_corner,
+	.set_shadow_color = surface_effect_handle_set_shadow_color,
+	.set_border_color = surface_effect_handle_set_border_color,
+	.set_border_width = surface_effect_handle_set_border_width,
+	.set_clip_region = surface_effect_handle_set_clip_region,
+	.release = surface_effect_handle_release,
+};
+
+static void surface_effect_handle_resource_destroy(struct wl_resource *resource) {
+	struct wsm_surface_effect *effect = surface_effect_from_resource(resource);
+	surface_effect_destroy(effect);
+}
+
+static void manager_handle_create(struct wl_client *client,
+		struct wl_resource *manager_resource, uint32_t id,
+		struct wl_resource *surface_resource) {
+	struct wlr_surface *surface = wlr_surface_from_resource(surface_resource);
+
+	struct wsm_surface_effect *old = wsm_surface_effect_from_wlr_surface(surface);
+	if (old) {
+		// The latest object wins, the previous one becomes inert
+		surface_effect_destroy(old);
+	}
+
+	struct wsm_surface_effect *effect = calloc(1, sizeof(struct wsm_surface_effect));
+	if (!effect) {
+		wsm_log(WSM_ERROR, "Could not create wsm_surface_effect: allocation failed!");
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	uint32_t version = wl_resource_get_version(manager_resource);
+	effect->resource = wl_resource_create(client, &surface_effect_interface,
+		version, id);
+	if (!effect->resource) {
+		free(effect);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(effect->resource, &surface_effect_impl,
+		effect, surface_effect_handle_resource_destroy);
+
+	effect->surface = surface;
+	surface_effect_state_init(&effect->pending);
+	surface_effect_state_init(&effect->current);
+	wlr_addon_init(&effect->addon, &surface->addons, NULL, &surface_addon_impl);
+}
+
+static void manager_handle_unset(struct wl_client *client,
+		struct wl_resource *manager_resource, struct wl_resource *surface_resource) {
+	struct wlr_surface *surface = wlr_surface_from_resource(surface_resource);
+	struct wsm_surface_effect *effect = wsm_surface_effect_from_wlr_surface(surface);
+	surface_effect_destroy(effect);
+}
+
+static const struct effects_manager_interface effects_manager_impl = {
+	.create = manager_handle_create,
+	.unset = manager_handle_unset,
+};
+
+static void effects_manager_bind(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wsm_effects_manager *manager = data;
+	struct wl_resource *resource = wl_resource_create(client,
+		&effects_manager_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &effects_manager_impl, manager, NULL);
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wsm_effects_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	wl_list_remove(&manager->display_destroy.link);
+	wl_global_destroy(manager->global);
+	free(manager);
+}
+
+struct wsm_effects_manager *wsm_effects_manager_create(struct wl_display *display) {
+	struct wsm_effects_manager *manager = calloc(1, sizeof(struct wsm_effects_manager));
+	if (!manager) {
+		wsm_log(WSM_ERROR, "Could not create wsm_effects_manager: allocation failed!");
+		return NULL;
+	}
+
+	manager->global = wl_global_create(display, &effects_manager_interface,
+		WSM_EFFECTS_MANAGER_VERSION, manager, effects_manager_bind);
+	if (!manager->global) {
+		wsm_log(WSM_ERROR, "Could not create effects_manager global");
+		free(manager);
+		return NULL;
+	}
+
+	manager->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+
+	return manager;
+}
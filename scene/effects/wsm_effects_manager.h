@@ -0,0 +1,58 @@
+#ifndef WSM_EFFECTS_MANAGER_H
+#define WSM_EFFECTS_MANAGER_H
+
+#include <stdbool.h>
+
+#include <pixman.h>
+
+#include <wayland-server-core.h>
+
+#include <wlr/util/addon.h>
+
+struct wlr_surface;
+
+struct wsm_surface_effect_state {
+	pixman_region32_t blur_region; // surface-local, unused with full_blur
+	pixman_region32_t clip_region; // surface-local
+
+	float corner_radius;
+	uint32_t corner_flags; // enum surface_effect_rounded_corners_flag
+
+	float shadow_color[4];
+	float border_color[4];
+	float border_width;
+
+	bool blur;
+	bool full_blur;
+	bool clip;
+};
+
+/**
+ * @brief surface_effect object of the wsm-effects protocol
+ */
+struct wsm_surface_effect {
+	struct wl_resource *resource;
+	struct wlr_surface *surface;
+	struct wlr_addon addon; // wlr_surface.addons
+
+	struct wsm_surface_effect_state pending;
+	struct wsm_surface_effect_state current;
+};
+
+struct wsm_effects_manager {
+	struct wl_global *global;
+	struct wl_listener display_destroy;
+};
+
+struct wsm_effects_manager *wsm_effects_manager_create(struct wl_display *display);
+struct wsm_surface_effect *wsm_surface_effect_from_wlr_surface(
+	struct wlr_surface *surface);
+/**
+ * @brief wsm_surface_effect_opaque_region the opaque region of the surface
+ * without its rounded corners and what its clip region drops, so what is
+ * below them keeps being rendered.
+ */
+void wsm_surface_effect_opaque_region(struct wlr_surface *surface,
+	pixman_region32_t *opaque);
+
+#endif
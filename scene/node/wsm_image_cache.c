@@ -0,0 +1,305 @@
+#include "wsm_image_cache.h"
+#include "wsm_image_node.h"
+#include "wsm_log.h"
+#include "wsm_worker_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <cairo.h>
+
+#include <drm_fourcc.h>
+
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/interfaces/wlr_buffer.h>
+
+struct cairo_buffer {
+	struct wlr_buffer base;
+	cairo_surface_t *surface;
+};
+
+struct image_request {
+	struct wsm_worker_job job;
+	struct wl_list cache_link; // wsm_image_cache.requests
+	struct wsm_image_cache *cache; // NULL once the cache is gone
+	struct wsm_image_cache_entry *entry; // only touched on the compositor thread
+	char *path;
+	int width;
+	int height;
+	cairo_surface_t *surface; // set by the worker, NULL on failure
+};
+
+static void cairo_buffer_handle_destroy(struct wlr_buffer *wlr_buffer) {
+	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	cairo_surface_destroy(buffer->surface);
+	free(buffer);
+}
+
+static bool cairo_buffer_handle_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = cairo_image_surface_get_data(buffer->surface);
+	*stride = cairo_image_surface_get_stride(buffer->surface);
+	*format = DRM_FORMAT_ARGB8888;
+	return true;
+}
+
+static void cairo_buffer_handle_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+}
+
+static const struct wlr_buffer_impl cairo_buffer_impl = {
+	.destroy = cairo_buffer_handle_destroy,
+	.begin_data_ptr_access = cairo_buffer_handle_begin_data_ptr_access,
+	.end_data_ptr_access = cairo_buffer_handle_end_data_ptr_access,
+};
+
+static void image_request_destroy(struct image_request *request) {
+	wl_list_remove(&request->cache_link);
+	if (request->surface) {
+		cairo_surface_destroy(request->surface);
+	}
+	free(request->path);
+	free(request);
+}
+
+static void image_request_run(struct wsm_worker_job *job) {
+	struct image_request *request = wl_container_of(job, request, job);
+	request->surface = create_cairo_surface_from_file_at_size(request->path,
+		request->width, request->height);
+	if (request->surface) {
+		cairo_surface_flush(request->surface);
+	}
+}
+
+static void image_cache_entry_destroy(struct wsm_image_cache_entry *entry) {
+	if (entry->cache) {
+		g_hash_table_remove(entry->cache->entries, entry->key);
+		entry->cache->size -= entry->size;
+	}
+	wl_list_remove(&entry->link);
+	if (entry->buffer) {
+		wlr_buffer_unlock(entry->buffer);
+	}
+	free(entry->key);
+	free(entry);
+}
+
+static void image_cache_trim(struct wsm_image_cache *cache) {
+	struct wsm_image_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &cache->unused, link) {
+		if (cache->size <= cache->budget) {
+			break;
+		}
+		image_cache_entry_destroy(entry);
+	}
+}
+
+static struct wlr_buffer *image_cache_upload(struct wsm_image_cache *cache,
+		cairo_surface_t *surface) {
+	struct cairo_buffer *cairo_buffer = calloc(1, sizeof(struct cairo_buffer));
+	if (!cairo_buffer) {
+		wsm_log(WSM_ERROR, "Could not create cairo_buffer: allocation failed!");
+		return NULL;
+	}
+
+	cairo_buffer->surface = cairo_surface_reference(surface);
+	wlr_buffer_init(&cairo_buffer->base, &cairo_buffer_impl,
+		cairo_image_surface_get_width(surface),
+		cairo_image_surface_get_height(surface));
+
+	// The texture is created once here, scene buffers showing the client
+	// buffer reuse it instead of uploading their own copy
+	struct wlr_client_buffer *client_buffer =
+		wlr_client_buffer_create(&cairo_buffer->base, cache->renderer);
+	if (!client_buffer) {
+		wsm_log(WSM_DEBUG, "Could not upload image, falling back to per node textures");
+		wlr_buffer_lock(&cairo_buffer->base);
+		wlr_buffer_drop(&cairo_buffer->base);
+		return &cairo_buffer->base;
+	}
+
+	wlr_buffer_drop(&cairo_buffer->base);
+	return &client_buffer->base;
+}
+
+static void image_request_done(struct wsm_worker_job *job) {
+	struct image_request *request = wl_container_of(job, request, job);
+	struct wsm_image_cache *cache = request->cache;
+	struct wsm_image_cache_entry *entry = request->entry;
+	entry->pending = false;
+	if (!cache) {
+		// The cache went away first, nothing is uploaded anymore
+		if (entry->refs == 0) {
+			image_cache_entry_destroy(entry);
+		}
+		image_request_destroy(request);
+		return;
+	}
+
+	if (request->surface) {
+		entry->buffer = image_cache_upload(cache, request->surface);
+	}
+	if (entry->buffer) {
+		entry->size = (size_t)entry->buffer->width * entry->buffer->height * 4;
+		cache->size += entry->size;
+	} else {
+		// Forget the failure, a later lookup may find a fixed file
+		g_hash_table_remove(cache->entries, entry->key);
+	}
+
+	// Listeners may drop their reference, keep the entry alive meanwhile
+	entry->refs++;
+	wl_signal_emit_mutable(&entry->events.ready, entry);
+	image_request_destroy(request);
+
+	if (--entry->refs == 0) {
+		wl_list_remove(&entry->link);
+		if (entry->buffer) {
+			wl_list_insert(cache->unused.prev, &entry->link);
+		} else {
+			wl_list_init(&entry->link);
+			entry->cache = NULL;
+			image_cache_entry_destroy(entry);
+		}
+	} else if (!entry->buffer) {
+		entry->cache = NULL;
+	}
+
+	image_cache_trim(cache);
+}
+
+struct wsm_image_cache *wsm_image_cache_create(struct wsm_worker_pool *pool,
+		struct wlr_renderer *renderer, size_t budget) {
+	struct wsm_image_cache *cache = calloc(1, sizeof(struct wsm_image_cache));
+	if (!cache) {
+		wsm_log(WSM_ERROR, "Could not create wsm_image_cache: allocation failed!");
+		return NULL;
+	}
+
+	wl_list_init(&cache->unused);
+	wl_list_init(&cache->requests);
+	cache->pool = pool;
+	cache->renderer = renderer;
+	cache->budget = budget;
+	cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+
+	return cache;
+}
+
+void wsm_image_cache_destroy(struct wsm_image_cache *cache) {
+	if (!cache) {
+		return;
+	}
+
+	// Requests still decoding are finished by image_request_done
+	struct image_request *request, *tmp;
+	wl_list_for_each_safe(request, tmp, &cache->requests, cache_link) {
+		request->cache = NULL;
+		request->entry->cache = NULL;
+		g_hash_table_remove(cache->entries, request->entry->key);
+		wl_list_remove(&request->cache_link);
+		wl_list_init(&request->cache_link);
+	}
+
+	struct wsm_image_cache_entry *entry, *entry_tmp;
+	wl_list_for_each_safe(entry, entry_tmp, &cache->unused, link) {
+		image_cache_entry_destroy(entry);
+	}
+
+	// Entries still shown by image nodes are freed by their last unref
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, cache->entries);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		entry = value;
+		entry->cache = NULL;
+		g_hash_table_iter_remove(&iter);
+	}
+
+	g_hash_table_unref(cache->entries);
+	free(cache);
+}
+
+struct wsm_image_cache_entry *wsm_image_cache_get(struct wsm_image_cache *cache,
+		const char *path, int width, int height) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		wsm_log(WSM_DEBUG, "Unable to stat image file: %s", path);
+		return NULL;
+	}
+
+	width = width > 0 ? width : 0;
+	height = height > 0 ? height : 0;
+	char *key = g_strdup_printf("%s:%lld.%09ld:%lld:%dx%d", path,
+		(long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+		(long long)st.st_size, width, height);
+
+	struct wsm_image_cache_entry *entry = g_hash_table_lookup(cache->entries, key);
+	if (entry) {
+		g_free(key);
+		if (entry->refs++ == 0) {
+			wl_list_remove(&entry->link);
+			wl_list_init(&entry->link);
+		}
+		return entry;
+	}
+
+	entry = calloc(1, sizeof(struct wsm_image_cache_entry));
+	struct image_request *request = calloc(1, sizeof(struct image_request));
+	if (!entry || !request) {
+		wsm_log(WSM_ERROR, "Could not create wsm_image_cache_entry: allocation failed!");
+		free(entry);
+		free(request);
+		g_free(key);
+		return NULL;
+	}
+
+	wl_signal_init(&entry->events.ready);
+	wl_list_init(&entry->link);
+	entry->cache = cache;
+	entry->key = strdup(key);
+	g_free(key);
+	entry->refs = 1;
+	entry->pending = true;
+	g_hash_table_insert(cache->entries, entry->key, entry);
+
+	request->job.run = image_request_run;
+	request->job.done = image_request_done;
+	request->cache = cache;
+	request->entry = entry;
+	request->path = strdup(path);
+	request->width = width;
+	request->height = height;
+	wl_list_insert(&cache->requests, &request->cache_link);
+
+	if (cache->pool) {
+		wsm_worker_pool_submit(cache->pool, &request->job);
+	} else {
+		image_request_run(&request->job);
+		image_request_done(&request->job);
+	}
+
+	return entry;
+}
+
+void wsm_image_cache_entry_unref(struct wsm_image_cache_entry *entry) {
+	if (!entry || --entry->refs > 0) {
+		return;
+	}
+
+	struct wsm_image_cache *cache = entry->cache;
+	if (entry->pending) {
+		// Finished by image_request_done, the pool still holds the request
+		return;
+	}
+
+	if (!cache) {
+		image_cache_entry_destroy(entry);
+		return;
+	}
+
+	wl_list_insert(cache->unused.prev, &entry->link);
+	image_cache_trim(cache);
+}
@@ -0,0 +1,68 @@
+#ifndef WSM_IMAGE_CACHE_H
+#define WSM_IMAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <wayland-server-core.h>
+
+#include <glib.h>
+
+#define WSM_IMAGE_CACHE_BUDGET (16 * 1024 * 1024)
+
+struct wlr_buffer;
+struct wlr_renderer;
+struct wsm_image_cache;
+struct wsm_worker_pool;
+
+/**
+ * @brief one decoded image, shared by every image node showing it.
+ */
+struct wsm_image_cache_entry {
+	struct {
+		struct wl_signal ready; // decoding finished, buffer is NULL on failure
+	} events;
+
+	struct wsm_image_cache *cache; // NULL once the cache is gone
+	struct wl_list link; // wsm_image_cache.unused, when refs is 0
+	char *key;
+
+	struct wlr_buffer *buffer; // locked, wraps the uploaded texture
+	size_t size; // bytes of texture memory
+	int refs;
+	bool pending; // queued on the worker pool
+};
+
+/**
+ * @brief process wide cache of decoded images, keyed by (path, mtime, file
+ * size, pixel size).
+ *
+ * @details Misses are decoded on the worker pool, the texture is uploaded on
+ * the compositor thread once done. Entries nobody uses stay around in LRU
+ * order as long as they fit in budget.
+ */
+struct wsm_image_cache {
+	struct wlr_renderer *renderer;
+	struct wsm_worker_pool *pool; // NULL decodes on the calling thread
+
+	GHashTable *entries; // key -> wsm_image_cache_entry
+	struct wl_list unused; // wsm_image_cache_entry.link, least recently used first
+	struct wl_list requests; // image_request.cache_link, being decoded
+	size_t budget;
+	size_t size;
+};
+
+struct wsm_image_cache *wsm_image_cache_create(struct wsm_worker_pool *pool,
+	struct wlr_renderer *renderer, size_t budget);
+void wsm_image_cache_destroy(struct wsm_image_cache *cache);
+/**
+ * @brief wsm_image_cache_get never decodes on the calling thread, unless the
+ * cache has no worker pool.
+ * @param width,height pixel size to decode to, 0 keeps the size of the image
+ * @return referenced entry, wait for events.ready while pending is set
+ */
+struct wsm_image_cache_entry *wsm_image_cache_get(struct wsm_image_cache *cache,
+	const char *path, int width, int height);
+void wsm_image_cache_entry_unref(struct wsm_image_cache_entry *entry);
+
+#endif
@@ -1,7 +1,10 @@
 #include "wsm_image_node.h"
 #include "wsm_log.h"
 #include "wsm_server.h"
+#include "wsm_scene.h"
+#include "wsm_image_cache.h"
 
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -20,49 +23,20 @@
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/interfaces/wlr_buffer.h>
 
-struct cairo_buffer {
-	struct wlr_buffer base;
-	cairo_surface_t *surface;
-};
-
 struct image_buffer {
 	struct wl_listener outputs_update;
 	struct wl_listener destroy;
+	struct wl_listener entry_ready;
 	struct wsm_image_node props;
 	struct wlr_scene_buffer *buffer_node;
-	struct cairo_buffer *buffer;
+	struct wsm_image_cache_entry *entry; // shown
+	struct wsm_image_cache_entry *pending_entry; // shown once decoded
 	char *path;
 
-	enum wl_output_subpixel subpixel;
-
+	float scale;
 	bool visible;
 };
 
-static void cairo_buffer_handle_destroy(struct wlr_buffer *wlr_buffer) {
-	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-
-	cairo_surface_destroy(buffer->surface);
-	free(buffer);
-}
-
-static bool cairo_buffer_handle_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
-		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
-	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-	*data = cairo_image_surface_get_data(buffer->surface);
-	*stride = cairo_image_surface_get_stride(buffer->surface);
-	*format = DRM_FORMAT_ARGB8888;
-	return true;
-}
-
-static void cairo_buffer_handle_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
-}
-
-static const struct wlr_buffer_impl cairo_buffer_impl = {
-	.destroy = cairo_buffer_handle_destroy,
-	.begin_data_ptr_access = cairo_buffer_handle_begin_data_ptr_access,
-	.end_data_ptr_access = cairo_buffer_handle_end_data_ptr_access,
-};
-
 static int is_target_image(const char *image_path, const char *lower_suffix, const char *capital_suffix) {
 	const char *ext = strrchr(image_path, '.');
 	if (ext != NULL) {
@@ -73,30 +47,73 @@ static int is_target_image(const char *image_path, const char *lower_suffix, con
 	return 0;
 }
 
-static void update_source_box(struct image_buffer *buffer) {
-	int width = cairo_image_surface_get_width(buffer->buffer->surface);
-	int height = cairo_image_surface_get_height(buffer->buffer->surface);
-	struct wlr_fbox source_box = {
-		.x = 0,
-		.y = 0,
-		.width = width,
-		.height = height,
-	};
-
-	wlr_scene_buffer_set_source_box(buffer->buffer_node, &source_box);
+static void image_buffer_set_entry(struct image_buffer *buffer,
+		struct wsm_image_cache_entry *entry) {
+	// A failed decode keeps whatever was shown before
+	if (entry->buffer) {
+		if (!buffer->buffer_node->buffer) {
+			wsm_scene_invalidate_render_lists(global_server.scene);
+		}
+		wlr_scene_buffer_set_buffer(buffer->buffer_node, entry->buffer);
+	}
+
+	wsm_image_cache_entry_unref(buffer->entry);
+	buffer->entry = entry;
+}
+
+static void image_buffer_cancel_pending(struct image_buffer *buffer) {
+	if (!buffer->pending_entry) {
+		return;
+	}
+
+	wl_list_remove(&buffer->entry_ready.link);
+	wl_list_init(&buffer->entry_ready.link);
+	wsm_image_cache_entry_unref(buffer->pending_entry);
+	buffer->pending_entry = NULL;
+}
+
+static void handle_entry_ready(struct wl_listener *listener, void *data) {
+	struct image_buffer *buffer = wl_container_of(listener, buffer, entry_ready);
+	struct wsm_image_cache_entry *entry = buffer->pending_entry;
+
+	wl_list_remove(&buffer->entry_ready.link);
+	wl_list_init(&buffer->entry_ready.link);
+	buffer->pending_entry = NULL;
+	image_buffer_set_entry(buffer, entry);
 }
 
-static void render_backing_buffer(struct image_buffer *buffer) {
-	if (!buffer->visible || !buffer->path) {
+static void image_buffer_request(struct image_buffer *buffer) {
+	if (!buffer->visible || !buffer->path || !global_server.image_cache) {
+		return;
+	}
+
+	int width = ceil(buffer->props.width * buffer->scale);
+	int height = ceil(buffer->props.height * buffer->scale);
+	struct wsm_image_cache_entry *entry = wsm_image_cache_get(
+		global_server.image_cache, buffer->path, width, height);
+	if (!entry) {
+		return;
+	}
+
+	if (entry == buffer->pending_entry) {
+		wsm_image_cache_entry_unref(entry);
+		return;
+	}
+
+	image_buffer_cancel_pending(buffer);
+	if (entry == buffer->entry) {
+		wsm_image_cache_entry_unref(entry);
 		return;
 	}
 
-	struct cairo_buffer *cairo_buffer =  buffer->buffer;
-	if (!cairo_buffer->surface) {
+	// The current image stays up until the new one is decoded
+	if (entry->pending) {
+		buffer->pending_entry = entry;
+		wl_signal_add(&entry->events.ready, &buffer->entry_ready);
 		return;
 	}
 
-	update_source_box(buffer);
+	image_buffer_set_entry(buffer, entry);
 }
 
 static void handle_destroy(struct wl_listener *listener, void *data) {
@@ -105,6 +122,8 @@ static void handle_destroy(struct wl_listener *listener, void *data) {
 	wl_list_remove(&buffer->outputs_update.link);
 	wl_list_remove(&buffer->destroy.link);
 
+	image_buffer_cancel_pending(buffer);
+	wsm_image_cache_entry_unref(buffer->entry);
 	free(buffer->path);
 	free(buffer);
 }
@@ -114,20 +133,8 @@ static void handle_outputs_update(struct wl_listener *listener, void *data) {
 	struct wlr_scene_outputs_update_event *event = data;
 
 	float scale = 0;
-	enum wl_output_subpixel subpixel = WL_OUTPUT_SUBPIXEL_UNKNOWN;
-
 	for (size_t i = 0; i < event->size; i++) {
 		struct wlr_scene_output *output = event->active[i];
-		if (subpixel == WL_OUTPUT_SUBPIXEL_UNKNOWN) {
-			subpixel = output->output->subpixel;
-		} else if (subpixel != output->output->subpixel) {
-			subpixel = WL_OUTPUT_SUBPIXEL_NONE;
-		}
-
-		if (scale != 0 && scale != output->output->scale) {
-			subpixel = WL_OUTPUT_SUBPIXEL_NONE;
-		}
-
 		if (scale < output->output->scale) {
 			scale = output->output->scale;
 		}
@@ -135,9 +142,9 @@ static void handle_outputs_update(struct wl_listener *listener, void *data) {
 
 	buffer->visible = event->size > 0;
 
-	if (subpixel != buffer->subpixel) {
-		buffer->subpixel = subpixel;
-		render_backing_buffer(buffer);
+	if (scale != buffer->scale) {
+		buffer->scale = scale;
+		image_buffer_request(buffer);
 	}
 }
 
@@ -171,9 +178,11 @@ struct wsm_image_node *wsm_image_node_create(struct wlr_scene_tree *parent,
 	wl_signal_add(&node->node.events.destroy, &buffer->destroy);
 	buffer->outputs_update.notify = handle_outputs_update;
 	wl_signal_add(&node->events.outputs_update, &buffer->outputs_update);
-	wsm_image_node_load(&buffer->props, path);
+	buffer->entry_ready.notify = handle_entry_ready;
+	wl_list_init(&buffer->entry_ready.link);
 	wlr_scene_buffer_set_dest_size(buffer->buffer_node,
 		width, height);
+	wsm_image_node_load(&buffer->props, path);
 	return &buffer->props;
 }
 
@@ -187,7 +196,8 @@ void handle_jpeg_error(j_common_ptr cinfo) {
 	wsm_log(WSM_ERROR, "read jpg file error");
 }
 
-cairo_surface_t *create_cairo_surface_frome_file(const char *file_path) {
+static cairo_surface_t *load_image_file(const char *file_path,
+		int width, int height) {
 	cairo_surface_t *surface = NULL;
 	if (is_target_image(file_path, ".png", ".PNG")) {
 		// PNG image
@@ -243,7 +253,13 @@ cairo_surface_t *create_cairo_surface_frome_file(const char *file_path) {
 		}
 
 		gdouble  out_width, out_height;
-		rsvg_handle_get_intrinsic_size_in_pixels(handle, &out_width, &out_height);
+		if (width > 0 && height > 0) {
+			// Vector images are rasterized at the size they are shown
+			out_width = width;
+			out_height = height;
+		} else {
+			rsvg_handle_get_intrinsic_size_in_pixels(handle, &out_width, &out_height);
+		}
 
 		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, out_width, out_height);
 		cairo_t *cr = cairo_create(surface);
@@ -305,6 +321,41 @@ cairo_surface_t *create_cairo_surface_frome_file(const char *file_path) {
 	return surface;
 }
 
+cairo_surface_t *create_cairo_surface_frome_file(const char *file_path) {
+	return load_image_file(file_path, 0, 0);
+}
+
+cairo_surface_t *create_cairo_surface_from_file_at_size(const char *file_path,
+		int width, int height) {
+	cairo_surface_t *surface = load_image_file(file_path, width, height);
+	if (!surface || width <= 0 || height <= 0) {
+		return surface;
+	}
+
+	int src_width = cairo_image_surface_get_width(surface);
+	int src_height = cairo_image_surface_get_height(surface);
+	if (src_width == width && src_height == height) {
+		return surface;
+	}
+
+	cairo_surface_t *scaled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+		width, height);
+	if (cairo_surface_status(scaled) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(scaled);
+		return surface;
+	}
+
+	cairo_t *cairo = cairo_create(scaled);
+	cairo_scale(cairo, (double)width / src_width, (double)height / src_height);
+	cairo_set_source_surface(cairo, surface, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cairo), CAIRO_FILTER_GOOD);
+	cairo_paint(cairo);
+	cairo_destroy(cairo);
+	cairo_surface_destroy(surface);
+	cairo_surface_flush(scaled);
+	return scaled;
+}
+
 struct wlr_texture *create_texture_from_cairo_surface(struct wlr_renderer *renderer, cairo_surface_t *surface) {
 	int width = cairo_image_surface_get_width(surface);
 	int height = cairo_image_surface_get_height(surface);
@@ -347,38 +398,19 @@ void wsm_image_node_load(struct wsm_image_node *node, const char *file_path) {
 
 	free(image_buffer->path);
 	image_buffer->path = new_path;
-
-	if (!image_buffer->buffer_node->buffer) {
-		image_buffer->buffer = calloc(1, sizeof(struct cairo_buffer));
-		if (!image_buffer->buffer) {
-			wsm_log(WSM_ERROR, "Could not create cairo_buffer: allocation failed!");
-			return;
-		}
-	} else {
-		cairo_surface_destroy(image_buffer->buffer->surface);
-	}
-
-	image_buffer->buffer->surface = create_cairo_surface_frome_file(new_path);
-	if (!image_buffer->buffer->surface) {
-		return;
-	}
-
-	cairo_surface_flush(image_buffer->buffer->surface);
-
-	wlr_buffer_init(&image_buffer->buffer->base, &cairo_buffer_impl,
-		cairo_image_surface_get_width(image_buffer->buffer->surface),
-		cairo_image_surface_get_height(image_buffer->buffer->surface));
-	wlr_scene_buffer_set_buffer(image_buffer->buffer_node, &image_buffer->buffer->base);
-	wlr_buffer_drop(&image_buffer->buffer->base);
+	image_buffer_request(image_buffer);
 }
 
 void wsm_image_node_set_size(struct wsm_image_node *node, int width, int height) {
 	struct image_buffer *image_buffer = wl_container_of(node, image_buffer, props);
 	assert(image_buffer);
-	if (image_buffer->buffer_node->dst_width == width &&
-		image_buffer->buffer_node->dst_height == height) {
+	if (node->width == width && node->height == height) {
 		return;
 	}
+
+	node->width = width;
+	node->height = height;
 	wlr_scene_buffer_set_dest_size(image_buffer->buffer_node,
 		width, height);
+	image_buffer_request(image_buffer);
 }
@@ -22,6 +22,12 @@ struct wsm_image_node *wsm_image_node_create(struct wlr_scene_tree *parent,
 	int width, int height, char *path, float alpha);
 void wsm_image_node_update_alpha(struct wsm_image_node *node, float alpha);
 cairo_surface_t *create_cairo_surface_frome_file(const char *file_path);
+/**
+ * @brief create_cairo_surface_from_file_at_size decode file_path to width x height
+ * pixels, safe to call off the compositor thread.
+ */
+cairo_surface_t *create_cairo_surface_from_file_at_size(const char *file_path,
+	int width, int height);
 struct wlr_texture *create_texture_from_cairo_surface(struct wlr_renderer *renderer, cairo_surface_t *surface);
 struct wlr_texture *create_texture_from_file_v1(struct wlr_renderer *renderer, const char *file_path);
 void wsm_image_node_load(struct wsm_image_node *node, const char *file_path);
@@ -39,6 +39,8 @@ struct wsm_node {
 	size_t id;
 	size_t ntxnrefs;
 	struct wsm_transaction_instruction *instruction;
+	// In the pending transaction, not committed yet
+	struct wsm_transaction_instruction *pending_instruction;
 
 	enum wsm_node_type type;
 	bool destroying;
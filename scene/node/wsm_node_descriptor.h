@@ -8,7 +8,6 @@ struct wlr_scene_node;
 struct wsm_view;
 
 enum wsm_scene_descriptor_type {
-	WSM_SCENE_DESC_BUFFER_TIMER,
 	WSM_SCENE_DESC_NON_INTERACTIVE,
 	WSM_SCENE_DESC_CONTAINER,
 	WSM_SCENE_DESC_VIEW,
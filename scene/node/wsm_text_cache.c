@@ -0,0 +1,347 @@
+#include "wsm_text_cache.h"
+#include "wsm_log.h"
+#include "wsm_cairo.h"
+#include "wsm_pango.h"
+#include "wsm_server.h"
+#include "wsm_worker_pool.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo.h>
+#include <pango/pangocairo.h>
+
+#include <drm_fourcc.h>
+
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/interfaces/wlr_buffer.h>
+
+struct cairo_buffer {
+	struct wlr_buffer base;
+	cairo_surface_t *surface;
+};
+
+struct text_request {
+	struct wsm_worker_job job;
+	struct wl_list link; // text_cache.requests
+	struct wsm_text_cache_entry *entry;
+	struct wsm_text_raster raster; // owns text and font
+	cairo_surface_t *surface; // set by the worker, NULL on failure
+	bool orphan; // the cache was finished first
+};
+
+static struct {
+	GHashTable *entries; // key -> wsm_text_cache_entry
+	struct wl_list lru; // wsm_text_cache_entry.link, least recently used first
+	struct wl_list requests; // text_request.link
+	size_t size;
+
+	PangoContext *measure; // default font options, as layout sizes expect
+
+	unsigned long hits;
+	unsigned long misses;
+	bool initialized;
+} text_cache;
+
+// One per thread rendering text, Pango contexts are not thread safe. Lives as
+// long as the thread.
+static __thread PangoContext *render_context;
+
+static void cairo_buffer_handle_destroy(struct wlr_buffer *wlr_buffer) {
+	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	cairo_surface_destroy(buffer->surface);
+	free(buffer);
+}
+
+static bool cairo_buffer_handle_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = cairo_image_surface_get_data(buffer->surface);
+	*stride = cairo_image_surface_get_stride(buffer->surface);
+	*format = DRM_FORMAT_ARGB8888;
+	return true;
+}
+
+static void cairo_buffer_handle_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+}
+
+static const struct wlr_buffer_impl cairo_buffer_impl = {
+	.destroy = cairo_buffer_handle_destroy,
+	.begin_data_ptr_access = cairo_buffer_handle_begin_data_ptr_access,
+	.end_data_ptr_access = cairo_buffer_handle_end_data_ptr_access,
+};
+
+static bool text_cache_init(void) {
+	if (text_cache.initialized) {
+		return true;
+	}
+
+	text_cache.measure = pango_font_map_create_context(
+		pango_cairo_font_map_get_default());
+	if (!text_cache.measure) {
+		wsm_log(WSM_ERROR, "Could not create text cache Pango context");
+		return false;
+	}
+
+	text_cache.entries = g_hash_table_new(g_str_hash, g_str_equal);
+	wl_list_init(&text_cache.lru);
+	wl_list_init(&text_cache.requests);
+	text_cache.initialized = true;
+	return true;
+}
+
+static void text_cache_entry_destroy(struct wsm_text_cache_entry *entry) {
+	wl_list_remove(&entry->link);
+	text_cache.size -= entry->size;
+	if (entry->buffer) {
+		wlr_buffer_unlock(entry->buffer);
+	}
+	free(entry->key);
+	free(entry);
+}
+
+static char *text_raster_key(const struct wsm_text_raster *raster) {
+	char *font = pango_font_description_to_string(raster->font);
+	const float *c = raster->color;
+	const float *b = raster->background;
+	char *key = g_strdup_printf("%s|%d|%a,%a,%a,%a|%a,%a,%a,%a|%a|%d|%dx%d+%d|%s",
+		font, raster->markup, c[0], c[1], c[2], c[3], b[0], b[1], b[2], b[3],
+		raster->scale, raster->subpixel, raster->width, raster->height,
+		raster->baseline_offset, raster->text);
+	g_free(font);
+	return key;
+}
+
+static cairo_surface_t *text_raster_render(const struct wsm_text_raster *raster) {
+	float scale = raster->scale;
+	int width = ceil(raster->width * scale);
+	int height = ceil(raster->height * scale);
+	const float *color = raster->color;
+	const float *background = raster->background;
+
+	cairo_surface_t *surface = cairo_image_surface_create(
+		CAIRO_FORMAT_ARGB32, width, height);
+	cairo_status_t status = cairo_surface_status(surface);
+	if (status != CAIRO_STATUS_SUCCESS) {
+		wsm_log(WSM_ERROR, "cairo_image_surface_create failed: %s",
+			cairo_status_to_string(status));
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
+	enum wl_output_subpixel subpixel = raster->subpixel;
+	if (subpixel == WL_OUTPUT_SUBPIXEL_NONE || subpixel == WL_OUTPUT_SUBPIXEL_UNKNOWN) {
+		cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_GRAY);
+	} else {
+		cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
+		cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(subpixel));
+	}
+
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	cairo_set_font_options(cairo, fo);
+	cairo_set_source_rgba(cairo, background[0], background[1], background[2], background[3]);
+	cairo_rectangle(cairo, 0, 0, width, height);
+	cairo_fill(cairo);
+	cairo_set_source_rgba(cairo, color[0], color[1], color[2], color[3]);
+	cairo_move_to(cairo, 0, raster->baseline_offset * scale);
+
+	if (!render_context) {
+		render_context = pango_font_map_create_context(
+			pango_cairo_font_map_get_default());
+	}
+	pango_cairo_context_set_font_options(render_context, fo);
+	pango_cairo_update_context(cairo, render_context);
+	PangoLayout *layout = get_pango_layout_with_context(render_context,
+		raster->font, raster->text, scale, raster->markup);
+	pango_cairo_show_layout(cairo, layout);
+	g_object_unref(layout);
+
+	cairo_destroy(cairo);
+	cairo_font_options_destroy(fo);
+	cairo_surface_flush(surface);
+	return surface;
+}
+
+static struct wlr_buffer *text_raster_upload(cairo_surface_t *surface) {
+	struct cairo_buffer *cairo_buffer = calloc(1, sizeof(struct cairo_buffer));
+	if (!cairo_buffer) {
+		wsm_log(WSM_ERROR, "Could not create cairo_buffer: allocation failed!");
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	cairo_buffer->surface = surface;
+	wlr_buffer_init(&cairo_buffer->base, &cairo_buffer_impl,
+		cairo_image_surface_get_width(surface),
+		cairo_image_surface_get_height(surface));
+
+	// Identical titles share one texture
+	struct wlr_client_buffer *client_buffer = NULL;
+	if (global_server.wlr_renderer) {
+		client_buffer = wlr_client_buffer_create(&cairo_buffer->base,
+			global_server.wlr_renderer);
+	}
+	if (!client_buffer) {
+		wlr_buffer_lock(&cairo_buffer->base);
+		wlr_buffer_drop(&cairo_buffer->base);
+		return &cairo_buffer->base;
+	}
+
+	wlr_buffer_drop(&cairo_buffer->base);
+	return &client_buffer->base;
+}
+
+static void text_request_destroy(struct text_request *request) {
+	wl_list_remove(&request->link);
+	if (request->surface) {
+		cairo_surface_destroy(request->surface);
+	}
+	free((char *)request->raster.text);
+	pango_font_description_free((PangoFontDescription *)request->raster.font);
+	free(request);
+}
+
+static void text_request_run(struct wsm_worker_job *job) {
+	struct text_request *request = wl_container_of(job, request, job);
+	request->surface = text_raster_render(&request->raster);
+}
+
+static void text_request_done(struct wsm_worker_job *job) {
+	struct text_request *request = wl_container_of(job, request, job);
+	struct wsm_text_cache_entry *entry = request->entry;
+	if (request->orphan) {
+		text_cache_entry_destroy(entry);
+		text_request_destroy(request);
+		return;
+	}
+
+	entry->pending = false;
+	if (request->surface) {
+		entry->buffer = text_raster_upload(request->surface);
+		request->surface = NULL;
+	}
+	if (entry->buffer) {
+		entry->size = (size_t)entry->buffer->width * entry->buffer->height * 4;
+		text_cache.size += entry->size;
+		wl_list_insert(text_cache.lru.prev, &entry->link);
+	} else {
+		g_hash_table_remove(text_cache.entries, entry->key);
+	}
+	text_request_destroy(request);
+
+	wl_signal_emit_mutable(&entry->events.ready, entry);
+	if (!entry->buffer) {
+		text_cache_entry_destroy(entry);
+		return;
+	}
+
+	struct wsm_text_cache_entry *lru, *tmp;
+	wl_list_for_each_safe(lru, tmp, &text_cache.lru, link) {
+		if (text_cache.size <= WSM_TEXT_CACHE_BUDGET || lru == entry) {
+			break;
+		}
+		g_hash_table_remove(text_cache.entries, lru->key);
+		text_cache_entry_destroy(lru);
+	}
+}
+
+struct wsm_text_cache_entry *wsm_text_cache_get(const struct wsm_text_raster *raster) {
+	if (!text_cache_init()) {
+		return NULL;
+	}
+
+	char *key = text_raster_key(raster);
+	struct wsm_text_cache_entry *entry = g_hash_table_lookup(text_cache.entries, key);
+	if (entry) {
+		g_free(key);
+		text_cache.hits++;
+		if (!entry->pending) {
+			wl_list_remove(&entry->link);
+			wl_list_insert(text_cache.lru.prev, &entry->link);
+		}
+		return entry;
+	}
+
+	text_cache.misses++;
+	if ((text_cache.hits + text_cache.misses) % 256 == 0) {
+		wsm_log(WSM_DEBUG, "text cache: %lu hits, %lu misses, %zu bytes",
+			text_cache.hits, text_cache.misses, text_cache.size);
+	}
+
+	entry = calloc(1, sizeof(struct wsm_text_cache_entry));
+	struct text_request *request = calloc(1, sizeof(struct text_request));
+	if (!entry || !request) {
+		wsm_log(WSM_ERROR, "Could not create wsm_text_cache_entry: allocation failed!");
+		free(entry);
+		free(request);
+		g_free(key);
+		return NULL;
+	}
+
+	wl_signal_init(&entry->events.ready);
+	wl_list_init(&entry->link);
+	entry->key = strdup(key);
+	entry->pending = true;
+	g_hash_table_insert(text_cache.entries, entry->key, entry);
+
+	request->job.run = text_request_run;
+	request->job.done = text_request_done;
+	request->entry = entry;
+	request->raster = *raster;
+	request->raster.text = strdup(raster->text);
+	request->raster.font = pango_font_description_copy(raster->font);
+	wl_list_insert(&text_cache.requests, &request->link);
+
+	if (global_server.worker_pool) {
+		wsm_worker_pool_submit(global_server.worker_pool, &request->job);
+	} else {
+		text_request_run(&request->job);
+		text_request_done(&request->job);
+		// Failed rasters are gone already
+		entry = g_hash_table_lookup(text_cache.entries, key);
+	}
+	g_free(key);
+	return entry;
+}
+
+void wsm_text_cache_measure(const PangoFontDescription *font, const char *text,
+		bool markup, int *width, int *height, int *baseline) {
+	if (!text_cache_init()) {
+		return;
+	}
+
+	PangoLayout *layout = get_pango_layout_with_context(text_cache.measure,
+		font, text, 1, markup);
+	pango_layout_get_pixel_size(layout, width, height);
+	if (baseline) {
+		*baseline = pango_layout_get_baseline(layout) / PANGO_SCALE;
+	}
+	g_object_unref(layout);
+}
+
+void wsm_text_cache_finish(void) {
+	if (!text_cache.initialized) {
+		return;
+	}
+
+	// Requests still rendering are freed by text_request_done
+	struct text_request *request, *request_tmp;
+	wl_list_for_each_safe(request, request_tmp, &text_cache.requests, link) {
+		request->orphan = true;
+		wl_list_remove(&request->link);
+		wl_list_init(&request->link);
+	}
+
+	struct wsm_text_cache_entry *entry, *tmp;
+	wl_list_for_each_safe(entry, tmp, &text_cache.lru, link) {
+		text_cache_entry_destroy(entry);
+	}
+	g_hash_table_unref(text_cache.entries);
+	g_clear_object(&text_cache.measure);
+	text_cache.initialized = false;
+}
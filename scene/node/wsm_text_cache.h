@@ -0,0 +1,62 @@
+#ifndef WSM_TEXT_CACHE_H
+#define WSM_TEXT_CACHE_H
+
+#include <stdbool.h>
+
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+
+#include <pango/pango.h>
+
+#define WSM_TEXT_CACHE_BUDGET (4 * 1024 * 1024)
+
+struct wlr_buffer;
+
+/**
+ * @brief everything a text raster depends on, the key of the text cache
+ */
+struct wsm_text_raster {
+	const char *text;
+	const PangoFontDescription *font;
+	float color[4];
+	float background[4];
+	float scale;
+	enum wl_output_subpixel subpixel;
+	int width; // logical size
+	int height;
+	int baseline_offset; // logical offset of the text from the top
+	bool markup;
+};
+
+/**
+ * @brief one rasterized text, in LRU order once rendered
+ */
+struct wsm_text_cache_entry {
+	struct {
+		struct wl_signal ready; // rendering finished, buffer is NULL on failure
+	} events;
+
+	struct wl_list link; // text_cache.lru, once rendered
+	char *key;
+	struct wlr_buffer *buffer; // locked
+	size_t size;
+	bool pending; // queued on the worker pool
+};
+
+/**
+ * @brief wsm_text_cache_get look up the raster of an earlier identical text,
+ * or queue it for rendering on the worker pool. Rasters are kept in LRU order
+ * within WSM_TEXT_CACHE_BUDGET.
+ * @return entry owned by the cache: take a lock on its buffer right away, or
+ * wait for events.ready while pending is set. NULL on failure
+ */
+struct wsm_text_cache_entry *wsm_text_cache_get(const struct wsm_text_raster *raster);
+/**
+ * @brief wsm_text_cache_measure measure text at scale 1 on the shared
+ * Pango context.
+ */
+void wsm_text_cache_measure(const PangoFontDescription *font, const char *text,
+	bool markup, int *width, int *height, int *baseline);
+void wsm_text_cache_finish(void);
+
+#endif
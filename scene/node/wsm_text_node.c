@@ -1,52 +1,22 @@
 #include "wsm_text_node.h"
 #include "wsm_log.h"
-#include "wsm_cairo.h"
-#include "wsm_pango.h"
+#include "wsm_text_cache.h"
 #include "wsm_server.h"
+#include "wsm_scene.h"
 #include "wsm_desktop.h"
 
 #include <math.h>
 #include <stdlib.h>
-#include <drm_fourcc.h>
+#include <string.h>
 
 #include <wayland-server-core.h>
 
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_buffer.h>
-#include <wlr/interfaces/wlr_buffer.h>
 
-struct cairo_buffer {
-	struct wlr_buffer base;
-	cairo_surface_t *surface;
-	cairo_t *cairo;
-};
-
-static void cairo_buffer_handle_destroy(struct wlr_buffer *wlr_buffer) {
-	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-
-	cairo_surface_destroy(buffer->surface);
-	cairo_destroy(buffer->cairo);
-	free(buffer);
-}
-
-static bool cairo_buffer_handle_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
-		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
-	struct cairo_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-	*data = cairo_image_surface_get_data(buffer->surface);
-	*stride = cairo_image_surface_get_stride(buffer->surface);
-	*format = DRM_FORMAT_ARGB8888;
-	return true;
-}
-
-static void cairo_buffer_handle_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
-}
-
-static const struct wlr_buffer_impl cairo_buffer_impl = {
-	.destroy = cairo_buffer_handle_destroy,
-	.begin_data_ptr_access = cairo_buffer_handle_begin_data_ptr_access,
-	.end_data_ptr_access = cairo_buffer_handle_end_data_ptr_access,
-};
+#define TEXT_RASTER_WIDTH_STEP 128
+#define TEXT_RASTER_MAX_PIXELS 32767 // cairo image surfaces are not larger
 
 struct text_buffer {
 	struct wlr_scene_buffer *buffer_node;
@@ -55,10 +25,15 @@ struct text_buffer {
 
 	bool visible;
 	float scale;
+	float raster_scale; // of the raster shown, lags behind scale while pending
+	int raster_width; // logical, of the raster last asked for
 	enum wl_output_subpixel subpixel;
 
+	struct wsm_text_cache_entry *pending_entry; // shown once rendered
+
 	struct wl_listener outputs_update;
 	struct wl_listener destroy;
+	struct wl_listener entry_ready;
 };
 
 static int get_text_width(struct wsm_text_node *props) {
@@ -69,86 +44,63 @@ static int get_text_width(struct wsm_text_node *props) {
 	return MAX(width, 0);
 }
 
+/**
+ * Only the part max_width lets through is rasterized, rounded up to steps so
+ * that resizing does not render a new raster for every pixel of max_width.
+ */
+static int get_raster_width(struct text_buffer *buffer) {
+	struct wsm_text_node *props = &buffer->props;
+	int width = props->width;
+	if (props->max_width >= 0) {
+		int steps = (props->max_width + TEXT_RASTER_WIDTH_STEP - 1) /
+			TEXT_RASTER_WIDTH_STEP;
+		width = MIN(width, steps * TEXT_RASTER_WIDTH_STEP);
+	}
+	width = MIN(width, (int)floor(TEXT_RASTER_MAX_PIXELS / MAX(buffer->scale, 1)));
+	return MAX(width, 0);
+}
+
 static void update_source_box(struct text_buffer *buffer) {
 	struct wsm_text_node *props = &buffer->props;
 	struct wlr_fbox source_box = {
 		.x = 0,
 		.y = 0,
-		.width = ceil(get_text_width(props) * buffer->scale),
-		.height = ceil(props->height * buffer->scale),
+		.width = ceil(get_text_width(props) * buffer->raster_scale),
+		.height = ceil(props->height * buffer->raster_scale),
 	};
 
+	// The previous raster may be smaller while the new one is rendered
+	struct wlr_buffer *wlr_buffer = buffer->buffer_node->buffer;
+	if (wlr_buffer) {
+		source_box.width = MIN(source_box.width, wlr_buffer->width);
+		source_box.height = MIN(source_box.height, wlr_buffer->height);
+	}
+
 	wlr_scene_buffer_set_source_box(buffer->buffer_node, &source_box);
 }
 
-static void render_backing_buffer(struct text_buffer *buffer) {
-	if (!buffer->visible) {
-		return;
-	}
-
-	if (buffer->props.max_width == 0) {
-		wlr_scene_buffer_set_buffer(buffer->buffer_node, NULL);
+static void text_buffer_cancel_pending(struct text_buffer *buffer) {
+	if (!buffer->pending_entry) {
 		return;
 	}
 
-	float scale = buffer->scale;
-	int width = ceil(buffer->props.width * scale);
-	int height = ceil(buffer->props.height * scale);
-	float *color = (float *)&buffer->props.color;
-	float *background = (float *)&buffer->props.background;
-	PangoContext *pango = NULL;
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
-	enum wl_output_subpixel subpixel = buffer->subpixel;
-	if (subpixel == WL_OUTPUT_SUBPIXEL_NONE || subpixel == WL_OUTPUT_SUBPIXEL_UNKNOWN) {
-		cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_GRAY);
-	} else {
-		cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
-		cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(subpixel));
-	}
+	wl_list_remove(&buffer->entry_ready.link);
+	wl_list_init(&buffer->entry_ready.link);
+	buffer->pending_entry = NULL;
+}
 
-	cairo_surface_t *surface = cairo_image_surface_create(
-		CAIRO_FORMAT_ARGB32, width, height);
-	cairo_status_t status = cairo_surface_status(surface);
-	if (status != CAIRO_STATUS_SUCCESS) {
-		wsm_log(WSM_ERROR, "cairo_image_surface_create failed: %s",
-			cairo_status_to_string(status));
-		goto err;
+static void text_buffer_set_raster(struct text_buffer *buffer,
+		struct wlr_buffer *wlr_buffer, float scale) {
+	if (!buffer->buffer_node->buffer) {
+		wsm_scene_invalidate_render_lists(global_server.scene);
 	}
-
-	struct cairo_buffer *cairo_buffer = calloc(1, sizeof(*cairo_buffer));
-	if (!cairo_buffer) {
-		wsm_log(WSM_ERROR, "Could not create cairo_buffer: allocation failed!");
-		goto err;
+	if (buffer->buffer_node->buffer != wlr_buffer) {
+		wlr_scene_buffer_set_buffer(buffer->buffer_node, wlr_buffer);
 	}
-
-	cairo_t *cairo = cairo_create(surface);
-	if (!cairo) {
-		wsm_log(WSM_ERROR, "cairo_create failed");
-		free(cairo_buffer);
-		goto err;
-	}
-
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_set_font_options(cairo, fo);
-	pango = pango_cairo_create_context(cairo);
-	cairo_set_source_rgba(cairo, background[0], background[1], background[2], background[3]);
-	cairo_rectangle(cairo, 0, 0, width, height);
-	cairo_fill(cairo);
-	cairo_set_source_rgba(cairo, color[0], color[1], color[2], color[3]);
-	cairo_move_to(cairo, 0, (global_server.desktop_interface->font_baseline - buffer->props.baseline) * scale);
-	render_text(cairo, global_server.desktop_interface->font_description, scale, buffer->props.pango_markup,
-		"%s", buffer->text);
-	cairo_surface_flush(surface);
-
-	wlr_buffer_init(&cairo_buffer->base, &cairo_buffer_impl, width, height);
-	cairo_buffer->surface = surface;
-	cairo_buffer->cairo = cairo;
-
-	wlr_scene_buffer_set_buffer(buffer->buffer_node, &cairo_buffer->base);
-	wlr_buffer_drop(&cairo_buffer->base);
+	buffer->raster_scale = scale;
 	update_source_box(buffer);
 
+	float *background = buffer->props.background;
 	pixman_region32_t opaque;
 	pixman_region32_init(&opaque);
 	if (background[3] == 1) {
@@ -157,10 +109,58 @@ static void render_backing_buffer(struct text_buffer *buffer) {
 	}
 	wlr_scene_buffer_set_opaque_region(buffer->buffer_node, &opaque);
 	pixman_region32_fini(&opaque);
+}
+
+static void handle_entry_ready(struct wl_listener *listener, void *data) {
+	struct text_buffer *buffer = wl_container_of(listener, buffer, entry_ready);
+	struct wsm_text_cache_entry *entry = data;
 
-err:
-	if (pango) g_object_unref(pango);
-	cairo_font_options_destroy(fo);
+	text_buffer_cancel_pending(buffer);
+	if (entry->buffer) {
+		text_buffer_set_raster(buffer, entry->buffer, buffer->scale);
+	}
+}
+
+static void render_backing_buffer(struct text_buffer *buffer) {
+	if (!buffer->visible) {
+		return;
+	}
+
+	text_buffer_cancel_pending(buffer);
+	if (buffer->props.max_width == 0) {
+		wlr_scene_buffer_set_buffer(buffer->buffer_node, NULL);
+		return;
+	}
+
+	// The source box crops the raster down to max_width
+	buffer->raster_width = get_raster_width(buffer);
+	struct wsm_text_raster raster = {
+		.text = buffer->text,
+		.font = global_server.desktop_interface->font_description,
+		.scale = buffer->scale,
+		.subpixel = buffer->subpixel,
+		.width = buffer->raster_width,
+		.height = buffer->props.height,
+		.baseline_offset = global_server.desktop_interface->font_baseline -
+			buffer->props.baseline,
+		.markup = buffer->props.pango_markup,
+	};
+	memcpy(raster.color, buffer->props.color, sizeof(raster.color));
+	memcpy(raster.background, buffer->props.background, sizeof(raster.background));
+
+	struct wsm_text_cache_entry *entry = wsm_text_cache_get(&raster);
+	if (!entry) {
+		return;
+	}
+
+	// The current raster stays up until the new one is rendered
+	if (entry->pending) {
+		buffer->pending_entry = entry;
+		wl_signal_add(&entry->events.ready, &buffer->entry_ready);
+		return;
+	}
+
+	text_buffer_set_raster(buffer, entry->buffer, buffer->scale);
 }
 
 static void handle_outputs_update(struct wl_listener *listener, void *data) {
@@ -201,6 +201,7 @@ static void handle_destroy(struct wl_listener *listener, void *data) {
 
 	wl_list_remove(&buffer->outputs_update.link);
 	wl_list_remove(&buffer->destroy.link);
+	text_buffer_cancel_pending(buffer);
 
 	free(buffer->text);
 	free(buffer);
@@ -208,16 +209,8 @@ static void handle_destroy(struct wl_listener *listener, void *data) {
 
 static void text_calc_size(struct text_buffer *buffer) {
 	struct wsm_text_node *props = &buffer->props;
-	cairo_t *c = cairo_create(NULL);
-	if (!c) {
-		wsm_log(WSM_ERROR, "cairo_t allocation failed");
-		return;
-	}
-
-	cairo_set_antialias(c, CAIRO_ANTIALIAS_BEST);
-	get_text_size(c, global_server.desktop_interface->font_description, &props->width, NULL,
-		&props->baseline, 1, props->pango_markup, "%s", buffer->text);
-	cairo_destroy(c);
+	wsm_text_cache_measure(global_server.desktop_interface->font_description,
+		buffer->text, props->pango_markup, &props->width, NULL, &props->baseline);
 
 	wlr_scene_buffer_set_dest_size(buffer->buffer_node,
 		get_text_width(props), props->height);
@@ -257,6 +250,8 @@ struct wsm_text_node *wsm_text_node_create(struct wlr_scene_tree *parent,
 	wl_signal_add(&node->node.events.destroy, &buffer->destroy);
 	buffer->outputs_update.notify = handle_outputs_update;
 	wl_signal_add(&node->events.outputs_update, &buffer->outputs_update);
+	buffer->entry_ready.notify = handle_entry_ready;
+	wl_list_init(&buffer->entry_ready.link);
 
 	text_calc_size(buffer);
 
@@ -297,11 +292,16 @@ void wsm_text_node_set_max_width(struct wsm_text_node *node, int max_width) {
 	if (max_width == buffer->props.max_width) {
 		return;
 	}
+	bool was_hidden = buffer->props.max_width == 0 || !buffer->buffer_node->buffer;
 	buffer->props.max_width = max_width;
 	wlr_scene_buffer_set_dest_size(buffer->buffer_node,
 		get_text_width(&buffer->props), buffer->props.height);
 	update_source_box(buffer);
-	render_backing_buffer(buffer);
+	// The raster only changes when max_width crosses a step
+	if (was_hidden || max_width == 0 ||
+			get_raster_width(buffer) != buffer->raster_width) {
+		render_backing_buffer(buffer);
+	}
 }
 
 void wsm_text_node_set_background(struct wsm_text_node *node, float background[4]) {
@@ -0,0 +1,84 @@
+#include "wsm_damage.h"
+#include "wsm_log.h"
+#include "wsm_config.h"
+
+#include <stdlib.h>
+
+uint64_t wsm_region_area(const pixman_region32_t *region) {
+	int nrects;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles((pixman_region32_t *)region, &nrects);
+	uint64_t area = 0;
+	for (int i = 0; i < nrects; ++i) {
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+static uint64_t box_area(const pixman_box32_t *box) {
+	return (uint64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static int snap_down(int value, int tile) {
+	return value >= 0 ? value / tile * tile : -((-value + tile - 1) / tile * tile);
+}
+
+static int snap_up(int value, int tile) {
+	return -snap_down(-value, tile);
+}
+
+static void damage_to_bounding_box(pixman_region32_t *damage) {
+	pixman_box32_t extents = *pixman_region32_extents(damage);
+	pixman_region32_fini(damage);
+	pixman_region32_init_rect(damage, extents.x1, extents.y1,
+		extents.x2 - extents.x1, extents.y2 - extents.y1);
+}
+
+static void damage_to_tiles(pixman_region32_t *damage, int tile) {
+	int nrects;
+	const pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	pixman_box32_t *tiles = malloc(nrects * sizeof(*tiles));
+	if (!tiles) {
+		wsm_log(WSM_ERROR, "Could not create damage tiles: allocation failed!");
+		damage_to_bounding_box(damage);
+		return;
+	}
+
+	for (int i = 0; i < nrects; ++i) {
+		tiles[i] = (pixman_box32_t){
+			.x1 = snap_down(rects[i].x1, tile),
+			.y1 = snap_down(rects[i].y1, tile),
+			.x2 = snap_up(rects[i].x2, tile),
+			.y2 = snap_up(rects[i].y2, tile),
+		};
+	}
+
+	pixman_region32_fini(damage);
+	pixman_region32_init_rects(damage, tiles, nrects);
+	free(tiles);
+}
+
+uint64_t wsm_damage_simplify(pixman_region32_t *damage, int width, int height) {
+	enum wsm_damage_policy policy = global_config.damage_policy;
+	if (policy == WSM_DAMAGE_POLICY_NONE ||
+			pixman_region32_n_rects(damage) <= global_config.damage_max_rects) {
+		return 0;
+	}
+
+	uint64_t area = wsm_region_area(damage);
+	if (policy == WSM_DAMAGE_POLICY_AUTO) {
+		// a sparse bounding box would repaint mostly undamaged pixels
+		uint64_t bounding = box_area(pixman_region32_extents(damage));
+		policy = bounding - area <= bounding * global_config.damage_max_waste ?
+			WSM_DAMAGE_POLICY_BOUNDING_BOX : WSM_DAMAGE_POLICY_TILES;
+	}
+
+	if (policy == WSM_DAMAGE_POLICY_TILES && global_config.damage_tile_size > 1) {
+		damage_to_tiles(damage, global_config.damage_tile_size);
+		pixman_region32_intersect_rect(damage, damage, 0, 0, width, height);
+	} else {
+		damage_to_bounding_box(damage);
+	}
+
+	return wsm_region_area(damage) - area;
+}
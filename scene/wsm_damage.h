@@ -0,0 +1,28 @@
+#ifndef WSM_DAMAGE_H
+#define WSM_DAMAGE_H
+
+#include <stdint.h>
+
+#include <pixman.h>
+
+/**
+ * @brief wsm_region_area number of pixels covered by a region
+ */
+uint64_t wsm_region_area(const pixman_region32_t *region);
+
+/**
+ * @brief wsm_damage_simplify trade overdraw for fewer rectangles, following
+ * the damage policy of the config
+ *
+ * @details Many small damaged rectangles, like blinking cursors in a dozen
+ * terminals, make every later region operation and every clipped draw call
+ * slower. Once a region has more than damage_max_rects rectangles it is
+ * replaced by its bounding box or snapped to a grid of damage_tile_size
+ * pixel tiles, which pixman merges back into a few bands. The result always
+ * contains the original region and stays within width x height.
+ *
+ * @return pixels added to the region
+ */
+uint64_t wsm_damage_simplify(pixman_region32_t *damage, int width, int height);
+
+#endif
@@ -7,11 +7,16 @@
 #include "wsm_common.h"
 #include "wsm_input_manager.h"
 #include "node/wsm_node_descriptor.h"
+#include "effects/wsm_effect.h"
+#include "effects/wsm_effects_manager.h"
 #include "wsm_output_manager.h"
 #include "wsm_workspace.h"
 #include "wsm_arrange.h"
+#include "wsm_config.h"
+#include "wsm_damage.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <drm_fourcc.h>
@@ -22,9 +27,14 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/render/swapchain.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output_layer.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
 
 #define HIGHLIGHT_DAMAGE_FADEOUT_TIME 250
+#define PLANES_FAILED_EXPIRE_FRAMES 300
+#define PLANE_DAMAGE_MAX_RECTS 16
 
 struct render_data {
 	pixman_region32_t damage;
@@ -34,6 +44,7 @@ struct render_data {
 	enum wl_output_transform transform;
 	float scale;
 	int trans_width, trans_height;
+	struct wsm_effect_output_data *effects; // NULL when effects are skipped
 };
 
 struct render_list_constructor_data {
@@ -47,8 +58,13 @@ struct render_list_constructor_data {
 struct render_list_entry {
 	struct wlr_scene_node *node;
 	int x, y;
-	bool sent_dmabuf_feedback;
 	bool highlight_transparent_region;
+	bool on_plane;
+
+	// render list cache validation, see render_list_cache_valid()
+	struct wsm_output *output;
+	struct wl_listener node_destroy;
+	int width, height;
 };
 
 struct highlight_region {
@@ -110,10 +126,20 @@ struct wsm_scene *wsm_scene_create(const struct wsm_server* server) {
 	scene->outputs = create_list();
 	scene->non_desktop_outputs = create_list();
 	scene->scratchpad = create_list();
+	scene->dirty_configs = create_list();
+	scene->dirty_buffers = create_list();
+	scene->config_dirty = true;
 
 	return scene;
 }
 
+void wsm_scene_mark_config_dirty(struct wsm_scene *root) {
+	root->config_dirty = true;
+}
+
+static void scene_output_planes_commit_failed(
+	struct wlr_scene_output *scene_output, const struct wlr_output_state *state);
+
 bool wsm_scene_output_commit(struct wlr_scene_output *scene_output,
 		const struct wlr_scene_output_state_options *options) {
 	if (!scene_output->output->needs_frame && !pixman_region32_not_empty(
@@ -129,7 +155,19 @@ bool wsm_scene_output_commit(struct wlr_scene_output *scene_output,
 	}
 
 	ok = wlr_output_commit_state(scene_output->output, &state);
+	if (!ok && state.tearing_page_flip) {
+		// the test passed, but the flip did not, better late than nothing
+		state.tearing_page_flip = false;
+		ok = wlr_output_commit_state(scene_output->output, &state);
+	}
+	if (ok && state.tearing_page_flip) {
+		struct wsm_output *output = scene_output->output->data;
+		if (output) {
+			output->stats.tearing_commits++;
+		}
+	}
 	if (!ok) {
+		scene_output_planes_commit_failed(scene_output, &state);
 		goto out;
 	}
 
@@ -315,32 +353,456 @@ static bool array_realloc(struct wl_array *arr, size_t size) {
 	return true;
 }
 
-static void scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
+static void render_list_cache_untrack(struct wsm_output *output) {
+	if (!output->render_list_tracked) {
+		return;
+	}
+
+	struct render_list_entry *entry;
+	wl_array_for_each(entry, &output->render_list) {
+		wl_list_remove(&entry->node_destroy.link);
+	}
+	output->render_list_tracked = false;
+}
+
+static void render_list_entry_handle_node_destroy(struct wl_listener *listener,
+		void *data) {
+	struct render_list_entry *entry =
+		wl_container_of(listener, entry, node_destroy);
+	struct wsm_output *output = entry->output;
+
+	// Drop every listener now, the cached node pointers are no longer trusted
+	render_list_cache_untrack(output);
+	output->render_list_valid = false;
+}
+
+static void render_list_cache_track(struct wsm_output *output,
+		const struct wlr_box *box, float scale) {
+	struct render_list_entry *entry;
+	wl_array_for_each(entry, &output->render_list) {
+		entry->output = output;
+		scene_node_get_size(entry->node, &entry->width, &entry->height);
+		entry->node_destroy.notify = render_list_entry_handle_node_destroy;
+		wl_signal_add(&entry->node->events.destroy, &entry->node_destroy);
+	}
+
+	output->render_list_tracked = true;
+	output->render_list_valid = true;
+	output->render_list_box = *box;
+	output->render_list_scale = scale;
+	output->render_list_generation = global_server.scene->render_generation;
+}
+
+struct scene_buffer_tracker {
+	struct wlr_addon addon;
+	struct wlr_scene_buffer *buffer;
+	struct wl_listener output_enter;
+	struct wl_listener output_leave;
+	struct wl_listener outputs_update;
+	struct wl_listener surface_precommit; // only for scene surfaces
+	struct wl_listener surface_commit; // only for scene surfaces
+	int dst_width, dst_height; // as of the last scale filter update
+	pixman_region32_t opaque_region; // as of the last clip
+	uint64_t commits; // of the surface, for backdrop buffers updated in place
+	pixman_region32_t damage; // of the surface since the last plane assignment
+	pixman_region32_t plane_damage; // handed to the plane of the pending commit
+};
+
+/**
+ * The scale filter depends on the destination size and the primary output of
+ * the buffer, which change without any arrange.
+ */
+static void scene_buffer_tracker_mark_config_dirty(struct scene_buffer_tracker *tracker) {
+	struct wsm_scene *root = global_server.scene;
+	tracker->dst_width = tracker->buffer->dst_width;
+	tracker->dst_height = tracker->buffer->dst_height;
+	if (list_find(root->dirty_buffers, tracker->buffer) == -1) {
+		list_add(root->dirty_buffers, tracker->buffer);
+	}
+}
+
+static void scene_buffer_tracker_handle_output_enter(struct wl_listener *listener,
+		void *data) {
+	struct scene_buffer_tracker *tracker =
+		wl_container_of(listener, tracker, output_enter);
+
+	// The buffer was not on this output before, so no cached list holds it
+	wsm_scene_invalidate_render_lists(global_server.scene);
+	scene_buffer_tracker_mark_config_dirty(tracker);
+}
+
+static void scene_buffer_tracker_handle_output_leave(struct wl_listener *listener,
+		void *data) {
+	struct scene_buffer_tracker *tracker =
+		wl_container_of(listener, tracker, output_leave);
+	scene_buffer_tracker_mark_config_dirty(tracker);
+}
+
+static void scene_buffer_tracker_handle_outputs_update(struct wl_listener *listener,
+		void *data) {
+	struct scene_buffer_tracker *tracker =
+		wl_container_of(listener, tracker, outputs_update);
+	scene_buffer_tracker_mark_config_dirty(tracker);
+}
+
+/**
+ * Effects drop the rounded corners and what the clip region drops from the
+ * opaque region, so what is below them keeps being rendered.
+ */
+static void scene_buffer_tracker_clip_opaque_region(struct scene_buffer_tracker *tracker,
+		struct wlr_surface *surface) {
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	wsm_surface_effect_opaque_region(surface, &opaque);
+	if (!pixman_region32_equal(&opaque, &tracker->opaque_region)) {
+		// nodes below the dropped part may now be visible
+		wsm_scene_invalidate_render_lists(global_server.scene);
+		pixman_region32_copy(&tracker->opaque_region, &opaque);
+	}
+	wlr_scene_buffer_set_opaque_region(tracker->buffer, &opaque);
+	pixman_region32_fini(&opaque);
+}
+
+static void scene_buffer_tracker_handle_surface_precommit(struct wl_listener *listener,
+		void *data) {
+	struct scene_buffer_tracker *tracker =
+		wl_container_of(listener, tracker, surface_precommit);
+	struct wlr_surface *surface = data;
+	if (!wsm_surface_effect_from_wlr_surface(surface)) {
+		return;
+	}
+
+	// Runs before the scene surface listener: the region it is about to set
+	// is already in place, so only the clipped one is set, once, after it
+	pixman_region32_copy(&tracker->buffer->opaque_region, &surface->opaque_region);
+}
+
+static void scene_buffer_tracker_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct scene_buffer_tracker *tracker =
+		wl_container_of(listener, tracker, surface_commit);
+	struct wlr_scene_buffer *buffer = tracker->buffer;
+
+	struct wlr_surface *surface = data;
+	scene_buffer_tracker_clip_opaque_region(tracker, surface);
+	tracker->commits++;
+
+	// buffer coordinates, as planes want it
+	pixman_region32_union(&tracker->damage, &tracker->damage, &surface->buffer_damage);
+	if (pixman_region32_n_rects(&tracker->damage) > PLANE_DAMAGE_MAX_RECTS) {
+		pixman_box32_t *extents = pixman_region32_extents(&tracker->damage);
+		pixman_region32_reset(&tracker->damage, extents);
+	}
+
+	if (buffer->dst_width != tracker->dst_width ||
+			buffer->dst_height != tracker->dst_height) {
+		scene_buffer_tracker_mark_config_dirty(tracker);
+	}
+}
+
+static void scene_buffer_tracker_handle_destroy(struct wlr_addon *addon) {
+	struct scene_buffer_tracker *tracker = wl_container_of(addon, tracker, addon);
+	struct wsm_list *dirty_buffers = global_server.scene->dirty_buffers;
+	int index = list_find(dirty_buffers, tracker->buffer);
+	if (index != -1) {
+		list_del(dirty_buffers, index);
+	}
+
+	wl_list_remove(&tracker->output_enter.link);
+	wl_list_remove(&tracker->output_leave.link);
+	wl_list_remove(&tracker->outputs_update.link);
+	wl_list_remove(&tracker->surface_precommit.link);
+	wl_list_remove(&tracker->surface_commit.link);
+	pixman_region32_fini(&tracker->opaque_region);
+	pixman_region32_fini(&tracker->damage);
+	pixman_region32_fini(&tracker->plane_damage);
+	wlr_addon_finish(&tracker->addon);
+	free(tracker);
+}
+
+static const struct wlr_addon_interface scene_buffer_tracker_impl = {
+	.name = "wsm_scene_buffer_tracker",
+	.destroy = scene_buffer_tracker_handle_destroy,
+};
+
+static void scene_track_buffers(struct wlr_scene_node *node) {
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &tree->children, link) {
+			scene_track_buffers(child);
+		}
+		return;
+	} else if (node->type != WLR_SCENE_NODE_BUFFER ||
+			wlr_addon_find(&node->addons, NULL, &scene_buffer_tracker_impl)) {
+		return;
+	}
+
+	struct scene_buffer_tracker *tracker = calloc(1, sizeof(*tracker));
+	if (!tracker) {
+		wsm_log(WSM_ERROR, "Could not create scene_buffer_tracker: allocation failed!");
+		return;
+	}
+
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	wlr_addon_init(&tracker->addon, &node->addons, NULL, &scene_buffer_tracker_impl);
+	tracker->buffer = buffer;
+	tracker->dst_width = buffer->dst_width;
+	tracker->dst_height = buffer->dst_height;
+	pixman_region32_init(&tracker->opaque_region);
+	pixman_region32_copy(&tracker->opaque_region, &buffer->opaque_region);
+	pixman_region32_init(&tracker->damage);
+	pixman_region32_init(&tracker->plane_damage);
+	tracker->output_enter.notify = scene_buffer_tracker_handle_output_enter;
+	wl_signal_add(&buffer->events.output_enter, &tracker->output_enter);
+	tracker->output_leave.notify = scene_buffer_tracker_handle_output_leave;
+	wl_signal_add(&buffer->events.output_leave, &tracker->output_leave);
+	tracker->outputs_update.notify = scene_buffer_tracker_handle_outputs_update;
+	wl_signal_add(&buffer->events.outputs_update, &tracker->outputs_update);
+
+	// Rounded corners must not hide what is below them
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (scene_surface) {
+		struct wl_signal *commit = &scene_surface->surface->events.commit;
+		tracker->surface_precommit.notify = scene_buffer_tracker_handle_surface_precommit;
+		wl_list_insert(&commit->listener_list, &tracker->surface_precommit.link);
+		tracker->surface_commit.notify = scene_buffer_tracker_handle_surface_commit;
+		wl_signal_add(commit, &tracker->surface_commit);
+		scene_buffer_tracker_clip_opaque_region(tracker, scene_surface->surface);
+	} else {
+		wl_list_init(&tracker->surface_precommit.link);
+		wl_list_init(&tracker->surface_commit.link);
+	}
+}
+
+static void scale_output_damage(pixman_region32_t *damage, float scale) {
+	wlr_region_scale(damage, damage, scale);
+
+	if (floor(scale) != scale) {
+		wlr_region_expand(damage, damage, 1);
+	}
+}
+
+static void scene_buffer_damage_outputs(struct wlr_scene_buffer *buffer) {
+	int lx, ly;
+	if (!wlr_scene_node_coords(&buffer->node, &lx, &ly)) {
+		return;
+	}
+
+	int width, height;
+	scene_node_get_size(&buffer->node, &width, &height);
+
+	struct wlr_scene_output *scene_output;
+	wl_list_for_each(scene_output, &global_server.scene->root_scene->outputs, link) {
+		if (!(buffer->active_outputs & (1ull << scene_output->index))) {
+			continue;
+		}
+
+		pixman_region32_t damage;
+		pixman_region32_init_rect(&damage, lx - scene_output->x,
+			ly - scene_output->y, width, height);
+		scale_output_damage(&damage, scene_output->output->scale);
+		wlr_damage_ring_add(&scene_output->damage_ring, &damage);
+		pixman_region32_fini(&damage);
+		wlr_output_schedule_frame(scene_output->output);
+	}
+}
+
+static void scene_surface_effect_changed(struct wlr_scene_node *node,
+		struct wlr_surface *surface) {
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &tree->children, link) {
+			scene_surface_effect_changed(child, surface);
+		}
+		return;
+	} else if (node->type != WLR_SCENE_NODE_BUFFER) {
+		return;
+	}
+
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (!scene_surface || scene_surface->surface != surface) {
+		return;
+	}
+
+	// Buffers not hooked yet are clipped once they are
+	struct wlr_addon *addon =
+		wlr_addon_find(&node->addons, NULL, &scene_buffer_tracker_impl);
+	if (addon) {
+		struct scene_buffer_tracker *tracker = wl_container_of(addon, tracker, addon);
+		scene_buffer_tracker_clip_opaque_region(tracker, surface);
+	}
+
+	// Effects are drawn within the surface, border included
+	scene_buffer_damage_outputs(buffer);
+}
+
+void wsm_scene_surface_effect_changed(struct wsm_scene *root,
+		struct wlr_surface *surface) {
+	scene_surface_effect_changed(&root->root_scene->tree.node, surface);
+}
+
+static int scene_node_depth(struct wlr_scene_node *node) {
+	int depth = 0;
+	for (struct wlr_scene_tree *tree = node->parent; tree; tree = tree->node.parent) {
+		depth++;
+	}
+	return depth;
+}
+
+/**
+ * Whether above is drawn over below: their ancestors under the closest common
+ * tree are compared, later children being on top.
+ */
+static bool scene_node_is_above(struct wlr_scene_node *above,
+		struct wlr_scene_node *below) {
+	int above_depth = scene_node_depth(above);
+	int below_depth = scene_node_depth(below);
+	for (; above_depth > below_depth; above_depth--) {
+		above = &above->parent->node;
+	}
+	for (; below_depth > above_depth; below_depth--) {
+		below = &below->parent->node;
+	}
+	if (above == below) {
+		return false;
+	}
+	while (above->parent != below->parent) {
+		above = &above->parent->node;
+		below = &below->parent->node;
+	}
+
+	struct wl_list *children = &below->parent->children;
+	for (struct wl_list *link = below->link.next; link != children; link = link->next) {
+		if (link == &above->link) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * The render list is reused as long as the scene did not change in a way
+ * which could add, remove or reorder entries. Every scene buffer, enabled or
+ * not, gets an output_enter listener, so buffers which are moved, enabled or
+ * uncovered on an output bump the scene render generation whoever moved them.
+ * Buffers created after the last walk are hooked once their surface maps,
+ * which bumps the generation as well. The same hook clips the opaque region
+ * of scene surfaces to their effects. Destroyed nodes drop the cache through
+ * their destroy listener and changes to the cached nodes themselves,
+ * including their stacking order since reparenting and restacking emit
+ * nothing, are checked here, which is proportional to the number of entries
+ * rather than to the scene size.
+ */
+static bool render_list_cache_valid(struct wsm_output *output,
+		const struct render_list_constructor_data *list_con, float scale) {
+	if (!output->render_list_valid ||
+			output->render_list_generation != global_server.scene->render_generation ||
+			output->render_list_scale != scale ||
+			!wlr_box_equal(&output->render_list_box, &list_con->box)) {
+		return false;
+	}
+
+	// entries go from the topmost node down
+	struct wlr_scene_node *prev = NULL;
+	struct render_list_entry *entry;
+	wl_array_for_each(entry, &output->render_list) {
+		struct wlr_scene_node *node = entry->node;
+		int x, y, width, height;
+		if (!wlr_scene_node_coords(node, &x, &y) ||
+				x != entry->x || y != entry->y) {
+			return false;
+		}
+
+		scene_node_get_size(node, &width, &height);
+		if (width != entry->width || height != entry->height ||
+				scene_node_invisible(node)) {
+			return false;
+		}
+
+		if (prev && !scene_node_is_above(prev, node)) {
+			return false;
+		}
+		prev = node;
+
+		entry->on_plane = false;
+	}
+
+	return true;
+}
+
+void wsm_scene_invalidate_render_lists(struct wsm_scene *root) {
+	root->render_generation++;
+}
+
+static bool scene_node_is_descendant(struct wlr_scene_node *node,
+		struct wlr_scene_node *ancestor) {
+	for (; node; node = node->parent ? &node->parent->node : NULL) {
+		if (node == ancestor) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * A moved node keeps its place in the stacking order, so the cached entries
+ * only need its new coordinates. What it uncovers or brings onto another
+ * output comes in through output_enter, as for any other node.
+ */
+void wsm_scene_render_lists_node_moved(struct wsm_scene *root,
+		struct wlr_scene_node *node) {
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct wsm_output *output = root->outputs->items[i];
+		if (!output->render_list_valid) {
+			continue;
+		}
+
+		struct render_list_entry *entry;
+		wl_array_for_each(entry, &output->render_list) {
+			if (scene_node_is_descendant(entry->node, node)) {
+				wlr_scene_node_coords(entry->node, &entry->x, &entry->y);
+			}
+		}
+	}
+}
+
+void wsm_scene_output_release_render_list(struct wsm_output *output) {
+	render_list_cache_untrack(output);
+	output->render_list_valid = false;
+	wl_array_release(&output->render_list);
+	wl_array_init(&output->render_list);
+}
+
+static bool scene_buffer_send_dmabuf_feedback(const struct wlr_scene *scene,
 		struct wlr_scene_buffer *scene_buffer,
 		const struct wlr_linux_dmabuf_feedback_v1_init_options *options) {
 	if (!scene->linux_dmabuf_v1) {
-		return;
+		return false;
 	}
 
 	struct wlr_scene_surface *surface = wlr_scene_surface_try_from_buffer(scene_buffer);
 	if (!surface) {
-		return;
+		return false;
 	}
 
 	if (memcmp(options, &scene_buffer->prev_feedback_options, sizeof(*options)) == 0) {
-		return;
+		return false;
 	}
 
 	scene_buffer->prev_feedback_options = *options;
 	struct wlr_linux_dmabuf_feedback_v1 feedback = {0};
 	if (!wlr_linux_dmabuf_feedback_v1_init_with_options(&feedback, options)) {
-		return;
+		return false;
 	}
 
 	wlr_linux_dmabuf_v1_set_surface_feedback(scene->linux_dmabuf_v1,
 		surface->surface, &feedback);
 
 	wlr_linux_dmabuf_feedback_v1_finish(&feedback);
+	return true;
 }
 
 static void transform_output_damage(pixman_region32_t *damage, const struct render_data *data) {
@@ -363,6 +825,21 @@ static void output_state_apply_damage(const struct render_data *data,
 	wlr_output_state_set_damage(state, &output->pending_commit_damage);
 }
 
+static bool scene_buffer_wants_tearing(struct wlr_scene_buffer *buffer) {
+	if (!global_config.allow_tearing || !global_server.tearing_control_manager_v1) {
+		return false;
+	}
+
+	struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+	if (!scene_surface) {
+		return false;
+	}
+
+	return wlr_tearing_control_manager_v1_surface_hint_from_surface(
+		global_server.tearing_control_manager_v1, scene_surface->surface) ==
+		WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
+}
+
 static bool scene_entry_try_direct_scanout(struct render_list_entry *entry,
 		struct wlr_output_state *state, const struct render_data *data) {
 	struct wlr_scene_output *scene_output = data->output;
@@ -415,16 +892,6 @@ static bool scene_entry_try_direct_scanout(struct render_list_entry *entry,
 		return false;
 	}
 
-	if (buffer->primary_output == scene_output) {
-		struct wlr_linux_dmabuf_feedback_v1_init_options options = {
-			.main_renderer = scene_output->output->renderer,
-			.scanout_primary_output = scene_output->output,
-		};
-
-		scene_buffer_send_dmabuf_feedback(scene_output->scene, buffer, &options);
-		entry->sent_dmabuf_feedback = true;
-	}
-
 	struct wlr_output_state pending;
 	wlr_output_state_init(&pending);
 	if (!wlr_output_state_copy(&pending, state)) {
@@ -432,12 +899,25 @@ static bool scene_entry_try_direct_scanout(struct render_list_entry *entry,
 	}
 
 	wlr_output_state_set_buffer(&pending, buffer->buffer);
+	// the display waits for the client's acquire point, not the compositor
+	if (buffer->wait_timeline != NULL) {
+		wlr_output_state_set_wait_timeline(&pending, buffer->wait_timeline,
+			buffer->wait_point);
+	}
 
 	if (!wlr_output_test_state(scene_output->output, &pending)) {
 		wlr_output_state_finish(&pending);
 		return false;
 	}
 
+	// tearing is only possible for a buffer scanned out on its own
+	if (scene_buffer_wants_tearing(buffer)) {
+		pending.tearing_page_flip = true;
+		if (!wlr_output_test_state(scene_output->output, &pending)) {
+			pending.tearing_page_flip = false;
+		}
+	}
+
 	wlr_output_state_copy(state, &pending);
 	wlr_output_state_finish(&pending);
 
@@ -512,14 +992,6 @@ static void scene_buffer_set_texture(struct wlr_scene_buffer *scene_buffer,
 	}
 }
 
-static void scale_output_damage(pixman_region32_t *damage, float scale) {
-	wlr_region_scale(damage, damage, scale);
-
-	if (floor(scale) != scale) {
-		wlr_region_expand(damage, damage, 1);
-	}
-}
-
 static int scale_length(int length, int offset, float scale) {
 	return round((offset + length) * scale) - round(offset * scale);
 }
@@ -623,6 +1095,18 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			wlr_output_transform_invert(scene_buffer->transform);
 		transform = wlr_output_transform_compose(transform, data->transform);
 
+		struct wsm_effect_window_data window_data = {
+			.output = data->effects,
+			.scene_buffer = scene_buffer,
+			.dst_box = dst_box,
+			.clip = &render_region,
+		};
+		if (data->effects) {
+			window_data.features = wsm_effects_window_features(scene_buffer,
+				&window_data.surface_effect);
+		}
+
+		wsm_effects_pre_render_window(&window_data);
 		wlr_render_pass_add_texture(data->render_pass, &(struct wlr_render_texture_options) {
 			.texture = texture,
 			.src_box = scene_buffer->src_box,
@@ -633,7 +1117,11 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 			.filter_mode = scene_buffer->filter_mode,
 			.blend_mode = pixman_region32_not_empty(&opaque) ?
 				WLR_RENDER_BLEND_MODE_PREMULTIPLIED : WLR_RENDER_BLEND_MODE_NONE,
+			.wait_timeline = scene_buffer->wait_timeline,
+			.wait_point = scene_buffer->wait_point,
 		});
+		wsm_effects_render_window(&window_data);
+		wsm_effects_post_render_window(&window_data);
 
 		struct wlr_scene_output_sample_event sample_event = {
 			.output = data->output,
@@ -656,6 +1144,612 @@ static void scene_entry_render(struct render_list_entry *entry, const struct ren
 	pixman_region32_fini(&render_region);
 }
 
+static bool scene_entry_plane_candidate(struct render_list_entry *entry,
+		const struct render_data *data) {
+	struct wlr_scene_node *node = entry->node;
+	if (node->type != WLR_SCENE_NODE_BUFFER) {
+		return false;
+	}
+
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	if (buffer->buffer == NULL || buffer->opacity != 1) {
+		return false;
+	}
+
+	// Effects are drawn by the compositor around the buffer
+	if (wsm_effects_window_features(buffer, NULL)) {
+		return false;
+	}
+
+	// Layer states cannot carry an acquire point, the buffer may not be ready
+	if (buffer->wait_timeline != NULL) {
+		return false;
+	}
+
+	// Planes can neither rotate nor blend with an alpha multiplier
+	if (buffer->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+			data->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
+
+	struct wlr_dmabuf_attributes attribs;
+	return wlr_buffer_get_dmabuf(buffer->buffer, &attribs);
+}
+
+/**
+ * The damage of a plane is relative to the buffer it showed last, so it is
+ * only known when the same scene surface stays on the same plane.
+ */
+static const pixman_region32_t *scene_entry_plane_damage(struct render_list_entry *entry,
+		bool same_plane) {
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+	struct wlr_addon *addon =
+		wlr_addon_find(&entry->node->addons, NULL, &scene_buffer_tracker_impl);
+	if (!same_plane || !addon || !wlr_scene_surface_try_from_buffer(buffer)) {
+		return NULL;
+	}
+
+	struct scene_buffer_tracker *tracker = wl_container_of(addon, tracker, addon);
+	pixman_region32_copy(&tracker->plane_damage, &tracker->damage);
+	return &tracker->plane_damage;
+}
+
+static void scene_entry_plane_damage_sent(struct render_list_entry *entry) {
+	struct wlr_addon *addon =
+		wlr_addon_find(&entry->node->addons, NULL, &scene_buffer_tracker_impl);
+	if (addon) {
+		struct scene_buffer_tracker *tracker = wl_container_of(addon, tracker, addon);
+		pixman_region32_clear(&tracker->damage);
+	}
+}
+
+static void scene_entry_plane_state(struct render_list_entry *entry,
+		struct wlr_output_layer_state *layer_state, const struct render_data *data,
+		bool same_plane) {
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+
+	struct wlr_box dst_box = {
+		.x = entry->x - data->logical.x,
+		.y = entry->y - data->logical.y,
+	};
+	scene_node_get_size(entry->node, &dst_box.width, &dst_box.height);
+	scale_box(&dst_box, data->scale);
+
+	struct wlr_fbox src_box = buffer->src_box;
+	if (wlr_fbox_empty(&src_box)) {
+		src_box = (struct wlr_fbox){
+			.width = buffer->buffer->width,
+			.height = buffer->buffer->height,
+		};
+	}
+
+	layer_state->buffer = buffer->buffer;
+	layer_state->src_box = src_box;
+	layer_state->dst_box = dst_box;
+	layer_state->damage = scene_entry_plane_damage(entry, same_plane);
+	layer_state->accepted = false;
+}
+
+static void scene_output_planes_disable(struct wsm_output *output,
+		struct wlr_output_state *state) {
+	if (output->planes_len == 0) {
+		return;
+	}
+
+	for (int i = 0; i < WSM_OUTPUT_PLANES_MAX; i++) {
+		output->plane_states[i] = (struct wlr_output_layer_state){
+			.layer = output->planes[i],
+		};
+	}
+	wlr_output_state_set_layers(state, output->plane_states, WSM_OUTPUT_PLANES_MAX);
+}
+
+/**
+ * A rejected set is only remembered for a while: the failed nodes are raw
+ * pointers which new nodes may reuse, and the hardware may accept it later
+ * with other planes or buffers in use. Modesets drop it as well, see
+ * handle_commit() in wsm_output.c.
+ */
+static bool scene_output_planes_failed_before(struct wsm_output *output,
+		struct render_list_entry **candidates, int candidates_len) {
+	if (output->plane_failed_len > 0 &&
+			++output->plane_failed_frames > PLANES_FAILED_EXPIRE_FRAMES) {
+		output->plane_failed_len = 0;
+	}
+
+	if (output->plane_failed_len != candidates_len) {
+		return false;
+	}
+
+	for (int i = 0; i < candidates_len; i++) {
+		if (output->plane_failed_nodes[i] != candidates[i]->node) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void scene_output_planes_set_failed(struct wsm_output *output,
+		struct render_list_entry **candidates, int candidates_len) {
+	for (int i = 0; i < candidates_len; i++) {
+		output->plane_failed_nodes[i] = candidates[i]->node;
+	}
+	output->plane_failed_len = candidates_len;
+	output->plane_failed_frames = 0;
+}
+
+/**
+ * Plane assignment stage: walk the render list from the top and pick client
+ * dmabufs which can be scanned out from an overlay plane. A candidate must not
+ * be covered by anything left for compositing, since planes are stacked above
+ * the primary buffer. The assignment is all-or-nothing: if the test commit
+ * fails or a plane is not accepted, everything is composited and that
+ * candidate set is not retried until it changes or expires. Planes get the
+ * damage of their surface when they keep showing it, and what they cover is
+ * dropped from the damage of the primary buffer.
+ *
+ * Returns the number of render list entries moved onto planes.
+ */
+static int scene_output_assign_planes(struct wlr_scene_output *scene_output,
+		struct render_list_entry *list_data, int list_len,
+		struct wlr_output_state *state, const struct render_data *data) {
+	struct wsm_output *output = scene_output->output->data;
+	if (!output) {
+		return 0;
+	}
+
+	if (!scene_output->scene->direct_scanout ||
+			(state->committed & (WLR_OUTPUT_STATE_MODE |
+			WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_RENDER_FORMAT)) ||
+			!wlr_output_is_direct_scanout_allowed(scene_output->output)) {
+		goto disable;
+	}
+
+	struct render_list_entry *candidates[WSM_OUTPUT_PLANES_MAX];
+	int candidates_len = 0;
+
+	pixman_region32_t composited;
+	pixman_region32_init(&composited);
+	for (int i = 0; i < list_len && candidates_len < WSM_OUTPUT_PLANES_MAX; i++) {
+		struct render_list_entry *entry = &list_data[i];
+		pixman_box32_t box = { .x1 = entry->x, .y1 = entry->y };
+		int width, height;
+		scene_node_get_size(entry->node, &width, &height);
+		box.x2 = box.x1 + width;
+		box.y2 = box.y1 + height;
+
+		if (scene_entry_plane_candidate(entry, data) &&
+				pixman_region32_contains_rectangle(&composited, &box) == PIXMAN_REGION_OUT) {
+			candidates[candidates_len++] = entry;
+			continue;
+		}
+
+		pixman_region32_union_rect(&composited, &composited,
+			box.x1, box.y1, width, height);
+	}
+	pixman_region32_fini(&composited);
+
+	if (candidates_len == 0 ||
+			scene_output_planes_failed_before(output, candidates, candidates_len)) {
+		goto disable;
+	}
+
+	for (int i = 0; i < WSM_OUTPUT_PLANES_MAX; i++) {
+		if (!output->planes[i]) {
+			output->planes[i] = wlr_output_layer_create(scene_output->output);
+			if (!output->planes[i]) {
+				wsm_log(WSM_ERROR, "Could not create wlr_output_layer: allocation failed!");
+				goto disable;
+			}
+		}
+	}
+
+	// plane_states is ordered bottom to top, candidates top to bottom
+	for (int i = 0; i < WSM_OUTPUT_PLANES_MAX; i++) {
+		struct wlr_output_layer_state *layer_state = &output->plane_states[i];
+		*layer_state = (struct wlr_output_layer_state){
+			.layer = output->planes[i],
+		};
+		if (i < candidates_len) {
+			struct render_list_entry *entry = candidates[candidates_len - 1 - i];
+			bool same_plane = i < output->planes_len &&
+				output->plane_nodes[i] == entry->node;
+			scene_entry_plane_state(entry, layer_state, data, same_plane);
+		}
+	}
+
+	struct wlr_output_state pending;
+	wlr_output_state_init(&pending);
+	if (!wlr_output_state_copy(&pending, state)) {
+		goto disable;
+	}
+	wlr_output_state_set_layers(&pending, output->plane_states, WSM_OUTPUT_PLANES_MAX);
+
+	bool ok = wlr_output_test_state(scene_output->output, &pending);
+	wlr_output_state_finish(&pending);
+	for (int i = 0; ok && i < candidates_len; i++) {
+		ok = output->plane_states[i].accepted;
+	}
+
+	if (!ok) {
+		wsm_log(WSM_DEBUG, "Plane assignment of %d buffers on %s rejected",
+			candidates_len, scene_output->output->name);
+		scene_output_planes_set_failed(output, candidates, candidates_len);
+		goto disable;
+	}
+
+	wlr_output_state_set_layers(state, output->plane_states, WSM_OUTPUT_PLANES_MAX);
+
+	// The primary buffer is not redrawn below the planes, what they uncover is
+	pixman_region32_t uncovered, covered;
+	pixman_region32_init(&uncovered);
+	pixman_region32_init(&covered);
+	bool changed = output->planes_len != candidates_len;
+	for (int i = 0; i < candidates_len; i++) {
+		struct render_list_entry *entry = candidates[candidates_len - 1 - i];
+		entry->on_plane = true;
+		changed |= output->plane_nodes[i] != entry->node;
+		output->plane_nodes[i] = entry->node;
+		scene_entry_plane_damage_sent(entry);
+
+		struct wlr_box *box = &output->plane_states[i].dst_box;
+		if (!wlr_box_equal(&output->plane_boxes[i], box)) {
+			struct wlr_box *old = &output->plane_boxes[i];
+			pixman_region32_union_rect(&uncovered, &uncovered,
+				old->x, old->y, old->width, old->height);
+			output->plane_boxes[i] = *box;
+		}
+		pixman_region32_union_rect(&covered, &covered,
+			box->x, box->y, box->width, box->height);
+
+		struct wlr_scene_output_sample_event sample_event = {
+			.output = scene_output,
+			.direct_scanout = true,
+		};
+		wl_signal_emit_mutable(&wlr_scene_buffer_from_node(entry->node)->events.output_sample,
+			&sample_event);
+	}
+	for (int i = candidates_len; i < WSM_OUTPUT_PLANES_MAX; i++) {
+		output->plane_boxes[i] = (struct wlr_box){0};
+	}
+
+	if (changed) {
+		// The primary buffer may still hold pixels of buffers now on planes
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+		wsm_log(WSM_DEBUG, "Offloading %d buffers to planes on %s",
+			candidates_len, scene_output->output->name);
+	}
+	wlr_damage_ring_add(&scene_output->damage_ring, &uncovered);
+	pixman_region32_subtract(&scene_output->damage_ring.current,
+		&scene_output->damage_ring.current, &covered);
+	pixman_region32_fini(&uncovered);
+	pixman_region32_fini(&covered);
+	output->planes_len = candidates_len;
+	return candidates_len;
+
+disable:
+	scene_output_planes_disable(output, state);
+	if (output->planes_len > 0) {
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+		output->planes_len = 0;
+		memset(output->plane_boxes, 0, sizeof(output->plane_boxes));
+	}
+	return 0;
+}
+
+static void scene_output_planes_commit_failed(
+		struct wlr_scene_output *scene_output, const struct wlr_output_state *state) {
+	struct wsm_output *output = scene_output->output->data;
+	if (!output || !(state->committed & WLR_OUTPUT_STATE_LAYERS) ||
+			output->planes_len == 0) {
+		return;
+	}
+
+	// Don't retry the same assignment, fall back to compositing next frame
+	for (int i = 0; i < output->planes_len; i++) {
+		output->plane_failed_nodes[i] = output->plane_nodes[output->planes_len - 1 - i];
+	}
+	output->plane_failed_len = output->planes_len;
+	output->plane_failed_frames = 0;
+	wlr_damage_ring_add_whole(&scene_output->damage_ring);
+}
+
+static bool scene_entry_fullscreen_candidate(struct render_list_entry *entry,
+		const struct render_data *data) {
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+	if (buffer->transform != data->transform) {
+		return false;
+	}
+
+	struct wlr_box node_box = { .x = entry->x, .y = entry->y };
+	scene_node_get_size(entry->node, &node_box.width, &node_box.height);
+	return wlr_box_equal(&data->logical, &node_box);
+}
+
+/**
+ * Dmabuf feedback stage: surfaces which could be scanned out, either directly
+ * because they cover the whole output or from an overlay plane, get a scan-out
+ * tranche with the formats of the primary output. Everything else only gets
+ * the formats of the renderer.
+ *
+ * Candidacy follows the layout and never the outcome of a test commit, which
+ * changes from frame to frame. Feedback identical to the last one sent to a
+ * buffer is not sent again, so clients only hear about it when they gain or
+ * lose candidacy.
+ */
+static void scene_output_send_dmabuf_feedback(struct wlr_scene_output *scene_output,
+		struct render_list_entry *list_data, int list_len,
+		const struct render_data *data) {
+	struct wlr_scene *scene = scene_output->scene;
+	if (!scene->linux_dmabuf_v1) {
+		return;
+	}
+
+	struct wsm_output *output = scene_output->output->data;
+
+	// A candidate must not be covered by anything which is composited
+	pixman_region32_t composited;
+	pixman_region32_init(&composited);
+	for (int i = 0; i < list_len; i++) {
+		struct render_list_entry *entry = &list_data[i];
+		int width, height;
+		scene_node_get_size(entry->node, &width, &height);
+
+		if (entry->node->type != WLR_SCENE_NODE_BUFFER) {
+			pixman_region32_union_rect(&composited, &composited,
+				entry->x, entry->y, width, height);
+			continue;
+		}
+
+		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+		pixman_box32_t box = {
+			.x1 = entry->x,
+			.y1 = entry->y,
+			.x2 = entry->x + width,
+			.y2 = entry->y + height,
+		};
+		bool candidate = scene->direct_scanout && buffer->buffer != NULL &&
+			pixman_region32_contains_rectangle(&composited, &box) == PIXMAN_REGION_OUT &&
+			(scene_entry_fullscreen_candidate(entry, data) ||
+			scene_entry_plane_candidate(entry, data));
+		if (!candidate) {
+			pixman_region32_union_rect(&composited, &composited,
+				entry->x, entry->y, width, height);
+		}
+
+		if (buffer->primary_output != scene_output) {
+			continue;
+		}
+
+		struct wlr_linux_dmabuf_feedback_v1_init_options options = {
+			.main_renderer = scene_output->output->renderer,
+			.scanout_primary_output = candidate ? scene_output->output : NULL,
+		};
+		if (scene_buffer_send_dmabuf_feedback(scene, buffer, &options) && output) {
+			output->stats.dmabuf_feedbacks++;
+		}
+	}
+	pixman_region32_fini(&composited);
+}
+
+struct backdrop_node {
+	struct wlr_scene_node *node;
+	int x, y;
+	int width, height;
+	// what the node shows, to tell when it changed in place
+	const void *content;
+	uint64_t commits;
+	float color[4];
+};
+
+static bool backdrop_nodes_iterator(struct wlr_scene_node *node,
+		int lx, int ly, void *data) {
+	struct wl_array *nodes = data;
+	if (scene_node_invisible(node)) {
+		return false;
+	}
+
+	struct backdrop_node *backdrop = wl_array_add(nodes, sizeof(*backdrop));
+	if (!backdrop) {
+		return false;
+	}
+
+	*backdrop = (struct backdrop_node){ .node = node, .x = lx, .y = ly };
+	scene_node_get_size(node, &backdrop->width, &backdrop->height);
+	if (node->type == WLR_SCENE_NODE_RECT) {
+		struct wlr_scene_rect *rect = wlr_scene_rect_from_node(node);
+		memcpy(backdrop->color, rect->color, sizeof(backdrop->color));
+	} else if (node->type == WLR_SCENE_NODE_BUFFER) {
+		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+		backdrop->content = buffer->buffer ?
+			(const void *)buffer->buffer : (const void *)buffer->texture;
+		backdrop->color[3] = buffer->opacity;
+
+		struct wlr_addon *addon =
+			wlr_addon_find(&node->addons, NULL, &scene_buffer_tracker_impl);
+		if (addon) {
+			struct scene_buffer_tracker *tracker =
+				wl_container_of(addon, tracker, addon);
+			backdrop->commits = tracker->commits;
+		}
+	}
+	return false;
+}
+
+/**
+ * Collects the nodes of the background layers, from the topmost one down.
+ */
+static void scene_collect_backdrop_nodes(const struct wlr_box *box,
+		struct wl_array *nodes) {
+	struct wlr_scene_tree *layers[] = {
+		global_server.scene->layers.shell_bottom,
+		global_server.scene->layers.shell_background,
+	};
+
+	for (size_t i = 0; i < sizeof(layers) / sizeof(layers[0]); i++) {
+		scene_nodes_in_box(&layers[i]->node, box, backdrop_nodes_iterator, nodes);
+	}
+}
+
+static bool backdrop_node_equal(const struct backdrop_node *a,
+		const struct backdrop_node *b) {
+	return a->node == b->node && a->x == b->x && a->y == b->y &&
+		a->width == b->width && a->height == b->height &&
+		a->content == b->content && a->commits == b->commits &&
+		memcmp(a->color, b->color, sizeof(a->color)) == 0;
+}
+
+static void backdrop_node_damage(const struct backdrop_node *backdrop,
+		const struct render_data *data, pixman_region32_t *damage) {
+	struct wlr_box box = {
+		.x = backdrop->x - data->logical.x,
+		.y = backdrop->y - data->logical.y,
+		.width = backdrop->width,
+		.height = backdrop->height,
+	};
+	scale_box(&box, data->scale);
+	pixman_region32_union_rect(damage, damage, box.x, box.y, box.width, box.height);
+}
+
+/**
+ * Windows and everything else above the background layers are drawn over
+ * the backdrop, so only the background nodes which changed since the
+ * previous frame with effects make it dirty. Nodes are compared in stacking
+ * order, one which moved, changed, appeared or went away damages both its
+ * old and new box.
+ */
+static void scene_output_backdrop_damage(struct wsm_output *output,
+		const struct render_data *data, pixman_region32_t *damage) {
+	struct wl_array nodes;
+	wl_array_init(&nodes);
+	scene_collect_backdrop_nodes(&data->logical, &nodes);
+
+	if (!wlr_box_equal(&output->backdrop_box, &data->logical) ||
+			output->backdrop_scale != data->scale) {
+		pixman_region32_union_rect(damage, damage, 0, 0,
+			data->trans_width, data->trans_height);
+	} else {
+		const struct backdrop_node *old = output->backdrop_nodes.data;
+		const struct backdrop_node *new = nodes.data;
+		size_t old_len = output->backdrop_nodes.size / sizeof(*old);
+		size_t new_len = nodes.size / sizeof(*new);
+		for (size_t i = 0; i < old_len || i < new_len; i++) {
+			if (i < old_len && i < new_len && backdrop_node_equal(&old[i], &new[i])) {
+				continue;
+			}
+			if (i < old_len) {
+				backdrop_node_damage(&old[i], data, damage);
+			}
+			if (i < new_len) {
+				backdrop_node_damage(&new[i], data, damage);
+			}
+		}
+	}
+
+	wl_array_release(&output->backdrop_nodes);
+	output->backdrop_nodes = nodes;
+	output->backdrop_box = data->logical;
+	output->backdrop_scale = data->scale;
+}
+
+static void scene_backdrop_node_render(const struct backdrop_node *backdrop,
+		const struct render_data *data, struct wlr_render_pass *pass,
+		const pixman_region32_t *clip) {
+	struct wlr_scene_node *node = backdrop->node;
+	struct wlr_box dst_box = {
+		.x = backdrop->x - data->logical.x,
+		.y = backdrop->y - data->logical.y,
+	};
+	scene_node_get_size(node, &dst_box.width, &dst_box.height);
+	scale_box(&dst_box, data->scale);
+
+	if (node->type == WLR_SCENE_NODE_RECT) {
+		struct wlr_scene_rect *scene_rect = wlr_scene_rect_from_node(node);
+		wlr_render_pass_add_rect(pass, &(struct wlr_render_rect_options){
+			.box = dst_box,
+			.color = {
+				.r = scene_rect->color[0],
+				.g = scene_rect->color[1],
+				.b = scene_rect->color[2],
+				.a = scene_rect->color[3],
+			},
+			.clip = clip,
+		});
+		return;
+	}
+
+	struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+	struct wlr_texture *texture = scene_buffer_get_texture(scene_buffer,
+		data->output->output->renderer);
+	if (texture == NULL) {
+		return;
+	}
+
+	wlr_render_pass_add_texture(pass, &(struct wlr_render_texture_options) {
+		.texture = texture,
+		.src_box = scene_buffer->src_box,
+		.dst_box = dst_box,
+		.transform = wlr_output_transform_invert(scene_buffer->transform),
+		.clip = clip,
+		.alpha = &scene_buffer->opacity,
+		.filter_mode = scene_buffer->filter_mode,
+		.blend_mode = WLR_RENDER_BLEND_MODE_PREMULTIPLIED,
+		.wait_timeline = scene_buffer->wait_timeline,
+		.wait_point = scene_buffer->wait_point,
+	});
+}
+
+/**
+ * Draws the background layers of the output, whole nodes regardless of what
+ * covers them, for effects showing them through windows.
+ */
+static void scene_render_backdrop(const struct wsm_effect_output_data *effect_data,
+		struct wlr_render_pass *pass, const pixman_region32_t *clip) {
+	const struct render_data *data = effect_data->backdrop_data;
+	struct wsm_output *output = data->output->output->data;
+
+	// collected along with the backdrop damage of this frame
+	struct wl_array collected;
+	wl_array_init(&collected);
+	struct wl_array *nodes = output ? &output->backdrop_nodes : &collected;
+	if (!output) {
+		scene_collect_backdrop_nodes(&data->logical, &collected);
+	}
+
+	// collected top to bottom
+	struct backdrop_node *backdrop_data = nodes->data;
+	for (int i = nodes->size / sizeof(*backdrop_data) - 1; i >= 0; i--) {
+		scene_backdrop_node_render(&backdrop_data[i], data, pass, clip);
+	}
+	wl_array_release(&collected);
+}
+
+static uint32_t scene_output_effect_features(struct render_list_entry *list_data,
+		int list_len, const struct render_data *data, pixman_region32_t *blur_region) {
+	uint32_t features = 0;
+	for (int i = 0; i < list_len; i++) {
+		struct render_list_entry *entry = &list_data[i];
+		if (entry->node->type != WLR_SCENE_NODE_BUFFER || entry->on_plane) {
+			continue;
+		}
+
+		uint32_t entry_features = wsm_effects_window_features(
+			wlr_scene_buffer_from_node(entry->node), NULL);
+		if (entry_features & WSM_EFFECT_FEATURE_BIT(WSM_EFFECT_BLUR)) {
+			struct wlr_box box = {
+				.x = entry->x - data->logical.x,
+				.y = entry->y - data->logical.y,
+			};
+			scene_node_get_size(entry->node, &box.width, &box.height);
+			scale_box(&box, data->scale);
+			pixman_region32_union_rect(blur_region, blur_region,
+				box.x, box.y, box.width, box.height);
+		}
+		features |= entry_features;
+	}
+	return features;
+}
+
 bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 		struct wlr_output_state *state, const struct wlr_scene_output_state_options *options) {
 	struct wlr_scene_output_state_options default_options = {0};
@@ -713,18 +1807,35 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	render_data.logical.width = render_data.trans_width / render_data.scale;
 	render_data.logical.height = render_data.trans_height / render_data.scale;
 
+	struct wsm_output *wsm_output = output->data;
 	struct render_list_constructor_data list_con = {
 		.box = render_data.logical,
-		.render_list = &scene_output->render_list,
+		.render_list = wsm_output ? &wsm_output->render_list : &scene_output->render_list,
 		.calculate_visibility = scene_output->scene->calculate_visibility,
 		.highlight_transparent_region = scene_output->scene->highlight_transparent_region,
 		.fractional_scale = floor(render_data.scale) != render_data.scale,
 	};
 
-	list_con.render_list->size = 0;
-	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
-		construct_render_list_iterator, &list_con);
-	array_realloc(list_con.render_list, list_con.render_list->size);
+	if (!wsm_output || !render_list_cache_valid(wsm_output, &list_con, render_data.scale)) {
+		if (wsm_output) {
+			render_list_cache_untrack(wsm_output);
+		}
+
+		struct wsm_scene *root = global_server.scene;
+		if (wsm_output && root->tracked_generation != root->render_generation) {
+			scene_track_buffers(&scene_output->scene->tree.node);
+			root->tracked_generation = root->render_generation;
+		}
+
+		list_con.render_list->size = 0;
+		scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
+			construct_render_list_iterator, &list_con);
+		array_realloc(list_con.render_list, list_con.render_list->size);
+
+		if (wsm_output) {
+			render_list_cache_track(wsm_output, &list_con.box, render_data.scale);
+		}
+	}
 
 	struct render_list_entry *list_data = list_con.render_list->data;
 	int list_len = list_con.render_list->size / sizeof(*list_data);
@@ -769,10 +1880,68 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 		pixman_region32_fini(&acc_damage);
 	}
 
+	int planes_len = 0;
+	if (options->color_transform == NULL &&
+			debug_damage != WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
+		planes_len = scene_output_assign_planes(scene_output, list_data, list_len,
+			state, &render_data);
+	}
+	scene_output_send_dmabuf_feedback(scene_output, list_data, list_len, &render_data);
+
+	// The single entry left for the primary plane may be scanned out directly
+	struct render_list_entry *primary_entry = NULL;
+	for (int i = 0; i < list_len && list_len - planes_len == 1; i++) {
+		if (!list_data[i].on_plane) {
+			primary_entry = &list_data[i];
+			break;
+		}
+	}
+
+	pixman_region32_t blur_region, backdrop_damage;
+	pixman_region32_init(&blur_region);
+	pixman_region32_init(&backdrop_damage);
+	uint32_t effect_features = scene_output_effect_features(list_data, list_len,
+		&render_data, &blur_region);
+
+	// Effects work in untransformed buffer coordinates
+	struct wsm_effect_output_data effect_data = {
+		.scene_output = scene_output,
+		.renderer = output->renderer,
+		.backdrop_damage = &backdrop_damage,
+		.blur_region = &blur_region,
+		.render_backdrop = scene_render_backdrop,
+		.backdrop_data = &render_data,
+		.width = resolution_width,
+		.height = resolution_height,
+		.scale = render_data.scale,
+		.features = effect_features,
+	};
+	bool effects = render_data.transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		(!primary_entry || effect_features);
+	if (effects) {
+		if (wsm_output) {
+			scene_output_backdrop_damage(wsm_output, &render_data, &backdrop_damage);
+		} else {
+			pixman_region32_copy(&backdrop_damage, &scene_output->damage_ring.current);
+		}
+		wsm_effects_pre_render_output(&effect_data);
+		render_data.effects = &effect_data;
+	}
+	pixman_region32_fini(&backdrop_damage);
+	effect_data.backdrop_damage = NULL;
+
+	wsm_damage_simplify(&scene_output->damage_ring.current,
+		render_data.trans_width, render_data.trans_height);
 	output_state_apply_damage(&render_data, state);
 	bool scanout = options->color_transform == NULL &&
-		list_len == 1 && debug_damage != WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
-		scene_entry_try_direct_scanout(&list_data[0], state, &render_data);
+		primary_entry && !effect_features &&
+		debug_damage != WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
+		scene_entry_try_direct_scanout(primary_entry, state, &render_data);
+
+	if (wsm_output) {
+		wsm_stats_output_build(&wsm_output->stats, list_len,
+			wsm_region_area(&scene_output->damage_ring.current), scanout);
+	}
 
 	if (scene_output->prev_scanout != scanout) {
 		scene_output->prev_scanout = scanout;
@@ -781,6 +1950,7 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	}
 
 	if (scanout) {
+		pixman_region32_fini(&blur_region);
 		if (timer) {
 			struct timespec end_time, duration;
 			clock_gettime(CLOCK_MONOTONIC, &end_time);
@@ -793,6 +1963,7 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	struct wlr_swapchain *swapchain = options->swapchain;
 	if (!swapchain) {
 		if (!wlr_output_configure_primary_swapchain(output, state, &output->swapchain)) {
+			pixman_region32_fini(&blur_region);
 			return false;
 		}
 
@@ -801,6 +1972,7 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 
 	struct wlr_buffer *buffer = wlr_swapchain_acquire(swapchain, NULL);
 	if (buffer == NULL) {
+		pixman_region32_fini(&blur_region);
 		return false;
 	}
 
@@ -821,6 +1993,7 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 			.color_transform = options->color_transform,
 	});
 	if (render_pass == NULL) {
+		pixman_region32_fini(&blur_region);
 		wlr_buffer_unlock(buffer);
 		return false;
 	}
@@ -830,6 +2003,14 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	pixman_region32_init(&render_data.damage);
 	wlr_damage_ring_rotate_buffer(&scene_output->damage_ring, buffer,
 		&render_data.damage);
+	// older frames' damage of the buffer fragments it again
+	struct timespec record_start;
+	clock_gettime(CLOCK_MONOTONIC, &record_start);
+	int damage_rects = pixman_region32_n_rects(&render_data.damage);
+	uint64_t overdraw_px = wsm_damage_simplify(&render_data.damage,
+		render_data.trans_width, render_data.trans_height);
+	effect_data.render_pass = render_pass;
+	effect_data.damage = &render_data.damage;
 
 	pixman_region32_t background;
 	pixman_region32_init(&background);
@@ -838,6 +2019,10 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	if (scene_output->scene->calculate_visibility) {
 		for (int i = list_len - 1; i >= 0; i--) {
 			struct render_list_entry *entry = &list_data[i];
+			if (entry->on_plane) {
+				continue;
+			}
+
 			pixman_region32_t opaque;
 			pixman_region32_init(&opaque);
 			scene_node_opaque_region(entry->node, entry->x, entry->y, &opaque);
@@ -865,20 +2050,23 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 
 	for (int i = list_len - 1; i >= 0; i--) {
 		struct render_list_entry *entry = &list_data[i];
-		scene_entry_render(entry, &render_data);
+		if (entry->on_plane) {
+			continue;
+		}
 
-		if (entry->node->type == WLR_SCENE_NODE_BUFFER) {
-			struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(entry->node);
+		scene_entry_render(entry, &render_data);
+	}
 
-			if (buffer->primary_output == scene_output && !entry->sent_dmabuf_feedback) {
-				struct wlr_linux_dmabuf_feedback_v1_init_options options = {
-					.main_renderer = output->renderer,
-					.scanout_primary_output = NULL,
-				};
+	if (effects) {
+		wsm_effects_render_output(&effect_data);
+	}
 
-				scene_buffer_send_dmabuf_feedback(scene_output->scene, buffer, &options);
-			}
-		}
+	if (wsm_output) {
+		struct timespec record_end, record_duration;
+		clock_gettime(CLOCK_MONOTONIC, &record_end);
+		timespec_sub(&record_duration, &record_end, &record_start);
+		wsm_stats_output_repaint(&wsm_output->stats, damage_rects, overdraw_px,
+			timespec_to_nsec(&record_duration));
 	}
 
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
@@ -899,9 +2087,15 @@ bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 
 	wlr_output_add_software_cursors_to_render_pass(output, render_pass, &render_data.damage);
 
+	bool submitted = wlr_render_pass_submit(render_pass);
+	if (effects) {
+		effect_data.render_pass = NULL;
+		wsm_effects_post_render_output(&effect_data);
+	}
 	pixman_region32_fini(&render_data.damage);
+	pixman_region32_fini(&blur_region);
 
-	if (!wlr_render_pass_submit(render_pass)) {
+	if (!submitted) {
 		wlr_buffer_unlock(buffer);
 		wlr_damage_ring_add_whole(&scene_output->damage_ring);
 		return false;
@@ -4,10 +4,12 @@
 #include "../config.h"
 #include "node/wsm_node.h"
 
+#include <stdint.h>
 #include <stdbool.h>
 
 struct wlr_scene;
 struct wlr_scene_tree;
+struct wlr_surface;
 struct wlr_scene_output;
 struct wlr_output_state;
 struct wlr_output_layout;
@@ -15,6 +17,7 @@ struct wlr_scene_output_layout;
 struct wlr_scene_output_state_options;
 
 struct wsm_server;
+struct wsm_output;
 
 /**
  * @brief scene render control.
@@ -77,6 +80,16 @@ struct wsm_scene {
 	struct wsm_list *outputs;
 	struct wsm_list *non_desktop_outputs;
 	struct wsm_list *scratchpad;
+	struct wsm_list *dirty_configs; // struct wsm_container
+	struct wsm_list *dirty_buffers; // struct wlr_scene_buffer
+
+	/* bumped whenever cached output render lists may miss a node */
+	uint64_t render_generation;
+	/* render generation at which every scene buffer was last hooked */
+	uint64_t tracked_generation;
+
+	/* opacity and scale filter of the whole tree need to be recomputed */
+	bool config_dirty;
 
 	struct wsm_output *fallback_output;
 	struct wsm_container *fullscreen_global;
@@ -90,6 +103,23 @@ bool wsm_scene_output_commit(struct wlr_scene_output *scene_output,
 	const struct wlr_scene_output_state_options *options);
 bool wsm_scene_output_build_state(struct wlr_scene_output *scene_output,
 	struct wlr_output_state *state, const struct wlr_scene_output_state_options *options);
+void wsm_scene_mark_config_dirty(struct wsm_scene *root);
+void wsm_scene_invalidate_render_lists(struct wsm_scene *root);
+/**
+ * @brief wsm_scene_render_lists_node_moved update the cached render list
+ * entries of a subtree which only changed position, instead of dropping the
+ * lists
+ */
+void wsm_scene_render_lists_node_moved(struct wsm_scene *root,
+	struct wlr_scene_node *node);
+/**
+ * @brief wsm_scene_surface_effect_changed clip the opaque region of the scene
+ * buffers of the surface to its new effects and damage them on the outputs
+ * they are on
+ */
+void wsm_scene_surface_effect_changed(struct wsm_scene *root,
+	struct wlr_surface *surface);
+void wsm_scene_output_release_render_list(struct wsm_output *output);
 void root_get_box(struct wsm_scene *root, struct wlr_box *box);
 void root_scratchpad_show(struct wsm_container *con);
 
@@ -1,4 +1,5 @@
 #include "wsm_log.h"
+#include "wsm_list.h"
 #include "wsm_view.h"
 #include "wsm_scene.h"
 #include "wsm_server.h"
@@ -17,6 +18,67 @@
 
 #include <wlr/types/wlr_scene.h>
 
+/**
+ * Scene nodes changed by arranging since arrange_take_scene_mutations() was
+ * last called. The helpers below skip what wlroots would skip as a no-op, so
+ * only real changes are counted.
+ */
+static size_t scene_mutations;
+// whether the last full arrange showed a global fullscreen container
+static bool root_fullscreen;
+
+static void arrange_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
+	if (node->enabled != enabled) {
+		scene_mutations++;
+		wlr_scene_node_set_enabled(node, enabled);
+	}
+}
+
+static void arrange_node_set_position(struct wlr_scene_node *node, int x, int y) {
+	if (node->x != x || node->y != y) {
+		scene_mutations++;
+		wlr_scene_node_set_position(node, x, y);
+	}
+}
+
+static void arrange_node_reparent(struct wlr_scene_node *node,
+		struct wlr_scene_tree *parent) {
+	if (node->parent != parent) {
+		scene_mutations++;
+		wlr_scene_node_reparent(node, parent);
+	}
+}
+
+static void arrange_rect_set_size(struct wlr_scene_rect *rect, int width, int height) {
+	if (rect->width != width || rect->height != height) {
+		scene_mutations++;
+		wlr_scene_rect_set_size(rect, width, height);
+	}
+}
+
+static void arrange_node_lower_to_bottom(struct wlr_scene_node *node) {
+	struct wlr_scene_node *bottom =
+		wl_container_of(node->parent->children.next, bottom, link);
+	if (bottom != node) {
+		scene_mutations++;
+		wlr_scene_node_lower_to_bottom(node);
+	}
+}
+
+static void arrange_buffer_set_dest_size(struct wlr_scene_buffer *buffer,
+		int width, int height) {
+	if (buffer->dst_width != width || buffer->dst_height != height) {
+		scene_mutations++;
+		wlr_scene_buffer_set_dest_size(buffer, width, height);
+	}
+}
+
+size_t arrange_take_scene_mutations(void) {
+	size_t mutations = scene_mutations;
+	scene_mutations = 0;
+	return mutations;
+}
+
 void arrange_root_auto(void) {
 	struct wlr_box layout_box;
 	wlr_output_layout_get_box(global_server.scene->output_layout, NULL, &layout_box);
@@ -43,16 +105,16 @@ void arrange_root_auto(void) {
 void arrange_root_scene(struct wsm_scene *root) {
 	struct wsm_container *fs = root->fullscreen_global;
 
-	wlr_scene_node_set_enabled(&root->layers.shell_background->node, !fs);
-	wlr_scene_node_set_enabled(&root->layers.shell_bottom->node, !fs);
-	wlr_scene_node_set_enabled(&root->layers.tiling->node, !fs);
-	wlr_scene_node_set_enabled(&root->layers.floating->node, !fs);
-	wlr_scene_node_set_enabled(&root->layers.shell_top->node, !fs);
-	wlr_scene_node_set_enabled(&root->layers.fullscreen->node, !fs);
+	arrange_node_set_enabled(&root->layers.shell_background->node, !fs);
+	arrange_node_set_enabled(&root->layers.shell_bottom->node, !fs);
+	arrange_node_set_enabled(&root->layers.tiling->node, !fs);
+	arrange_node_set_enabled(&root->layers.floating->node, !fs);
+	arrange_node_set_enabled(&root->layers.shell_top->node, !fs);
+	arrange_node_set_enabled(&root->layers.fullscreen->node, !fs);
 
 	for (int i = 0; i < root->scratchpad->length; i++) {
 		struct wsm_container *con = root->scratchpad->items[i];
-		wlr_scene_node_set_enabled(&con->scene_tree->node, false);
+		arrange_node_set_enabled(&con->scene_tree->node, false);
 	}
 
 	if (fs) {
@@ -72,27 +134,83 @@ void arrange_root_scene(struct wsm_scene *root) {
 
 			wlr_scene_output_set_position(output->scene_output, output->lx, output->ly);
 
-			wlr_scene_node_reparent(&output->layers.shell_background->node, root->layers.shell_background);
-			wlr_scene_node_reparent(&output->layers.shell_bottom->node, root->layers.shell_bottom);
-			wlr_scene_node_reparent(&output->layers.tiling->node, root->layers.tiling);
-			wlr_scene_node_reparent(&output->layers.shell_top->node, root->layers.shell_top);
-			wlr_scene_node_reparent(&output->layers.shell_overlay->node, root->layers.shell_overlay);
-			wlr_scene_node_reparent(&output->layers.fullscreen->node, root->layers.fullscreen);
-			wlr_scene_node_reparent(&output->layers.session_lock->node, root->layers.session_lock);
-
-			wlr_scene_node_set_position(&output->layers.shell_background->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.shell_bottom->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.tiling->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.fullscreen->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.shell_top->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.shell_overlay->node, output->lx, output->ly);
-			wlr_scene_node_set_position(&output->layers.session_lock->node, output->lx, output->ly);
+			arrange_node_reparent(&output->layers.shell_background->node, root->layers.shell_background);
+			arrange_node_reparent(&output->layers.shell_bottom->node, root->layers.shell_bottom);
+			arrange_node_reparent(&output->layers.tiling->node, root->layers.tiling);
+			arrange_node_reparent(&output->layers.shell_top->node, root->layers.shell_top);
+			arrange_node_reparent(&output->layers.shell_overlay->node, root->layers.shell_overlay);
+			arrange_node_reparent(&output->layers.fullscreen->node, root->layers.fullscreen);
+			arrange_node_reparent(&output->layers.session_lock->node, root->layers.session_lock);
+
+			arrange_node_set_position(&output->layers.shell_background->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.shell_bottom->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.tiling->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.fullscreen->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.shell_top->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.shell_overlay->node, output->lx, output->ly);
+			arrange_node_set_position(&output->layers.session_lock->node, output->lx, output->ly);
 
 			arrange_output_width_size(output, output->width, output->height);
 		}
 	}
 
+	root_fullscreen = fs != NULL;
 	wsm_arrange_popups(root->layers.popup);
+	wsm_scene_mark_config_dirty(root);
+	wsm_scene_invalidate_render_lists(root);
+}
+
+static void arrange_workspace_scene(struct wsm_output *output,
+	struct wsm_workspace *ws, int width, int height);
+
+static bool output_scene_arranged(struct wsm_scene *root, struct wsm_output *output) {
+	struct wlr_scene_node *tiling = &output->layers.tiling->node;
+	return tiling->parent == root->layers.tiling &&
+		tiling->x == output->lx && tiling->y == output->ly &&
+		output->scene_output->x == output->lx && output->scene_output->y == output->ly;
+}
+
+static void workspace_mark_config_dirty(struct wsm_workspace *ws) {
+	for (int i = 0; i < ws->current.tiling->length; i++) {
+		container_mark_config_dirty(ws->current.tiling->items[i]);
+	}
+	for (int i = 0; i < ws->current.floating->length; i++) {
+		container_mark_config_dirty(ws->current.floating->items[i]);
+	}
+	if (ws->current.fullscreen) {
+		container_mark_config_dirty(ws->current.fullscreen);
+	}
+}
+
+void arrange_workspaces_scene(struct wsm_scene *root, struct wsm_list *workspaces) {
+	// a global fullscreen container hides or shows whole root layers
+	if (root->fullscreen_global || root_fullscreen) {
+		arrange_root_scene(root);
+		return;
+	}
+
+	for (int i = 0; i < workspaces->length; i++) {
+		struct wsm_workspace *ws = workspaces->items[i];
+		struct wsm_output *output = ws->current.output;
+		if (output && !output_scene_arranged(root, output)) {
+			// the output moved in the layout
+			arrange_root_scene(root);
+			return;
+		}
+	}
+
+	for (int i = 0; i < workspaces->length; i++) {
+		struct wsm_workspace *ws = workspaces->items[i];
+		struct wsm_output *output = ws->current.output;
+		if (!output || list_find(output->current.workspaces, ws) == -1) {
+			continue;
+		}
+		arrange_workspace_scene(output, ws, output->width, output->height);
+		workspace_mark_config_dirty(ws);
+	}
+
+	wsm_arrange_popups(root->layers.popup);
+	wsm_scene_invalidate_render_lists(root);
 }
 
 void wsm_arrange_output_auto(struct wsm_output *output) {
@@ -110,53 +228,57 @@ void wsm_arrange_output_auto(struct wsm_output *output) {
 	}
 }
 
-void arrange_output_width_size(struct wsm_output *output, int width, int height) {
-	for (int i = 0; i < output->current.workspaces->length; i++) {
-		struct wsm_workspace *child = output->current.workspaces->items[i];
+static void arrange_workspace_scene(struct wsm_output *output,
+		struct wsm_workspace *ws, int width, int height) {
+	bool activated = output->current.active_workspace == ws;
 
-		bool activated = output->current.active_workspace == child;
+	arrange_node_reparent(&ws->layers.non_fullscreen->node, output->layers.tiling);
+	arrange_node_reparent(&ws->layers.fullscreen->node, output->layers.fullscreen);
 
-		wlr_scene_node_reparent(&child->layers.non_fullscreen->node, output->layers.tiling);
-		wlr_scene_node_reparent(&child->layers.fullscreen->node, output->layers.fullscreen);
+	for (int i = 0; i < ws->current.floating->length; i++) {
+		struct wsm_container *floater = ws->current.floating->items[i];
+		arrange_node_reparent(&floater->scene_tree->node, global_server.scene->layers.floating);
+		arrange_node_set_enabled(&floater->scene_tree->node, activated);
+	}
 
-		for (int i = 0; i < child->current.floating->length; i++) {
-			struct wsm_container *floater = child->current.floating->items[i];
-			wlr_scene_node_reparent(&floater->scene_tree->node, global_server.scene->layers.floating);
-			wlr_scene_node_set_enabled(&floater->scene_tree->node, activated);
-		}
+	if (activated) {
+		struct wsm_container *fs = ws->current.fullscreen;
+		arrange_node_set_enabled(&ws->layers.non_fullscreen->node, !fs);
+		arrange_node_set_enabled(&ws->layers.fullscreen->node, fs);
 
-		if (activated) {
-			struct wsm_container *fs = child->current.fullscreen;
-			wlr_scene_node_set_enabled(&child->layers.non_fullscreen->node, !fs);
-			wlr_scene_node_set_enabled(&child->layers.fullscreen->node, fs);
+		arrange_workspace_floating(ws);
 
-			arrange_workspace_floating(child);
+		arrange_node_set_enabled(&output->layers.shell_background->node, !fs);
+		arrange_node_set_enabled(&output->layers.shell_bottom->node, !fs);
+		arrange_node_set_enabled(&output->layers.fullscreen->node, fs);
 
-			wlr_scene_node_set_enabled(&output->layers.shell_background->node, !fs);
-			wlr_scene_node_set_enabled(&output->layers.shell_bottom->node, !fs);
-			wlr_scene_node_set_enabled(&output->layers.fullscreen->node, fs);
+		if (fs) {
+			arrange_rect_set_size(output->fullscreen_background, width, height);
+			wsm_arrange_fullscreen(ws->layers.fullscreen, fs, ws,
+				width, height);
+		} else {
+			struct wlr_box *area = &output->usable_area;
+			struct side_gaps *gaps = &ws->current_gaps;
 
-			if (fs) {
-				wlr_scene_rect_set_size(output->fullscreen_background, width, height);
-				wsm_arrange_fullscreen(child->layers.fullscreen, fs, child,
-					width, height);
-			} else {
-				struct wlr_box *area = &output->usable_area;
-				struct side_gaps *gaps = &child->current_gaps;
+			arrange_node_set_position(&ws->layers.non_fullscreen->node,
+				gaps->left + area->x, gaps->top + area->y);
 
-				wlr_scene_node_set_position(&child->layers.non_fullscreen->node,
-					gaps->left + area->x, gaps->top + area->y);
+			arrange_workspace_tiling(ws,
+				area->width - gaps->left - gaps->right,
+				area->height - gaps->top - gaps->bottom);
+		}
+	} else {
+		arrange_node_set_enabled(&ws->layers.non_fullscreen->node, false);
+		arrange_node_set_enabled(&ws->layers.fullscreen->node, false);
 
-				arrange_workspace_tiling(child,
-					area->width - gaps->left - gaps->right,
-					area->height - gaps->top - gaps->bottom);
-			}
-		} else {
-			wlr_scene_node_set_enabled(&child->layers.non_fullscreen->node, false);
-			wlr_scene_node_set_enabled(&child->layers.fullscreen->node, false);
+		disable_workspace(ws);
+	}
+}
 
-			disable_workspace(child);
-		}
+void arrange_output_width_size(struct wsm_output *output, int width, int height) {
+	for (int i = 0; i < output->current.workspaces->length; i++) {
+		struct wsm_workspace *child = output->current.workspaces->items[i];
+		arrange_workspace_scene(output, child, width, height);
 	}
 }
 
@@ -243,7 +365,7 @@ void wsm_arrange_popups(struct wlr_scene_tree *popups) {
 
 		int lx, ly;
 		wlr_scene_node_coords(popup->relative, &lx, &ly);
-		wlr_scene_node_set_position(node, lx, ly);
+		arrange_node_set_position(node, lx, ly);
 	}
 }
 
@@ -340,7 +462,7 @@ void container_arrange_title_bar_node(struct wsm_container *con) {
 		alloc_width = MAX(alloc_width, 0);
 
 		wsm_text_node_set_max_width(node, alloc_width);
-		wlr_scene_node_set_position(node->node_wlr,
+		arrange_node_set_position(node->node_wlr,
 			h_padding, ((height - node->height) >> 1) + get_max_thickness(con->pending)
 			* con->pending.border_top);
 		pixman_region32_union_rect(&text_area, &text_area,
@@ -352,9 +474,9 @@ void container_arrange_title_bar_node(struct wsm_container *con) {
 		return;
 	}
 
-	wlr_scene_node_set_position(&con->title_bar->background->node, 0, get_max_thickness(con->pending)
+	arrange_node_set_position(&con->title_bar->background->node, 0, get_max_thickness(con->pending)
 		* con->pending.border_top);
-	wlr_scene_rect_set_size(con->title_bar->background, width, height);
+	arrange_rect_set_size(con->title_bar->background, width, height);
 	if (!con->title_bar->icon && con->view && con->current.border == B_NORMAL) {
 		char *icon_path = con->view->app_icon_path;
 		if (icon_path) {
@@ -367,7 +489,7 @@ void container_arrange_title_bar_node(struct wsm_container *con) {
 	if (con->title_bar->icon) {
 		int size = height - global_config.titlebar_v_padding;
 		wsm_image_node_set_size(con->title_bar->icon, size, size);
-		wlr_scene_node_set_position(con->title_bar->icon->node_wlr, ((height - size) >> 1),
+		arrange_node_set_position(con->title_bar->icon->node_wlr, ((height - size) >> 1),
 			((height - size) >> 1) + get_max_thickness(con->pending)
 			* con->pending.border_top);
 	}
@@ -380,12 +502,12 @@ void wsm_arrange_title_bar(struct wsm_container *con,
 	container_update(con);
 
 	bool has_title_bar = height > 0;
-	wlr_scene_node_set_enabled(&con->title_bar->tree->node, has_title_bar && con->view->enabled);
+	arrange_node_set_enabled(&con->title_bar->tree->node, has_title_bar && con->view->enabled);
 	if (!has_title_bar) {
 		return;
 	}
 
-	wlr_scene_node_set_position(&con->title_bar->tree->node, x, y);
+	arrange_node_set_position(&con->title_bar->tree->node, x, y);
 
 	con->title_width = width;
 	container_arrange_title_bar_node(con);
@@ -397,23 +519,23 @@ void wsm_arrange_fullscreen(struct wlr_scene_tree *tree,
 	struct wlr_scene_node *fs_node;
 	if (fs->view) {
 		fs_node = &fs->view->scene_tree->node;
-		wlr_scene_node_set_enabled(&fs->scene_tree->node, false);
+		arrange_node_set_enabled(&fs->scene_tree->node, false);
 	} else {
 		fs_node = &fs->scene_tree->node;
 		wsm_arrange_container_with_title_bar(fs, width, height, true, 0);
 	}
 
-	wlr_scene_node_reparent(fs_node, tree);
-	wlr_scene_node_lower_to_bottom(fs_node);
-	wlr_scene_node_set_position(fs_node, 0, 0);
+	arrange_node_reparent(fs_node, tree);
+	arrange_node_lower_to_bottom(fs_node);
+	arrange_node_set_position(fs_node, 0, 0);
 }
 
 void wsm_arrange_container_with_title_bar(struct wsm_container *con,
 		int width, int height, bool title_bar, int gaps) {
-	wlr_scene_node_set_enabled(&con->scene_tree->node, true);
+	arrange_node_set_enabled(&con->scene_tree->node, true);
 
 	if (con->output_handler) {
-		wlr_scene_buffer_set_dest_size(con->output_handler, width, height);
+		arrange_buffer_set_dest_size(con->output_handler, width, height);
 	}
 
 	if (con->view) {
@@ -443,27 +565,27 @@ void wsm_arrange_container_with_title_bar(struct wsm_container *con,
 		int border_right = con->current.border_right ? border_width : 0;
 		int page_top = con->current.border_top ? border_width : 0;
 
-		wlr_scene_rect_set_size(con->sensing.top, width, page_top);
-		wlr_scene_rect_set_size(con->sensing.bottom, width, border_bottom);
-		wlr_scene_rect_set_size(con->sensing.left,
+		arrange_rect_set_size(con->sensing.top, width, page_top);
+		arrange_rect_set_size(con->sensing.bottom, width, border_bottom);
+		arrange_rect_set_size(con->sensing.left,
 			border_left, height - border_bottom - page_top);
-		wlr_scene_rect_set_size(con->sensing.right,
+		arrange_rect_set_size(con->sensing.right,
 			border_right, height - border_bottom - page_top);
 
-		wlr_scene_node_set_position(&con->sensing.top->node, 0, 0);
-		wlr_scene_node_set_position(&con->sensing.bottom->node,
+		arrange_node_set_position(&con->sensing.top->node, 0, 0);
+		arrange_node_set_position(&con->sensing.bottom->node,
 			0, height - border_bottom);
-		wlr_scene_node_set_position(&con->sensing.left->node,
+		arrange_node_set_position(&con->sensing.left->node,
 			0, page_top);
-		wlr_scene_node_set_position(&con->sensing.right->node,
+		arrange_node_set_position(&con->sensing.right->node,
 			width - border_right, page_top);
 
-		wlr_scene_node_reparent(&con->view->scene_tree->node, con->content_tree);
-		wlr_scene_node_set_position(&con->view->scene_tree->node,
+		arrange_node_reparent(&con->view->scene_tree->node, con->content_tree);
+		arrange_node_set_position(&con->view->scene_tree->node,
 			border_left, border_top);
 	} else {
 		if (title_bar) {
-			wlr_scene_node_set_enabled(&con->title_bar->tree->node, false);
+			arrange_node_set_enabled(&con->title_bar->tree->node, false);
 		}
 
 		arrange_children_with_titlebar(con->current.layout, con->current.children,
@@ -491,9 +613,9 @@ void arrange_children_with_titlebar(enum wsm_container_layout layout, struct wsm
 		bool activated = child == active;
 
 		wsm_arrange_title_bar(child, 0, y + title_height, width, title_bar_height);
-		wlr_scene_node_set_enabled(&child->sensing.tree->node, activated);
-		wlr_scene_node_set_position(&child->scene_tree->node, 0, title_height);
-		wlr_scene_node_reparent(&child->scene_tree->node, content);
+		arrange_node_set_enabled(&child->sensing.tree->node, activated);
+		arrange_node_set_position(&child->scene_tree->node, 0, title_height);
+		arrange_node_reparent(&child->scene_tree->node, content);
 
 		if (activated) {
 			wsm_arrange_container_with_title_bar(child, width, height - title_height,
@@ -538,10 +660,10 @@ void arrange_workspace_floating(struct wsm_workspace *ws) {
 			}
 		}
 
-		wlr_scene_node_reparent(&floater->scene_tree->node, layer);
-		wlr_scene_node_set_position(&floater->scene_tree->node,
+		arrange_node_reparent(&floater->scene_tree->node, layer);
+		arrange_node_set_position(&floater->scene_tree->node,
 			floater->current.x, floater->current.y);
-		wlr_scene_node_set_enabled(&floater->scene_tree->node, true);		
+		arrange_node_set_enabled(&floater->scene_tree->node, true);		
 		wsm_arrange_container_with_title_bar(floater, floater->current.width, floater->current.height,
 			true, ws->gaps_inner);
 	}
@@ -3,6 +3,8 @@
 
 #include "wsm_container.h"
 
+#include <stddef.h>
+
 struct wsm_list;
 struct wsm_scene;
 struct wsm_output;
@@ -10,6 +12,17 @@ struct wsm_workspace;
 
 void arrange_root_auto(void);
 void arrange_root_scene(struct wsm_scene *root);
+/**
+ * @brief arrange_workspaces_scene re-lay-out the scene of some workspaces
+ * only, from their current state. Falls back to arrange_root_scene() while a
+ * container is fullscreen on all outputs.
+ */
+void arrange_workspaces_scene(struct wsm_scene *root, struct wsm_list *workspaces);
+/**
+ * @brief arrange_take_scene_mutations number of scene node changes made by
+ * arranging since the last call
+ */
+size_t arrange_take_scene_mutations(void);
 void wsm_arrange_output_auto(struct wsm_output *output);
 void arrange_output_width_size(struct wsm_output *output, int width, int height);
 void wsm_arrange_workspace_auto(struct wsm_workspace *workspace);
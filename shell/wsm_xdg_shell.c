@@ -9,6 +9,8 @@
 #include "wsm_arrange.h"
 #include "wsm_desktop.h"
 #include "wsm_transaction.h"
+#include "wsm_stats.h"
+#include "wsm_trace.h"
 #include "wsm_workspace.h"
 #include "wsm_xdg_decoration.h"
 #include "wsm_server_decoration.h"
@@ -72,17 +74,8 @@ static const char *get_string_prop(struct wsm_view *view,
 		if (new_text) {
 			free(view->app_id);
 			view->app_id = new_text;
-
-			view->app_icon_path = find_app_icon_frome_app_id(
-				global_server.desktop_interface, view->app_id);
-			if (!view->app_icon_path) {
-				view->app_icon_path = find_icon_file_frome_theme(
-					global_server.desktop_interface, WAYLAND_ICON_NAME);
-			}
-		} else {
-			view->app_icon_path = find_icon_file_frome_theme(
-				global_server.desktop_interface, WAYLAND_ICON_NAME);
 		}
+		view_update_app_icon(view, WAYLAND_ICON_NAME);
 		return view->app_id;
 	default:
 		return NULL;
@@ -235,6 +228,14 @@ static void handle_commit(struct wl_listener *listener, void *data) {
 		return;
 	}
 
+	struct wl_client *client = wl_resource_get_client(xdg_surface->surface->resource);
+	wsm_stats_client_commit(client);
+	wsm_trace_client_commit(xdg_surface->surface);
+	// the content type is surface state
+	if (view->container && view->container->current.fullscreen_mode != FULLSCREEN_NONE) {
+		wsm_content_policy_update_all();
+	}
+
 	struct wlr_box new_geo;
 	wlr_xdg_surface_get_geometry(xdg_surface, &new_geo);
 	bool new_size = new_geo.width != view->geometry.width ||
@@ -12,6 +12,8 @@
 #include "wsm_desktop.h"
 #include "wsm_workspace.h"
 #include "wsm_transaction.h"
+#include "wsm_stats.h"
+#include "wsm_trace.h"
 #include "wsm_output_manager.h"
 #include "wsm_input_manager.h"
 #include "node/wsm_node_descriptor.h"
@@ -264,6 +266,93 @@ static char *get_xwayland_surface_app_id(xcb_get_property_reply_t *reply) {
 	}
 }
 
+static void xwayland_view_set_app_id(struct wsm_xwayland_view *xwayland_view,
+		xcb_get_property_reply_t *reply) {
+	struct wsm_view *view = &xwayland_view->view;
+	xwayland_view->app_id_pending = false;
+	xwayland_view->app_id_resolved = true;
+
+	char *new_text = reply ? get_xwayland_surface_app_id(reply) : NULL;
+	if (!new_text && view->wlr_xwayland_surface->instance) {
+		new_text = strdup(view->wlr_xwayland_surface->instance);
+	}
+	if (new_text) {
+		free(view->app_id);
+		view->app_id = new_text;
+	}
+	view_update_app_icon(view, X11_ICON_NAME);
+}
+
+static void xwayland_view_handle_prop_reply(struct wsm_xwayland_view *xwayland_view,
+		enum wsm_xwayland_prop prop, xcb_get_property_reply_t *reply) {
+	struct wsm_view *view = &xwayland_view->view;
+	switch (prop) {
+	case XWAYLAND_PROP_APP_ID:
+		xwayland_view_set_app_id(xwayland_view, reply);
+		if (!view->surface) {
+			break;
+		}
+
+		view_update_app_id(view);
+		if (view->app_icon_path && view->container && view->container->title_bar) {
+			container_arrange_title_bar_node(view->container);
+		}
+		break;
+	}
+}
+
+static bool xwayland_view_fetch_prop(struct wsm_xwayland_view *xwayland_view,
+		enum wsm_xwayland_prop prop, xcb_atom_t atom, xcb_atom_t type) {
+	struct wsm_xwayland *xwayland = &global_server.xwayland;
+	struct wsm_xwayland_prop_request *request =
+		calloc(1, sizeof(struct wsm_xwayland_prop_request));
+	if (!request) {
+		wsm_log(WSM_ERROR, "Could not create wsm_xwayland_prop_request: allocation failed!");
+		return false;
+	}
+
+	xcb_get_property_cookie_t cookie = xcb_get_property(xwayland->xcb_conn, 0,
+		xwayland_view->view.wlr_xwayland_surface->window_id, atom, type, 0, MAX_PROP_SIZE);
+	request->view = xwayland_view;
+	request->prop = prop;
+	request->sequence = cookie.sequence;
+	wl_list_insert(xwayland->prop_requests.prev, &request->link);
+	xwayland_view->prop_requests_pending++;
+	return true;
+}
+
+/**
+ * Sends the property requests of a view in one batch, the replies are read
+ * from the event loop and never waited for.
+ */
+static void xwayland_view_fetch_props(struct wsm_xwayland_view *xwayland_view) {
+	struct wsm_xwayland *xwayland = &global_server.xwayland;
+	if (!xwayland->xcb_conn || !xwayland->atoms_ready ||
+			xwayland_view->app_id_pending || xwayland_view->app_id_resolved) {
+		return;
+	}
+
+	xwayland_view->app_id_pending = xwayland_view_fetch_prop(xwayland_view,
+		XWAYLAND_PROP_APP_ID, xwayland->atoms[GTK_APPLICATION_ID],
+		xwayland->atoms[UTF8_STRING]);
+	xcb_flush(xwayland->xcb_conn);
+}
+
+static void xwayland_view_cancel_props(struct wsm_xwayland_view *xwayland_view) {
+	if (xwayland_view->prop_requests_pending == 0) {
+		return;
+	}
+
+	struct wsm_xwayland_prop_request *request;
+	wl_list_for_each(request, &global_server.xwayland.prop_requests, link) {
+		if (request->view == xwayland_view) {
+			request->view = NULL;
+		}
+	}
+	xwayland_view->prop_requests_pending = 0;
+	xwayland_view->app_id_pending = false;
+}
+
 static const char *get_string_prop(struct wsm_view *view, enum wsm_view_prop prop) {
 	if (xwayland_view_from_view(view) == NULL) {
 		return NULL;
@@ -275,48 +364,17 @@ static const char *get_string_prop(struct wsm_view *view, enum wsm_view_prop pro
 	case VIEW_PROP_CLASS:
 		return view->wlr_xwayland_surface->class;
 	case VIEW_PROP_APP_ID:;
-		if (view->app_id) {
+		struct wsm_xwayland_view *xwayland_view = xwayland_view_from_view(view);
+		if (view->app_id || xwayland_view->app_id_resolved) {
 			return view->app_id;
 		}
-		struct wsm_xwayland *xwayland = &global_server.xwayland;
-		xcb_get_property_cookie_t cookies = xcb_get_property(xwayland->xcb_conn, 0, view->wlr_xwayland_surface->window_id,
-			 xwayland->atoms[GTK_APPLICATION_ID], xwayland->atoms[UTF8_STRING], 0, MAX_PROP_SIZE);
-		xcb_get_property_reply_t *reply =
-			xcb_get_property_reply(xwayland->xcb_conn, cookies, NULL);
-		if (reply->type != XCB_ATOM_STRING &&
-			reply->type != xwayland->atoms[UTF8_STRING]) {
-			char *new_text = strdup(view->wlr_xwayland_surface->instance);
-			if (new_text) {
-				free(view->app_id);
-				view->app_id = new_text;
-
-				view->app_icon_path = find_app_icon_frome_app_id(
-					global_server.desktop_interface, view->app_id);
-				if (!view->app_icon_path) {
-					view->app_icon_path = find_icon_file_frome_theme(
-						global_server.desktop_interface, X11_ICON_NAME);
-				}
-			} else {
-				view->app_icon_path = find_icon_file_frome_theme(
-					global_server.desktop_interface, X11_ICON_NAME);
-			}
-		} else {
-			char *new_text = get_xwayland_surface_app_id(reply);
-			if (new_text) {
-				free(view->app_id);
-				view->app_id = new_text;
-
-				view->app_icon_path = find_app_icon_frome_app_id(
-					global_server.desktop_interface, view->app_id);
-				if (!view->app_icon_path) {
-					view->app_icon_path = find_icon_file_frome_theme(
-						global_server.desktop_interface, X11_ICON_NAME);
-				}
-			} else {
-				view->app_icon_path = find_icon_file_frome_theme(
-					global_server.desktop_interface, X11_ICON_NAME);
-			}
+
+		// Until _GTK_APPLICATION_ID arrives, the instance stands in for it
+		if (xwayland_view->app_id_pending) {
+			return view->wlr_xwayland_surface->instance;
 		}
+
+		xwayland_view_set_app_id(xwayland_view, NULL);
 		return view->app_id;
 	case VIEW_PROP_INSTANCE:
 		return view->wlr_xwayland_surface->instance;
@@ -531,6 +589,14 @@ static void handle_commit(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_surface *xsurface = view->wlr_xwayland_surface;
 	struct wlr_surface_state *state = &xsurface->surface->current;
 
+	struct wl_client *client = wl_resource_get_client(xsurface->surface->resource);
+	wsm_stats_client_commit(client);
+	wsm_trace_client_commit(xsurface->surface);
+	// the content type is surface state
+	if (view->container && view->container->current.fullscreen_mode != FULLSCREEN_NONE) {
+		wsm_content_policy_update_all();
+	}
+
 	struct wlr_box new_geo = {0};
 	new_geo.width = state->width;
 	new_geo.height = state->height;
@@ -571,6 +637,7 @@ static void handle_destroy(struct wl_listener *listener, void *data) {
 		wl_list_remove(&xwayland_view->commit.link);
 	}
 
+	xwayland_view_cancel_props(xwayland_view);
 	xwayland_view->view.wlr_xwayland_surface = NULL;
 
 	wl_list_remove(&xwayland_view->destroy.link);
@@ -872,6 +939,8 @@ static void handle_associate(struct wl_listener *listener, void *data) {
 	xwayland_view->unmap.notify = handle_unmap;
 	wl_signal_add(&xsurface->surface->events.map, &xwayland_view->map);
 	xwayland_view->map.notify = handle_map;
+
+	xwayland_view_fetch_props(xwayland_view);
 }
 
 static void handle_dissociate(struct wl_listener *listener, void *data) {
@@ -977,11 +1046,83 @@ void handle_xwayland_surface(struct wl_listener *listener, void *data) {
 	create_xwayland_view(xsurface);
 }
 
+static void xwayland_poll_atoms(struct wsm_xwayland *xwayland) {
+	while (xwayland->atoms_resolved < ATOM_LAST) {
+		size_t i = xwayland->atoms_resolved;
+		xcb_intern_atom_reply_t *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xwayland->xcb_conn, xwayland->atom_cookies[i].sequence,
+				(void **)&reply, &error)) {
+			return;
+		}
+
+		if (reply != NULL && error == NULL) {
+			xwayland->atoms[i] = reply->atom;
+		}
+		if (error != NULL) {
+			wsm_log(WSM_ERROR, "could not resolve atom %s, X11 error code %d",
+				atom_map[i], error->error_code);
+		}
+		free(reply);
+		free(error);
+		xwayland->atoms_resolved++;
+	}
+
+	xwayland->atoms_ready = true;
+}
+
+static void xwayland_poll_props(struct wsm_xwayland *xwayland) {
+	// Replies arrive in request order, stop at the first one still missing
+	struct wsm_xwayland_prop_request *request, *tmp;
+	wl_list_for_each_safe(request, tmp, &xwayland->prop_requests, link) {
+		xcb_get_property_reply_t *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xwayland->xcb_conn, request->sequence,
+				(void **)&reply, &error)) {
+			return;
+		}
+
+		wl_list_remove(&request->link);
+		if (request->view) {
+			request->view->prop_requests_pending--;
+			xwayland_view_handle_prop_reply(request->view, request->prop, reply);
+		}
+		free(reply);
+		free(error);
+		free(request);
+	}
+}
+
+static int handle_xcb_readable(int fd, uint32_t mask, void *data) {
+	struct wsm_xwayland *xwayland = data;
+	if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+		wsm_log(WSM_ERROR, "XCB connection lost");
+		wl_event_source_remove(xwayland->xcb_source);
+		xwayland->xcb_source = NULL;
+		return 0;
+	}
+
+	// Nothing is selected on this connection, events are only drained
+	xcb_generic_event_t *event;
+	while ((event = xcb_poll_for_event(xwayland->xcb_conn))) {
+		free(event);
+	}
+
+	if (!xwayland->atoms_ready) {
+		xwayland_poll_atoms(xwayland);
+	}
+	if (xwayland->atoms_ready) {
+		xwayland_poll_props(xwayland);
+	}
+	return 0;
+}
+
 void handle_xwayland_ready(struct wl_listener *listener, void *data) {
 	struct wsm_server *server =
 		wl_container_of(listener, server, xwayland_ready);
 	struct wsm_xwayland *xwayland = &server->xwayland;
 
+	wl_list_init(&xwayland->prop_requests);
 	xwayland->xcb_conn = xcb_connect(NULL, NULL);
 	int err = xcb_connection_has_error(xwayland->xcb_conn);
 	if (err) {
@@ -989,29 +1130,19 @@ void handle_xwayland_ready(struct wl_listener *listener, void *data) {
 		return;
 	}
 
-	xcb_intern_atom_cookie_t cookies[ATOM_LAST];
-	for (size_t i = 0; i < ATOM_LAST; i++) {
-		cookies[i] =
-			xcb_intern_atom(xwayland->xcb_conn, 0, strlen(atom_map[i]), atom_map[i]);
+	xwayland->xcb_source = wl_event_loop_add_fd(server->wl_event_loop,
+		xcb_get_file_descriptor(xwayland->xcb_conn), WL_EVENT_READABLE,
+		handle_xcb_readable, xwayland);
+	if (!xwayland->xcb_source) {
+		wsm_log(WSM_ERROR, "Could not watch the XCB connection");
+		return;
 	}
 
 	for (size_t i = 0; i < ATOM_LAST; i++) {
-		xcb_generic_error_t *error = NULL;
-		xcb_intern_atom_reply_t *reply =
-			xcb_intern_atom_reply(xwayland->xcb_conn, cookies[i], &error);
-		if (reply != NULL && error == NULL) {
-			xwayland->atoms[i] = reply->atom;
-		}
-
-		free(reply);
-
-		if (error != NULL) {
-			wsm_log(WSM_ERROR, "could not resolve atom %s, X11 error code %d",
-				atom_map[i], error->error_code);
-			free(error);
-			break;
-		}
+		xwayland->atom_cookies[i] =
+			xcb_intern_atom(xwayland->xcb_conn, 0, strlen(atom_map[i]), atom_map[i]);
 	}
+	xcb_flush(xwayland->xcb_conn);
 }
 
 /**
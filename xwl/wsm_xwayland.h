@@ -7,6 +7,8 @@
 
 #ifdef HAVE_XWAYLAND
 
+#include <wayland-server-core.h>
+
 #include <xcb/xproto.h>
 
 struct wlr_xwayland;
@@ -36,12 +38,33 @@ enum atom_name {
 	ATOM_LAST,
 };
 
+/**
+ * @brief X11 property of a view fetched from the xcb connection, the reply is
+ * read once the connection becomes readable.
+ */
+enum wsm_xwayland_prop {
+	XWAYLAND_PROP_APP_ID,
+};
+
+struct wsm_xwayland_prop_request {
+	struct wl_list link; // wsm_xwayland.prop_requests
+	struct wsm_xwayland_view *view; // NULL when the view went away
+	enum wsm_xwayland_prop prop;
+	unsigned int sequence;
+};
+
 struct wsm_xwayland {
 	xcb_atom_t atoms[ATOM_LAST];
 	struct wlr_xwayland *xwayland_wlr;
 	struct wlr_xcursor_manager *xcursor_manager;
 
 	xcb_connection_t *xcb_conn;
+	struct wl_event_source *xcb_source;
+	/* atoms are interned asynchronously, no property is fetched before */
+	xcb_intern_atom_cookie_t atom_cookies[ATOM_LAST];
+	size_t atoms_resolved;
+	bool atoms_ready;
+	struct wl_list prop_requests; // wsm_xwayland_prop_request.link, in request order
 };
 
 bool xwayland_start(struct wsm_server *server);